@@ -0,0 +1,110 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_POWER
+
+#include "AutosuspendPhaseStats.h"
+
+#include <utils/Trace.h>
+
+#include <iterator>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// Phases mostly take from a few us to a few ms, 1/16th precision is enough to tell them apart.
+static constexpr uint8_t kPhaseHistogramPrecision = 5;
+
+// Indexed by SuspendPhaseInfo::PHASE_*. Also used as atrace slice names.
+static constexpr const char* kPhaseNames[] = {
+    "autosuspend_backoff_wait",       "autosuspend_wakeup_count_read",
+    "autosuspend_wake_lock_wait",     "autosuspend_token_check",
+    "autosuspend_wakeup_count_write", "autosuspend_state_write",
+    "autosuspend_suspend_time_read",  "autosuspend_wakeup_reasons_read",
+    "autosuspend_stats_update",       "autosuspend_notify",
+};
+static_assert(std::size(kPhaseNames) == static_cast<size_t>(SuspendPhaseInfo::NUM_PHASES));
+
+AutosuspendPhaseStats::Phase::Phase() : histogram(kPhaseHistogramPrecision) {}
+
+AutosuspendPhaseStats::AutosuspendPhaseStats() : mPhases(SuspendPhaseInfo::NUM_PHASES) {}
+
+const char* AutosuspendPhaseStats::phaseName(int32_t phase) {
+    if (phase < 0 || phase >= SuspendPhaseInfo::NUM_PHASES) {
+        return nullptr;
+    }
+    return kPhaseNames[phase];
+}
+
+void AutosuspendPhaseStats::record(int32_t phase, std::chrono::nanoseconds duration) {
+    if (phase < 0 || phase >= SuspendPhaseInfo::NUM_PHASES) {
+        return;
+    }
+    int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+
+    auto lock = std::lock_guard(mLock);
+    mPhases[phase].histogram.record(micros);
+    mPhases[phase].totalMicros += micros;
+}
+
+void AutosuspendPhaseStats::getPhaseStats(std::vector<SuspendPhaseInfo>* aidl_return) const {
+    aidl_return->clear();
+
+    auto lock = std::lock_guard(mLock);
+    aidl_return->reserve(mPhases.size());
+    for (int32_t i = 0; i < static_cast<int32_t>(mPhases.size()); i++) {
+        const Phase& phase = mPhases[i];
+        SuspendPhaseInfo info;
+        info.phase = i;
+        info.name = kPhaseNames[i];
+        info.count = phase.histogram.count();
+        info.totalMicros = phase.totalMicros;
+        info.p50Micros = phase.histogram.percentile(50);
+        info.p90Micros = phase.histogram.percentile(90);
+        info.p99Micros = phase.histogram.percentile(99);
+        info.maxMicros = phase.histogram.max();
+        aidl_return->emplace_back(std::move(info));
+    }
+}
+
+ScopedAutosuspendPhase::ScopedAutosuspendPhase(AutosuspendPhaseStats* stats, int32_t phase)
+    : mStats(stats), mPhase(phase), mStart(std::chrono::steady_clock::now()) {
+    const char* name = AutosuspendPhaseStats::phaseName(phase);
+    ATRACE_BEGIN(name != nullptr ? name : "autosuspend_unknown_phase");
+}
+
+ScopedAutosuspendPhase::~ScopedAutosuspendPhase() {
+    end();
+}
+
+/**
+ * Ends the phase. Calling it again does nothing.
+ */
+void ScopedAutosuspendPhase::end() {
+    if (mEnded) {
+        return;
+    }
+    mEnded = true;
+    ATRACE_END();
+    mStats->record(mPhase, std::chrono::steady_clock::now() - mStart);
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
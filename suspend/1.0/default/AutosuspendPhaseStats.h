@@ -0,0 +1,90 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_AUTOSUSPEND_PHASE_STATS_H
+#define ANDROID_SYSTEM_SUSPEND_AUTOSUSPEND_PHASE_STATS_H
+
+#include <android-base/thread_annotations.h>
+#include <android/system/suspend/internal/SuspendPhaseInfo.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "DurationHistogram.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using ::android::system::suspend::internal::SuspendPhaseInfo;
+
+/*
+ * Time spent in each phase of the autosuspend loop, see SuspendPhaseInfo for the phases.
+ * This class is thread safe.
+ */
+class AutosuspendPhaseStats {
+   public:
+    AutosuspendPhaseStats();
+
+    void record(int32_t phase, std::chrono::nanoseconds duration);
+    void getPhaseStats(std::vector<SuspendPhaseInfo>* aidl_return) const;
+
+    // Returns the name of the phase, or nullptr if phase is not one of SuspendPhaseInfo::PHASE_*.
+    static const char* phaseName(int32_t phase);
+
+   private:
+    struct Phase {
+        Phase();
+
+        // Durations in us.
+        DurationHistogram histogram;
+        int64_t totalMicros = 0;
+    };
+
+    mutable std::mutex mLock;
+    std::vector<Phase> mPhases GUARDED_BY(mLock);
+};
+
+/*
+ * Times a phase of the autosuspend loop from its construction until end() is called or it is
+ * destroyed, whichever comes first, and traces the phase as an atrace slice.
+ */
+class ScopedAutosuspendPhase {
+   public:
+    ScopedAutosuspendPhase(AutosuspendPhaseStats* stats, int32_t phase);
+    ~ScopedAutosuspendPhase();
+
+    ScopedAutosuspendPhase(const ScopedAutosuspendPhase&) = delete;
+    ScopedAutosuspendPhase& operator=(const ScopedAutosuspendPhase&) = delete;
+
+    void end();
+
+   private:
+    AutosuspendPhaseStats* mStats;
+    int32_t mPhase;
+    std::chrono::steady_clock::time_point mStart;
+    bool mEnded = false;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_AUTOSUSPEND_PHASE_STATS_H
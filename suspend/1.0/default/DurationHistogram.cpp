@@ -0,0 +1,128 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DurationHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// Durations are counted up to 2^kMaxBits - 1, e.g. about 49 days in ms or 71 minutes in us.
+static constexpr uint8_t kMaxBits = 32;
+static constexpr uint64_t kMaxDuration = (uint64_t{1} << kMaxBits) - 1;
+// Percentiles within 0.05% are more than enough.
+static constexpr uint8_t kMaxPrecision = 12;
+
+/**
+ * Durations of up to precision bits each get their own bucket. Each further bit adds 2^(precision
+ * - 1) buckets, one per value of the top precision bits of the duration.
+ */
+static size_t numBuckets(uint8_t precision) {
+    if (precision == 0) {
+        return 0;
+    }
+    return (kMaxBits - precision + 2) * (size_t{1} << (precision - 1));
+}
+
+uint8_t DurationHistogram::precisionForSize(size_t bytes) {
+    for (uint8_t precision = kMaxPrecision; precision > 0; precision--) {
+        if (sizeForPrecision(precision) <= bytes) {
+            return precision;
+        }
+    }
+    return 0;
+}
+
+size_t DurationHistogram::sizeForPrecision(uint8_t precision) {
+    return numBuckets(precision) * sizeof(uint32_t);
+}
+
+DurationHistogram::DurationHistogram(uint8_t precision)
+    : mPrecision(std::min(precision, kMaxPrecision)),
+      mNumBuckets(numBuckets(mPrecision)),
+      mBuckets(mNumBuckets > 0 ? std::make_unique<uint32_t[]>(mNumBuckets) : nullptr) {}
+
+size_t DurationHistogram::bucketIndex(uint64_t duration) const {
+    size_t bits = 64 - __builtin_clzll(duration | 1);
+    if (bits <= mPrecision) {
+        return duration;
+    }
+    size_t shift = bits - mPrecision;
+    return (shift << (mPrecision - 1)) + (duration >> shift);
+}
+
+uint64_t DurationHistogram::bucketEnd(size_t index) const {
+    size_t halfCount = size_t{1} << (mPrecision - 1);
+    if (index < 2 * halfCount) {
+        return index;
+    }
+    size_t shift = index / halfCount - 1;
+    uint64_t start = static_cast<uint64_t>(index - (shift << (mPrecision - 1))) << shift;
+    return start + (uint64_t{1} << shift) - 1;
+}
+
+void DurationHistogram::record(int64_t duration) {
+    if (mNumBuckets == 0) {
+        return;
+    }
+    duration = std::max<int64_t>(duration, 0);
+    uint32_t& bucket = mBuckets[bucketIndex(std::min<uint64_t>(duration, kMaxDuration))];
+    if (bucket < std::numeric_limits<uint32_t>::max()) {
+        bucket++;
+    }
+    mCount++;
+    mMax = std::max(mMax, duration);
+}
+
+void DurationHistogram::merge(const DurationHistogram& other) {
+    if (other.mPrecision != mPrecision || mNumBuckets == 0) {
+        return;
+    }
+    for (size_t i = 0; i < mNumBuckets; i++) {
+        uint64_t sum = uint64_t{mBuckets[i]} + other.mBuckets[i];
+        mBuckets[i] = std::min<uint64_t>(sum, std::numeric_limits<uint32_t>::max());
+    }
+    mCount += other.mCount;
+    mMax = std::max(mMax, other.mMax);
+}
+
+int64_t DurationHistogram::percentile(double percentile) const {
+    if (mCount == 0) {
+        return 0;
+    }
+    double rank = std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * mCount);
+    uint64_t target = std::max<uint64_t>(static_cast<uint64_t>(rank), 1);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < mNumBuckets; i++) {
+        seen += mBuckets[i];
+        if (seen >= target) {
+            return std::min<int64_t>(bucketEnd(i), mMax);
+        }
+    }
+    // Only reached if bucket counts saturated.
+    return mMax;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
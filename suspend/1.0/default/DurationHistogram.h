@@ -0,0 +1,75 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_DURATION_HISTOGRAM_H
+#define ANDROID_SYSTEM_SUSPEND_DURATION_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * Log-linear histogram of durations with a fixed memory footprint, in the spirit of HdrHistogram.
+ * Durations are in an integer unit chosen by the user, e.g. ms. Durations below 2^precision are
+ * counted exactly. Above that, each power of two range is split into 2^(precision - 1) buckets, so
+ * a recorded duration is known within 1 / 2^(precision - 1) of its value. Durations of 2^32 or
+ * more are counted as 2^32 - 1.
+ * This class is not thread safe.
+ */
+class DurationHistogram {
+   public:
+    // Returns the highest precision whose histogram fits in bytes, or 0 if none does.
+    static uint8_t precisionForSize(size_t bytes);
+    // Returns the memory used by the buckets of a histogram of the given precision.
+    static size_t sizeForPrecision(uint8_t precision);
+
+    // A histogram of precision 0 records nothing and takes no memory.
+    explicit DurationHistogram(uint8_t precision);
+
+    void record(int64_t duration);
+    // Returns the smallest duration that at least percentile percent of the recorded durations are
+    // not longer than, rounded up to the end of its bucket but never above the longest recorded
+    // duration. Returns 0 if nothing was recorded.
+    int64_t percentile(double percentile) const;
+    // Adds the durations recorded by other, which must have the same precision.
+    void merge(const DurationHistogram& other);
+
+    uint8_t precision() const { return mPrecision; }
+    uint64_t count() const { return mCount; }
+    int64_t max() const { return mMax; }
+
+   private:
+    size_t bucketIndex(uint64_t duration) const;
+    uint64_t bucketEnd(size_t index) const;
+
+    uint8_t mPrecision;
+    size_t mNumBuckets;
+    std::unique_ptr<uint32_t[]> mBuckets;
+    uint64_t mCount = 0;
+    int64_t mMax = 0;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_DURATION_HISTOGRAM_H
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LegacyWakeLocks.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+using ::android::base::WriteStringToFd;
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+LegacyWakeLocks::LegacyWakeLocks(int wakeLockFd, int wakeUnlockFd)
+    : mWakeLockFd(wakeLockFd), mWakeUnlockFd(wakeUnlockFd) {}
+
+LegacyWakeLocks::Stripe& LegacyWakeLocks::getStripe(const WakeLockName& name) {
+    return mStripes[name.id() % kNumStripes];
+}
+
+void LegacyWakeLocks::acquire(const WakeLockName& name) {
+    Stripe& stripe = getStripe(name);
+    std::lock_guard<std::mutex> lock(stripe.lock);
+
+    auto it = stripe.holders.try_emplace(name.id(), Holders{name, 0}).first;
+    if (it->second.count++ > 0) {
+        mAvoidedWriteCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    mWriteCount.fetch_add(1, std::memory_order_relaxed);
+    if (!WriteStringToFd(name.str(), mWakeLockFd)) {
+        PLOG(ERROR) << "error writing " << name.str() << " to /sys/power/wake_lock";
+    }
+}
+
+void LegacyWakeLocks::release(const WakeLockName& name) {
+    Stripe& stripe = getStripe(name);
+    std::lock_guard<std::mutex> lock(stripe.lock);
+
+    auto it = stripe.holders.find(name.id());
+    if (it == stripe.holders.end()) {
+        LOG(WARNING) << "releasing " << name.str() << " which is not held";
+        return;
+    }
+    if (--it->second.count > 0) {
+        mAvoidedWriteCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    stripe.holders.erase(it);
+    mWriteCount.fetch_add(1, std::memory_order_relaxed);
+    if (!WriteStringToFd(name.str(), mWakeUnlockFd)) {
+        PLOG(ERROR) << "error writing " << name.str() << " to /sys/power/wake_unlock";
+    }
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
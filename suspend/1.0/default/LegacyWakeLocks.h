@@ -0,0 +1,84 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_LEGACY_WAKE_LOCKS_H
+#define ANDROID_SYSTEM_SUSPEND_LEGACY_WAKE_LOCKS_H
+
+#include <android-base/thread_annotations.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "WakeLockName.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * Native wake locks taken through /sys/power/wake_lock, when the suspend counter is not used.
+ * The kernel does not count the holders of a wake lock, so the holders are counted here and only
+ * the first acquisition and the last release of a name are written to the kernel.
+ * This class is thread safe.
+ */
+class LegacyWakeLocks {
+   public:
+    // The fds of /sys/power/wake_lock and /sys/power/wake_unlock must outlive this object.
+    LegacyWakeLocks(int wakeLockFd, int wakeUnlockFd);
+
+    void acquire(const WakeLockName& name);
+    void release(const WakeLockName& name);
+
+    // Number of writes to /sys/power/wake_lock and wake_unlock.
+    uint64_t getWriteCount() const { return mWriteCount; }
+    // Number of acquisitions and releases that were not written because the name had other
+    // holders.
+    uint64_t getAvoidedWriteCount() const { return mAvoidedWriteCount; }
+
+   private:
+    struct Holders {
+        // Keeps the id interned while the name is held.
+        WakeLockName name;
+        uint32_t count;
+    };
+    // Names are split across stripes by id. The lock of a stripe is held while writing to the
+    // kernel, so that the writes for a name are in the same order as its holder count changes,
+    // without making writes for other names wait.
+    struct Stripe {
+        std::mutex lock;
+        std::unordered_map<WakeLockNameId, Holders> holders GUARDED_BY(lock);
+    };
+    static constexpr size_t kNumStripes = 16;
+
+    Stripe& getStripe(const WakeLockName& name);
+
+    int mWakeLockFd;
+    int mWakeUnlockFd;
+    std::array<Stripe, kNumStripes> mStripes;
+    std::atomic<uint64_t> mWriteCount{0};
+    std::atomic<uint64_t> mAvoidedWriteCount{0};
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_LEGACY_WAKE_LOCKS_H
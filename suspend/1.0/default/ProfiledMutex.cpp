@@ -0,0 +1,192 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProfiledMutex.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// Wait and hold times range from under a us to seconds, 1/16th precision is enough.
+static constexpr uint8_t kLockHistogramPrecision = 5;
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+std::atomic<bool> ProfiledMutex::sProfilingEnabled{false};
+
+/**
+ * Returns the name of the calling thread, read once per thread since binder threads keep their
+ * names.
+ */
+static const char* currentThreadName() {
+    thread_local char name[16] = {};
+    thread_local bool named = false;
+    if (!named) {
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        named = true;
+    }
+    return name;
+}
+
+LockStats::LockStats() : waitTimes(kLockHistogramPrecision), holdTimes(kLockHistogramPrecision) {}
+
+ProfiledMutex::ProfiledMutex(const char* name)
+    : mName(name), mWaitTimes(kLockHistogramPrecision), mHoldTimes(kLockHistogramPrecision) {}
+
+void ProfiledMutex::setProfilingEnabled(bool enabled) {
+    sProfilingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool ProfiledMutex::isProfilingEnabled() {
+    return sProfilingEnabled.load(std::memory_order_relaxed);
+}
+
+void ProfiledMutex::lock() NO_THREAD_SAFETY_ANALYSIS {
+    if (!isProfilingEnabled()) {
+        mMutex.lock();
+        mAcquireTime = {};
+        return;
+    }
+
+    auto start = steady_clock::now();
+    if (mMutex.try_lock()) {
+        recordAcquire(start, false);
+        return;
+    }
+    // Only contended acquisitions pay for looking up the waiter.
+    const char* threadName = currentThreadName();
+    mMutex.lock();
+    auto acquireTime = steady_clock::now();
+    recordAcquire(acquireTime, true);
+    recordWaiter(threadName, acquireTime - start);
+}
+
+bool ProfiledMutex::try_lock() NO_THREAD_SAFETY_ANALYSIS {
+    if (!mMutex.try_lock()) {
+        return false;
+    }
+    if (isProfilingEnabled()) {
+        recordAcquire(steady_clock::now(), false);
+    } else {
+        mAcquireTime = {};
+    }
+    return true;
+}
+
+void ProfiledMutex::unlock() NO_THREAD_SAFETY_ANALYSIS {
+    if (mAcquireTime != steady_clock::time_point{}) {
+        auto hold = steady_clock::now() - mAcquireTime;
+        mHoldTimes.record(duration_cast<microseconds>(hold).count());
+        mTotalHold += hold;
+        mAcquireTime = {};
+    }
+    mMutex.unlock();
+}
+
+/**
+ * Records an acquisition at acquireTime. Uncontended acquisitions are recorded as not waiting at
+ * all, the wait of contended ones is recorded by recordWaiter().
+ */
+void ProfiledMutex::recordAcquire(steady_clock::time_point acquireTime, bool contended) {
+    mAcquireTime = acquireTime;
+    mAcquireCount++;
+    if (contended) {
+        mContendedCount++;
+    } else {
+        mWaitTimes.record(0);
+    }
+}
+
+/**
+ * Records the wait of a contended acquisition, by the calling thread. The waiters table keeps the
+ * threads with the longest total waits: a new thread only replaces the waiter with the shortest
+ * total wait if it has just waited longer than that.
+ */
+void ProfiledMutex::recordWaiter(const char* threadName, std::chrono::nanoseconds wait) {
+    mWaitTimes.record(duration_cast<microseconds>(wait).count());
+    mTotalWait += wait;
+
+    pid_t tid = gettid();
+    Waiter* shortest = &mWaiters[0];
+    for (Waiter& waiter : mWaiters) {
+        if (waiter.tid == tid) {
+            waiter.count++;
+            waiter.totalWait += wait;
+            return;
+        }
+        if (waiter.totalWait < shortest->totalWait) {
+            shortest = &waiter;
+        }
+    }
+    // Free slots have no wait, so they are the first to be taken.
+    if (shortest->tid != 0 && shortest->totalWait >= wait) {
+        return;
+    }
+    shortest->tid = tid;
+    std::copy_n(threadName, sizeof(shortest->threadName), shortest->threadName);
+    shortest->threadName[sizeof(shortest->threadName) - 1] = '\0';
+    shortest->count = 1;
+    shortest->totalWait = wait;
+}
+
+void ProfiledMutex::addStats(LockStats* stats) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        stats->acquireCount += mAcquireCount;
+        stats->contendedCount += mContendedCount;
+        stats->totalWaitMicros += duration_cast<microseconds>(mTotalWait).count();
+        stats->totalHoldMicros += duration_cast<microseconds>(mTotalHold).count();
+        stats->waitTimes.merge(mWaitTimes);
+        stats->holdTimes.merge(mHoldTimes);
+
+        for (const Waiter& waiter : mWaiters) {
+            if (waiter.tid == 0) {
+                continue;
+            }
+            int64_t totalWaitMicros = duration_cast<microseconds>(waiter.totalWait).count();
+            auto it = std::find_if(stats->topWaiters.begin(), stats->topWaiters.end(),
+                                   [&](const LockWaiter& w) { return w.tid == waiter.tid; });
+            if (it != stats->topWaiters.end()) {
+                it->count += waiter.count;
+                it->totalWaitMicros += totalWaitMicros;
+            } else {
+                stats->topWaiters.push_back(
+                    {waiter.tid, waiter.threadName, waiter.count, totalWaitMicros});
+            }
+        }
+    }
+
+    std::sort(stats->topWaiters.begin(), stats->topWaiters.end(),
+              [](const LockWaiter& a, const LockWaiter& b) {
+                  return a.totalWaitMicros > b.totalWaitMicros;
+              });
+    if (stats->topWaiters.size() > kMaxWaiters) {
+        stats->topWaiters.resize(kMaxWaiters);
+    }
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_PROFILED_MUTEX_H
+#define ANDROID_SYSTEM_SUSPEND_PROFILED_MUTEX_H
+
+#include <android-base/thread_annotations.h>
+#include <sys/types.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DurationHistogram.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// A thread that waited for a ProfiledMutex.
+struct LockWaiter {
+    pid_t tid;
+    std::string threadName;
+    uint64_t count;
+    int64_t totalWaitMicros;
+};
+
+// Contention stats of one or more ProfiledMutex.
+struct LockStats {
+    LockStats();
+
+    std::string name;
+    uint64_t acquireCount = 0;
+    // Acquisitions that had to wait for another holder.
+    uint64_t contendedCount = 0;
+    int64_t totalWaitMicros = 0;
+    int64_t totalHoldMicros = 0;
+    // Durations in us.
+    DurationHistogram waitTimes;
+    DurationHistogram holdTimes;
+    // The threads that waited the longest in total, the longest first.
+    std::vector<LockWaiter> topWaiters;
+};
+
+/*
+ * Mutex that records how often it is acquired, how long it is waited for and held, and which
+ * threads wait for it the most. Recording is done while holding the mutex, and only while
+ * profiling is enabled, otherwise locking costs a relaxed atomic load on top of std::mutex.
+ * Meets the Lockable requirements, waiting on it requires std::condition_variable_any.
+ */
+class CAPABILITY("mutex") ProfiledMutex {
+   public:
+    explicit ProfiledMutex(const char* name);
+
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void lock() ACQUIRE();
+    void unlock() RELEASE();
+    bool try_lock() TRY_ACQUIRE(true);
+
+    const char* name() const { return mName; }
+    // Adds the stats of this mutex to stats. Must not be called while holding the mutex.
+    void addStats(LockStats* stats);
+
+    // Profiling is off by default and applies to all ProfiledMutex of the process.
+    static void setProfilingEnabled(bool enabled);
+    static bool isProfilingEnabled();
+
+   private:
+    struct Waiter {
+        pid_t tid = 0;
+        char threadName[16] = {};
+        uint64_t count = 0;
+        std::chrono::nanoseconds totalWait{0};
+    };
+    static constexpr size_t kMaxWaiters = 8;
+
+    void recordAcquire(std::chrono::steady_clock::time_point acquireTime, bool contended);
+    void recordWaiter(const char* threadName, std::chrono::nanoseconds wait);
+
+    static std::atomic<bool> sProfilingEnabled;
+
+    std::mutex mMutex;
+    const char* mName;
+    // All below are only accessed while holding mMutex.
+    // Time the current holder acquired the mutex, or the epoch if it was not profiled.
+    std::chrono::steady_clock::time_point mAcquireTime;
+    uint64_t mAcquireCount = 0;
+    uint64_t mContendedCount = 0;
+    std::chrono::nanoseconds mTotalWait{0};
+    std::chrono::nanoseconds mTotalHold{0};
+    DurationHistogram mWaitTimes;
+    DurationHistogram mHoldTimes;
+    std::array<Waiter, kMaxWaiters> mWaiters;
+};
+
+/*
+ * ProfiledMutex equivalent of android::base::ScopedLockAssertion, to tell the thread safety
+ * analysis that a ProfiledMutex is held, e.g. through a std::unique_lock.
+ */
+class SCOPED_CAPABILITY ScopedProfiledLockAssertion {
+   public:
+    explicit ScopedProfiledLockAssertion(ProfiledMutex& mutex) ACQUIRE(mutex) {}
+    ~ScopedProfiledLockAssertion() RELEASE() {}
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_PROFILED_MUTEX_H
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SuspendBackoffPolicy.h"
+
+#include <algorithm>
+#include <cmath>
+
+using ::android::base::Error;
+using namespace std::chrono_literals;
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// Weight of the latest attempt in the moving averages of AdaptiveBackoffPolicy.
+static constexpr double kAverageWeight = 1.0 / 8;
+// Fraction of the time that AdaptiveBackoffPolicy lets suspend attempts spend in overhead.
+static constexpr double kOverheadBudget = 0.1;
+// Lower bound of SleepTimeConfig.baseSleepTime. A base sleep time of 0 would never grow when
+// backing off, and the suspend loop would spin on bad suspends.
+static constexpr std::chrono::milliseconds kMinBaseSleepTime = 1ms;
+// Upper bound of SleepTimeConfig.maxSleepTime, past which backing off would look like a stalled
+// suspend loop.
+static constexpr std::chrono::milliseconds kMaxSleepTimeLimit = 60s;
+
+bool operator==(const SleepTimeConfig& a, const SleepTimeConfig& b) {
+    return a.baseSleepTime == b.baseSleepTime && a.maxSleepTime == b.maxSleepTime &&
+           a.sleepTimeScaleFactor == b.sleepTimeScaleFactor &&
+           a.backoffThreshold == b.backoffThreshold &&
+           a.shortSuspendThreshold == b.shortSuspendThreshold &&
+           a.failedSuspendBackoffEnabled == b.failedSuspendBackoffEnabled &&
+           a.shortSuspendBackoffEnabled == b.shortSuspendBackoffEnabled &&
+           a.eventDrivenAutosuspendEnabled == b.eventDrivenAutosuspendEnabled &&
+           a.backoffPolicy == b.backoffPolicy;
+}
+
+bool operator!=(const SleepTimeConfig& a, const SleepTimeConfig& b) {
+    return !(a == b);
+}
+
+Result<void> validateSleepTimeConfig(const SleepTimeConfig& config) {
+    if (config.baseSleepTime < kMinBaseSleepTime) {
+        return Error() << "base sleep time " << config.baseSleepTime.count() << " ms is below "
+                       << kMinBaseSleepTime.count() << " ms";
+    }
+    if (config.maxSleepTime < config.baseSleepTime) {
+        return Error() << "max sleep time " << config.maxSleepTime.count()
+                       << " ms is below the base sleep time " << config.baseSleepTime.count()
+                       << " ms";
+    }
+    if (config.maxSleepTime > kMaxSleepTimeLimit) {
+        return Error() << "max sleep time " << config.maxSleepTime.count() << " ms exceeds "
+                       << kMaxSleepTimeLimit.count() << " ms";
+    }
+    if (!std::isfinite(config.sleepTimeScaleFactor) || config.sleepTimeScaleFactor < 1.0) {
+        return Error() << "sleep time scale factor " << config.sleepTimeScaleFactor
+                       << " is not a finite number of at least 1";
+    }
+    if (config.shortSuspendThreshold < 0ms) {
+        return Error() << "negative short suspend threshold "
+                       << config.shortSuspendThreshold.count() << " ms";
+    }
+    return {};
+}
+
+std::unique_ptr<SuspendBackoffPolicy> SuspendBackoffPolicy::create(SuspendBackoffPolicyType type) {
+    switch (type) {
+        case SuspendBackoffPolicyType::ADAPTIVE:
+            return std::make_unique<AdaptiveBackoffPolicy>();
+        case SuspendBackoffPolicyType::EXPONENTIAL:
+        default:
+            return std::make_unique<ExponentialBackoffPolicy>();
+    }
+}
+
+bool SuspendBackoffPolicy::parseType(std::string_view name, SuspendBackoffPolicyType* type) {
+    if (name == "exponential") {
+        *type = SuspendBackoffPolicyType::EXPONENTIAL;
+    } else if (name == "adaptive") {
+        *type = SuspendBackoffPolicyType::ADAPTIVE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Time (in milliseconds) between suspend attempts is described the formula
+ * t[n] = { B, 0 < n <= N
+ *        { min(B * (S**(n - N)), M), n > N
+ * where:
+ *   n is the number of consecutive bad suspend attempts,
+ *   B = baseSleepTime,
+ *   N = backoffThreshold,
+ *   S = sleepTimeScaleFactor,
+ *   M = maxSleepTime
+ */
+std::chrono::milliseconds ExponentialBackoffPolicy::nextSleepTime(
+    const SleepTimeConfig& config, const SuspendAttempt& attempt,
+    std::chrono::milliseconds sleepTime) {
+    if (!attempt.bad) {
+        return config.baseSleepTime;
+    }
+    if (attempt.numConsecutiveBadSuspends < config.backoffThreshold) {
+        return sleepTime;
+    }
+    return std::min(std::chrono::round<std::chrono::milliseconds>(
+                        sleepTime * config.sleepTimeScaleFactor),
+                    config.maxSleepTime);
+}
+
+/**
+ * Picks the wait t such that the average overhead O of an attempt is kOverheadBudget of the
+ * average time spent per attempt:
+ *   O = kOverheadBudget * (t + (1 - R) * D + O)
+ * where R is the bad suspend rate and D the suspend duration, counted only for good suspends
+ * since short suspends are mostly overhead. The wait is kept within [baseSleepTime,
+ * maxSleepTime], and backing off still starts after backoffThreshold bad suspends in a row.
+ */
+std::chrono::milliseconds AdaptiveBackoffPolicy::nextSleepTime(
+    const SleepTimeConfig& config, const SuspendAttempt& attempt,
+    std::chrono::milliseconds /* sleepTime */) {
+    double badSample = attempt.bad ? 1 : 0;
+    double overheadSample =
+        std::chrono::duration<double, std::milli>(attempt.suspendOverhead).count();
+    if (!mHasSamples) {
+        mBadSuspendRate = badSample;
+        mSuspendOverheadMillis = overheadSample;
+        mHasSamples = true;
+    } else {
+        mBadSuspendRate += kAverageWeight * (badSample - mBadSuspendRate);
+        mSuspendOverheadMillis += kAverageWeight * (overheadSample - mSuspendOverheadMillis);
+    }
+    if (attempt.success && !attempt.bad) {
+        double suspendTimeSample =
+            std::chrono::duration<double, std::milli>(attempt.suspendTime).count();
+        if (!mHasSuspendTimeSamples) {
+            mSuspendTimeMillis = suspendTimeSample;
+            mHasSuspendTimeSamples = true;
+        } else {
+            mSuspendTimeMillis += kAverageWeight * (suspendTimeSample - mSuspendTimeMillis);
+        }
+    }
+
+    if (!attempt.bad || attempt.numConsecutiveBadSuspends < config.backoffThreshold) {
+        return config.baseSleepTime;
+    }
+
+    double productiveMillis = (1 - mBadSuspendRate) * mSuspendTimeMillis;
+    double waitMillis =
+        mSuspendOverheadMillis / kOverheadBudget - mSuspendOverheadMillis - productiveMillis;
+    auto wait = std::chrono::milliseconds(std::llround(std::max(waitMillis, 0.0)));
+    return std::clamp(wait, config.baseSleepTime,
+                      std::max(config.baseSleepTime, config.maxSleepTime));
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_SUSPEND_BACKOFF_POLICY_H
+#define ANDROID_SYSTEM_SUSPEND_SUSPEND_BACKOFF_POLICY_H
+
+#include <android-base/result.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using ::android::base::Result;
+
+enum class SuspendBackoffPolicyType {
+    // See ExponentialBackoffPolicy.
+    EXPONENTIAL,
+    // See AdaptiveBackoffPolicy.
+    ADAPTIVE,
+};
+
+struct SleepTimeConfig {
+    std::chrono::milliseconds baseSleepTime;
+    std::chrono::milliseconds maxSleepTime;
+    double sleepTimeScaleFactor;
+    uint32_t backoffThreshold;
+    std::chrono::milliseconds shortSuspendThreshold;
+    bool failedSuspendBackoffEnabled;
+    bool shortSuspendBackoffEnabled;
+    // If true, the suspend loop only waits between suspend attempts while backing off after bad
+    // suspends. Otherwise, it always waits the current sleep time before each suspend attempt.
+    bool eventDrivenAutosuspendEnabled;
+    SuspendBackoffPolicyType backoffPolicy;
+};
+
+bool operator==(const SleepTimeConfig& a, const SleepTimeConfig& b);
+bool operator!=(const SleepTimeConfig& a, const SleepTimeConfig& b);
+
+// Returns an error if the config could stall or spin the suspend loop.
+Result<void> validateSleepTimeConfig(const SleepTimeConfig& config);
+
+// Outcome of a suspend attempt.
+struct SuspendAttempt {
+    bool success;
+    // Failed or short suspend, counted as bad according to the SleepTimeConfig.
+    bool bad;
+    // Number of bad suspend attempts in a row before this one.
+    uint32_t numConsecutiveBadSuspends;
+    std::chrono::nanoseconds suspendTime;
+    std::chrono::nanoseconds suspendOverhead;
+};
+
+/*
+ * Chooses the time the suspend loop waits before the next suspend attempt.
+ * Implementations are only called from the suspend loop and need not be thread safe.
+ */
+class SuspendBackoffPolicy {
+   public:
+    static std::unique_ptr<SuspendBackoffPolicy> create(SuspendBackoffPolicyType type);
+    // Returns false if name is not the name of a policy.
+    static bool parseType(std::string_view name, SuspendBackoffPolicyType* type);
+
+    virtual ~SuspendBackoffPolicy() = default;
+
+    virtual const char* name() const = 0;
+    // Returns the time to wait before the next suspend attempt, after waiting sleepTime before
+    // the last one.
+    virtual std::chrono::milliseconds nextSleepTime(const SleepTimeConfig& config,
+                                                    const SuspendAttempt& attempt,
+                                                    std::chrono::milliseconds sleepTime) = 0;
+};
+
+/*
+ * Waits the base sleep time until backoffThreshold bad suspends in a row, then multiplies the
+ * sleep time by sleepTimeScaleFactor after each further bad suspend, up to maxSleepTime.
+ */
+class ExponentialBackoffPolicy : public SuspendBackoffPolicy {
+   public:
+    const char* name() const override { return "exponential"; }
+    std::chrono::milliseconds nextSleepTime(const SleepTimeConfig& config,
+                                            const SuspendAttempt& attempt,
+                                            std::chrono::milliseconds sleepTime) override;
+};
+
+/*
+ * Keeps moving averages of the bad suspend rate, of the suspend overhead and of the suspend
+ * duration. Once backing off, waits long enough for the overhead of suspend attempts to stay a
+ * small fraction of the time spent waiting, suspending and resuming, so that the wait only grows
+ * with repeated bad suspends if they are expensive and do not suspend for long.
+ */
+class AdaptiveBackoffPolicy : public SuspendBackoffPolicy {
+   public:
+    const char* name() const override { return "adaptive"; }
+    std::chrono::milliseconds nextSleepTime(const SleepTimeConfig& config,
+                                            const SuspendAttempt& attempt,
+                                            std::chrono::milliseconds sleepTime) override;
+
+    double getBadSuspendRate() const { return mBadSuspendRate; }
+    double getSuspendOverheadMillis() const { return mSuspendOverheadMillis; }
+    double getSuspendTimeMillis() const { return mSuspendTimeMillis; }
+
+   private:
+    bool mHasSamples = false;
+    double mBadSuspendRate = 0;
+    // Of all attempts.
+    double mSuspendOverheadMillis = 0;
+    bool mHasSuspendTimeSamples = false;
+    // Of good attempts.
+    double mSuspendTimeMillis = 0;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_SUSPEND_BACKOFF_POLICY_H
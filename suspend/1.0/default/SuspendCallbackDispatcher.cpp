@@ -0,0 +1,125 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SuspendCallbackDispatcher.h"
+
+#include <android-base/logging.h>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+SuspendCallbackDispatcher::SuspendCallbackDispatcher(const sp<ISuspendCallback>& callback,
+                                                     const SuspendCallbackConfig& config)
+    : mCallback(callback), mConfig(config) {
+    mThread = std::thread(&SuspendCallbackDispatcher::run, this);
+}
+
+SuspendCallbackDispatcher::~SuspendCallbackDispatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopped = true;
+    }
+    mCondVar.notify_all();
+    mThread.join();
+}
+
+const sp<ISuspendCallback>& SuspendCallbackDispatcher::getCallback() const {
+    return mCallback;
+}
+
+/**
+ * Queues a wakeup for delivery. Never blocks on the callback: when the queue is full because the
+ * callback does not keep up, the oldest queued wakeup is dropped, and wakeups left queued past
+ * the delivery deadline are dropped before reaching the callback.
+ */
+void SuspendCallbackDispatcher::enqueue(bool success,
+                                        const std::vector<std::string>& wakeupReasons) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mConfig.coalesceWakeups && !mQueue.empty()) {
+            // The pending wakeup now carries fresh news, restart its delivery deadline.
+            Wakeup& pending = mQueue.back();
+            pending.success = success;
+            pending.wakeupReasons = wakeupReasons;
+            pending.enqueueTime = Clock::now();
+            mCoalescedCount++;
+            return;
+        }
+        if (mQueue.size() >= std::max<size_t>(mConfig.queueCapacity, 1)) {
+            mQueue.pop_front();
+            mDroppedCount++;
+        }
+        mQueue.push_back({success, wakeupReasons, Clock::now()});
+    }
+    mCondVar.notify_one();
+}
+
+void SuspendCallbackDispatcher::run() {
+    while (true) {
+        Wakeup wakeup;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mCondVar.wait(lock, [this] {
+                android::base::ScopedLockAssertion lock_assertion(mLock);
+                return mStopped || !mQueue.empty();
+            });
+            if (mStopped) {
+                return;
+            }
+            wakeup = std::move(mQueue.front());
+            mQueue.pop_front();
+            if (Clock::now() - wakeup.enqueueTime > mConfig.deliveryDeadline) {
+                mExpiredCount++;
+                continue;
+            }
+        }
+
+        mCallback->notifyWakeup(wakeup.success, wakeup.wakeupReasons).isOk();  // ignore errors
+        Clock::duration latency = Clock::now() - wakeup.enqueueTime;
+
+        std::lock_guard<std::mutex> lock(mLock);
+        mDeliveredCount++;
+        if (latency > mConfig.deliveryDeadline) {
+            mLateCount++;
+        }
+        mTotalLatency += latency;
+        mMaxLatency = std::max(mMaxLatency, latency);
+    }
+}
+
+void SuspendCallbackDispatcher::dump(std::ostream& out) const {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    Clock::duration averageLatency = Clock::duration::zero();
+    if (mDeliveredCount > 0) {
+        averageLatency = mTotalLatency / static_cast<Clock::rep>(mDeliveredCount);
+    }
+    out << "callback " << IInterface::asBinder(mCallback).get() << ": delivered "
+        << mDeliveredCount << ", pending " << mQueue.size() << ", dropped " << mDroppedCount
+        << ", coalesced " << mCoalescedCount << ", expired " << mExpiredCount << ", late "
+        << mLateCount << ", avg latency " << duration_cast<microseconds>(averageLatency).count()
+        << " us, max latency " << duration_cast<microseconds>(mMaxLatency).count() << " us"
+        << std::endl;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_SUSPEND_CALLBACK_DISPATCHER_H
+#define ANDROID_SYSTEM_SUSPEND_SUSPEND_CALLBACK_DISPATCHER_H
+
+#include <android-base/thread_annotations.h>
+#include <android/system/suspend/ISuspendCallback.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using ::android::system::suspend::ISuspendCallback;
+
+struct SuspendCallbackConfig {
+    // Maximum number of wakeups queued for a callback, the oldest wakeup is dropped when full.
+    size_t queueCapacity = 16;
+    // Wakeups still queued this long after the suspend loop queued them are dropped undelivered,
+    // wakeups the callback returns from later than this are counted as late.
+    std::chrono::milliseconds deliveryDeadline = std::chrono::seconds(1);
+    // If true, a wakeup queued while another one is still pending replaces it.
+    bool coalesceWakeups = false;
+};
+
+/*
+ * Delivers ISuspendCallback::notifyWakeup() to a single callback from its own thread, so that the
+ * suspend loop only queues wakeups and a slow or stuck callback only delays its own wakeups.
+ * This class is thread safe.
+ */
+class SuspendCallbackDispatcher {
+   public:
+    SuspendCallbackDispatcher(const sp<ISuspendCallback>& callback,
+                              const SuspendCallbackConfig& config);
+    // Waits for the wakeup being delivered, if any, and drops the queued ones.
+    ~SuspendCallbackDispatcher();
+
+    const sp<ISuspendCallback>& getCallback() const;
+    void enqueue(bool success, const std::vector<std::string>& wakeupReasons);
+    void dump(std::ostream& out) const;
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Wakeup {
+        bool success;
+        std::vector<std::string> wakeupReasons;
+        Clock::time_point enqueueTime;
+    };
+
+    void run();
+
+    const sp<ISuspendCallback> mCallback;
+    const SuspendCallbackConfig mConfig;
+
+    mutable std::mutex mLock;
+    std::condition_variable mCondVar;
+    std::deque<Wakeup> mQueue GUARDED_BY(mLock);
+    bool mStopped GUARDED_BY(mLock) = false;
+
+    // Delivery stats, latencies are measured from queuing the wakeup to the callback returning.
+    uint64_t mDeliveredCount GUARDED_BY(mLock) = 0;
+    uint64_t mDroppedCount GUARDED_BY(mLock) = 0;
+    uint64_t mCoalescedCount GUARDED_BY(mLock) = 0;
+    uint64_t mExpiredCount GUARDED_BY(mLock) = 0;
+    uint64_t mLateCount GUARDED_BY(mLock) = 0;
+    Clock::duration mTotalLatency GUARDED_BY(mLock) = Clock::duration::zero();
+    Clock::duration mMaxLatency GUARDED_BY(mLock) = Clock::duration::zero();
+
+    std::thread mThread;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_SUSPEND_CALLBACK_DISPATCHER_H
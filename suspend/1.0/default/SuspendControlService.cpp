@@ -22,6 +22,7 @@
 
 #include "SystemSuspend.h"
 
+using ::android::base::Error;
 using ::android::base::Result;
 using ::android::base::StringPrintf;
 
@@ -40,6 +41,61 @@ binder::Status retOk(const T& value, T* ret_val) {
     return binder::Status::ok();
 }
 
+static SleepTimeConfigInfo toSleepTimeConfigInfo(const SleepTimeConfig& config) {
+    SleepTimeConfigInfo info;
+    info.baseSleepTimeMillis = config.baseSleepTime.count();
+    info.maxSleepTimeMillis = config.maxSleepTime.count();
+    info.sleepTimeScaleFactor = config.sleepTimeScaleFactor;
+    info.backoffThreshold = static_cast<int32_t>(config.backoffThreshold);
+    info.shortSuspendThresholdMillis = config.shortSuspendThreshold.count();
+    info.failedSuspendBackoffEnabled = config.failedSuspendBackoffEnabled;
+    info.shortSuspendBackoffEnabled = config.shortSuspendBackoffEnabled;
+    info.eventDrivenAutosuspendEnabled = config.eventDrivenAutosuspendEnabled;
+    info.backoffPolicy = SuspendBackoffPolicy::create(config.backoffPolicy)->name();
+    return info;
+}
+
+static Result<SleepTimeConfig> fromSleepTimeConfigInfo(const SleepTimeConfigInfo& info) {
+    if (info.backoffThreshold < 0) {
+        return Error() << "negative backoff threshold " << info.backoffThreshold;
+    }
+    SleepTimeConfig config = {
+        .baseSleepTime = std::chrono::milliseconds(info.baseSleepTimeMillis),
+        .maxSleepTime = std::chrono::milliseconds(info.maxSleepTimeMillis),
+        .sleepTimeScaleFactor = info.sleepTimeScaleFactor,
+        .backoffThreshold = static_cast<uint32_t>(info.backoffThreshold),
+        .shortSuspendThreshold = std::chrono::milliseconds(info.shortSuspendThresholdMillis),
+        .failedSuspendBackoffEnabled = info.failedSuspendBackoffEnabled,
+        .shortSuspendBackoffEnabled = info.shortSuspendBackoffEnabled,
+        .eventDrivenAutosuspendEnabled = info.eventDrivenAutosuspendEnabled,
+    };
+    if (!SuspendBackoffPolicy::parseType(info.backoffPolicy, &config.backoffPolicy)) {
+        return Error() << "unknown backoff policy " << info.backoffPolicy;
+    }
+    return config;
+}
+
+SuspendControlService::SuspendControlService(const SuspendCallbackConfig& callbackConfig)
+    : mCallbacks(std::make_shared<const SuspendCallbacks>()),
+      mWakelockCallbacks(std::make_shared<const WakelockCallbacksMap>()),
+      mWakelockPatterns(std::make_shared<const WakelockPatterns>()),
+      mCallbackConfig(callbackConfig) {}
+
+SuspendControlService::~SuspendControlService() {
+    // Names are interned process wide, do not leave them watched.
+    for (const auto& [id, wakelockCallbacks] : *std::atomic_load(&mWakelockCallbacks)) {
+        wakelockCallbacks->name.removeWatcher();
+    }
+    if (mWakelockNotifier.joinable()) {
+        {
+            auto l = std::lock_guard(mWakelockNotificationLock);
+            mWakelockNotifierStopped = true;
+        }
+        mWakelockNotificationCondVar.notify_all();
+        mWakelockNotifier.join();
+    }
+}
+
 binder::Status SuspendControlService::registerCallback(const sp<ISuspendCallback>& callback,
                                                        bool* _aidl_return) {
     if (!callback) {
@@ -47,32 +103,70 @@ binder::Status SuspendControlService::registerCallback(const sp<ISuspendCallback
     }
 
     auto l = std::lock_guard(mCallbackLock);
+    auto current = std::atomic_load(&mCallbacks);
     sp<IBinder> cb = IInterface::asBinder(callback);
+    // A callback registered again keeps its dispatcher and is still notified once per wakeup.
+    if (std::any_of(current->begin(), current->end(), [&cb](const auto& i) {
+            return cb == IInterface::asBinder(i->getCallback());
+        })) {
+        return retOk(true, _aidl_return);
+    }
+    if (current->size() >= kMaxSuspendCallbacks) {
+        LOG(ERROR) << __func__ << " Too many suspend callbacks: " << current->size();
+        return retOk(false, _aidl_return);
+    }
     // Only remote binders can be linked to death
     if (cb->remoteBinder() != nullptr) {
-        if (findCb(cb) == mCallbacks.end()) {
-            auto status = cb->linkToDeath(this);
-            if (status != NO_ERROR) {
-                LOG(ERROR) << __func__ << " Cannot link to death: " << status;
-                return retOk(false, _aidl_return);
-            }
+        auto status = cb->linkToDeath(this);
+        if (status != NO_ERROR) {
+            LOG(ERROR) << __func__ << " Cannot link to death: " << status;
+            return retOk(false, _aidl_return);
         }
     }
-    mCallbacks.push_back(callback);
+    auto callbacks = std::make_shared<SuspendCallbacks>(*current);
+    callbacks->push_back(std::make_shared<SuspendCallbackDispatcher>(callback, mCallbackConfig));
+    std::atomic_store(&mCallbacks, std::shared_ptr<const SuspendCallbacks>(std::move(callbacks)));
     return retOk(true, _aidl_return);
 }
 
+/**
+ * Returns a copy of the callbacks registered for name in map, or new empty callbacks for name if
+ * there are none.
+ */
+std::shared_ptr<SuspendControlService::WakelockCallbacks>
+SuspendControlService::copyWakelockCallbacksLocked(const WakelockCallbacksMap& map,
+                                                   const WakeLockName& name) {
+    auto it = map.find(name.id());
+    if (it != map.end()) {
+        return std::make_shared<WakelockCallbacks>(*it->second);
+    }
+
+    startWakelockNotifier();
+    auto wakelockCallbacks = std::make_shared<WakelockCallbacks>(WakelockCallbacks{name, {}, {}});
+    wakelockCallbacks->name.addWatcher();
+    return wakelockCallbacks;
+}
+
+void SuspendControlService::startWakelockNotifier() {
+    std::call_once(mWakelockNotifierStarted, [this] {
+        mWakelockNotifier = std::thread(&SuspendControlService::deliverWakelockNotifications, this);
+    });
+}
+
 binder::Status SuspendControlService::registerWakelockCallback(
     const sp<IWakelockCallback>& callback, const std::string& name, bool* _aidl_return) {
     if (!callback || name.empty()) {
         return retOk(false, _aidl_return);
     }
-
+    WakeLockName wlName(name);
     auto l = std::lock_guard(mWakelockCallbackLock);
-    if (std::find_if(mWakelockCallbacks[name].begin(), mWakelockCallbacks[name].end(),
+    auto current = std::atomic_load(&mWakelockCallbacks);
+    auto it = current->find(wlName.id());
+    if (it != current->end() &&
+        std::find_if(it->second->callbacks.begin(), it->second->callbacks.end(),
                      [&callback](const sp<IWakelockCallback>& i) {
                          return IInterface::asBinder(callback) == IInterface::asBinder(i);
-                     }) != mWakelockCallbacks[name].end()) {
+                     }) != it->second->callbacks.end()) {
         LOG(ERROR) << __func__ << " Same wakelock callback has already been registered";
         return retOk(false, _aidl_return);
     }
@@ -82,69 +176,399 @@ binder::Status SuspendControlService::registerWakelockCallback(
         LOG(WARNING) << __func__ << " Cannot link to death";
         return retOk(false, _aidl_return);
     }
-    mWakelockCallbacks[name].push_back(callback);
+    auto wakelockCallbacks = copyWakelockCallbacksLocked(*current, wlName);
+    wakelockCallbacks->callbacks.push_back(callback);
+    auto map = std::make_shared<WakelockCallbacksMap>(*current);
+    (*map)[wlName.id()] = std::move(wakelockCallbacks);
+    std::atomic_store(&mWakelockCallbacks, std::shared_ptr<const WakelockCallbacksMap>(map));
+    mWakelockCallbackNames[IInterface::asBinder(callback)].push_back(wlName.id());
 
     return retOk(true, _aidl_return);
 }
 
+/**
+ * Registers a callback for every wake lock whose name matches pattern. Patterns are matched once
+ * per wake lock name and change of the patterns, so that a family of wake locks can be monitored
+ * without registering a callback for each of them.
+ */
+bool SuspendControlService::registerWakelockPatternCallback(const sp<IWakelockCallback>& callback,
+                                                            const std::string& pattern) {
+    if (!callback || pattern.empty()) {
+        return false;
+    }
+
+    auto l = std::lock_guard(mWakelockCallbackLock);
+    std::vector<WakelockPatternCallbacks> patterns = std::atomic_load(&mWakelockPatterns)->patterns;
+    auto it = std::find_if(patterns.begin(), patterns.end(), [&pattern](const auto& i) {
+        return i.pattern.str() == pattern;
+    });
+    if (it != patterns.end() &&
+        std::any_of(it->callbacks.begin(), it->callbacks.end(), [&callback](const auto& i) {
+            return IInterface::asBinder(callback) == IInterface::asBinder(i);
+        })) {
+        LOG(ERROR) << __func__ << " Same wakelock callback has already been registered";
+        return false;
+    }
+
+    if (IInterface::asBinder(callback)->remoteBinder() &&
+        IInterface::asBinder(callback)->linkToDeath(this) != NO_ERROR) {
+        LOG(WARNING) << __func__ << " Cannot link to death";
+        return false;
+    }
+    startWakelockNotifier();
+    if (it == patterns.end()) {
+        it = patterns.insert(patterns.end(), {WakeLockNamePattern(pattern), {}});
+    }
+    it->callbacks.push_back(callback);
+    publishWakelockPatternsLocked(std::move(patterns));
+    return true;
+}
+
+void SuspendControlService::publishWakelockPatternsLocked(
+    std::vector<WakelockPatternCallbacks> patterns) {
+    // Shared by all instances, as the match results are cached in the interned names.
+    static std::atomic<uint64_t> nextGeneration{1};
+
+    auto wakelockPatterns = std::make_shared<WakelockPatterns>();
+    wakelockPatterns->generation = patterns.empty() ? 0 : nextGeneration++;
+    wakelockPatterns->patterns = std::move(patterns);
+    uint64_t generation = wakelockPatterns->generation;
+    std::atomic_store(&mWakelockPatterns,
+                      std::shared_ptr<const WakelockPatterns>(std::move(wakelockPatterns)));
+    mWakelockPatternGeneration.store(generation, std::memory_order_release);
+}
+
+/**
+ * Returns true if name matches any wake lock name pattern. Only matches the patterns the first
+ * time it sees name after a change to the patterns, and never takes a lock if there are none.
+ */
+bool SuspendControlService::matchesWakelockPattern(const WakeLockName& name) {
+    uint64_t generation = mWakelockPatternGeneration.load(std::memory_order_acquire);
+    if (generation == 0) {
+        return false;
+    }
+    // The cache holds the generation it was computed for and the result in its lowest bit.
+    uint64_t cache = name.getPatternMatchCache();
+    if ((cache >> 1) == generation) {
+        return cache & 1;
+    }
+
+    // The snapshot may be newer than generation, in which case the result is recomputed once the
+    // new generation is seen.
+    auto patterns = std::atomic_load(&mWakelockPatterns);
+    bool matches = std::any_of(
+        patterns->patterns.begin(), patterns->patterns.end(),
+        [&name](const WakelockPatternCallbacks& i) { return i.pattern.matches(name.str()); });
+    name.setPatternMatchCache((generation << 1) | matches);
+    return matches;
+}
+
+bool SuspendControlService::registerWakeLockEventCallback(
+    const sp<IWakeLockEventCallback>& callback, const std::vector<std::string>& names,
+    std::chrono::milliseconds maxDelay, size_t maxBatchSize, bool collapsePairs) {
+    if (!callback || names.empty() || maxDelay.count() < 0 || maxBatchSize == 0 ||
+        std::find(names.begin(), names.end(), "") != names.end()) {
+        return false;
+    }
+
+    auto l = std::lock_guard(mWakelockCallbackLock);
+    auto current = std::atomic_load(&mWakelockCallbacks);
+    sp<IBinder> binder = IInterface::asBinder(callback);
+    auto namesIt = mWakelockCallbackNames.find(binder);
+    if (namesIt != mWakelockCallbackNames.end()) {
+        for (WakeLockNameId id : namesIt->second) {
+            auto it = current->find(id);
+            if (it == current->end()) {
+                continue;
+            }
+            const auto& subscribers = it->second->eventSubscribers;
+            if (std::any_of(subscribers.begin(), subscribers.end(), [&binder](const auto& i) {
+                    return binder == IInterface::asBinder(i->callback);
+                })) {
+                LOG(ERROR) << __func__ << " Same callback has already been registered";
+                return false;
+            }
+        }
+    }
+
+    if (binder->remoteBinder() && binder->linkToDeath(this) != NO_ERROR) {
+        LOG(WARNING) << __func__ << " Cannot link to death";
+        return false;
+    }
+
+    auto subscriber = std::make_shared<WakeLockEventSubscriber>();
+    subscriber->callback = callback;
+    subscriber->maxDelay = maxDelay;
+    subscriber->maxBatchSize = maxBatchSize;
+    subscriber->collapsePairs = collapsePairs;
+    auto map = std::make_shared<WakelockCallbacksMap>(*current);
+    auto& registeredNames = mWakelockCallbackNames[binder];
+    for (const auto& name : names) {
+        WakeLockName wlName(name);
+        auto wakelockCallbacks = copyWakelockCallbacksLocked(*map, wlName);
+        // Names may be listed more than once.
+        if (!wakelockCallbacks->eventSubscribers.empty() &&
+            wakelockCallbacks->eventSubscribers.back() == subscriber) {
+            continue;
+        }
+        wakelockCallbacks->eventSubscribers.push_back(subscriber);
+        (*map)[wlName.id()] = std::move(wakelockCallbacks);
+        registeredNames.push_back(wlName.id());
+    }
+    std::atomic_store(&mWakelockCallbacks, std::shared_ptr<const WakelockCallbacksMap>(map));
+    return true;
+}
+
 void SuspendControlService::binderDied(const wp<IBinder>& who) {
-    auto l = std::lock_guard(mCallbackLock);
-    mCallbacks.erase(std::remove_if(mCallbacks.begin(), mCallbacks.end(),
-                                    [&who](const sp<ISuspendCallback>& i) {
-                                        return who == IInterface::asBinder(i);
-                                    }),
-                     mCallbacks.end());
+    // Destroying a dispatcher waits for the wakeup it is delivering, which fails fast for a dead
+    // binder. The last reference may still be dropped by notifyWakeup() if it is using the
+    // previous snapshot.
+    std::shared_ptr<const SuspendCallbacks> deadCallbacks;
+    {
+        auto l = std::lock_guard(mCallbackLock);
+        deadCallbacks = std::atomic_load(&mCallbacks);
+        auto callbacks = std::make_shared<SuspendCallbacks>();
+        std::copy_if(deadCallbacks->begin(), deadCallbacks->end(), std::back_inserter(*callbacks),
+                     [&who](const auto& i) {
+                         return !(who == IInterface::asBinder(i->getCallback()));
+                     });
+        if (callbacks->size() != deadCallbacks->size()) {
+            std::atomic_store(&mCallbacks,
+                              std::shared_ptr<const SuspendCallbacks>(std::move(callbacks)));
+        }
+    }
+    deadCallbacks.reset();
 
     auto lWakelock = std::lock_guard(mWakelockCallbackLock);
-    // Iterate through all wakelock names as same callback can be registered with different
-    // wakelocks.
-    for (auto wakelockIt = mWakelockCallbacks.begin(); wakelockIt != mWakelockCallbacks.end();) {
-        wakelockIt->second.erase(
+    auto currentPatterns = std::atomic_load(&mWakelockPatterns);
+    if (!currentPatterns->patterns.empty()) {
+        std::vector<WakelockPatternCallbacks> patterns;
+        bool changed = false;
+        for (const auto& patternCallbacks : currentPatterns->patterns) {
+            auto& callbacks = patterns.emplace_back(patternCallbacks).callbacks;
+            auto deadIt = std::remove_if(callbacks.begin(), callbacks.end(), [&who](const auto& i) {
+                return who == IInterface::asBinder(i);
+            });
+            changed |= deadIt != callbacks.end();
+            callbacks.erase(deadIt, callbacks.end());
+            if (callbacks.empty()) {
+                patterns.pop_back();
+            }
+        }
+        if (changed) {
+            publishWakelockPatternsLocked(std::move(patterns));
+        }
+    }
+
+    auto namesIt = mWakelockCallbackNames.find(who);
+    if (namesIt == mWakelockCallbackNames.end()) {
+        return;
+    }
+    auto map = std::make_shared<WakelockCallbacksMap>(*std::atomic_load(&mWakelockCallbacks));
+    for (WakeLockNameId id : namesIt->second) {
+        auto it = map->find(id);
+        if (it == map->end()) {
+            continue;
+        }
+        auto wakelockCallbacks = std::make_shared<WakelockCallbacks>(*it->second);
+        auto& callbacks = wakelockCallbacks->callbacks;
+        callbacks.erase(
             std::remove_if(
-                wakelockIt->second.begin(), wakelockIt->second.end(),
+                callbacks.begin(), callbacks.end(),
                 [&who](const sp<IWakelockCallback>& i) { return who == IInterface::asBinder(i); }),
-            wakelockIt->second.end());
-        if (wakelockIt->second.empty()) {
-            wakelockIt = mWakelockCallbacks.erase(wakelockIt);
+            callbacks.end());
+        auto& subscribers = wakelockCallbacks->eventSubscribers;
+        subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+                                         [&who](const auto& i) {
+                                             return who == IInterface::asBinder(i->callback);
+                                         }),
+                          subscribers.end());
+        if (callbacks.empty() && subscribers.empty()) {
+            wakelockCallbacks->name.removeWatcher();
+            map->erase(it);
         } else {
-            ++wakelockIt;
+            it->second = std::move(wakelockCallbacks);
         }
     }
+    mWakelockCallbackNames.erase(namesIt);
+    std::atomic_store(&mWakelockCallbacks, std::shared_ptr<const WakelockCallbacksMap>(map));
 }
 
-void SuspendControlService::notifyWakelock(const std::string& name, bool isAcquired) {
-    // A callback could potentially modify mWakelockCallbacks (e.g., via registerCallback). That
-    // must not result in a deadlock. To that end, we make a copy of the callback is an entry can be
-    // found for the particular wakelock  and release mCallbackLock before calling the copied
-    // callbacks.
-    auto callbackLock = std::unique_lock(mWakelockCallbackLock);
-    auto it = mWakelockCallbacks.find(name);
-    if (it == mWakelockCallbacks.end()) {
+void SuspendControlService::notifyWakelock(const WakeLockName& name, bool isAcquired) {
+    // Called on every wake lock acquisition and release, most of which nobody listens to.
+    if (!name.hasWatchers() && !matchesWakelockPattern(name)) {
         return;
     }
-    auto callbacksCopy = it->second;
-    callbackLock.unlock();
 
-    for (const auto& callback : callbacksCopy) {
-        if (isAcquired) {
-            callback->notifyAcquired().isOk();  // ignore errors
-        } else {
-            callback->notifyReleased().isOk();  // ignore errors
+    auto time = std::chrono::steady_clock::now();
+    {
+        auto l = std::lock_guard(mWakelockNotificationLock);
+        mWakelockNotifications.push_back({name, isAcquired, time});
+    }
+    mWakelockNotificationCondVar.notify_one();
+}
+
+void SuspendControlService::addWakeLockEvent(WakeLockEventSubscriber* subscriber,
+                                             const WakelockNotification& notification) {
+    int64_t timeMillis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             notification.time.time_since_epoch())
+                             .count();
+    WakeLockNameId id = notification.name.id();
+
+    if (subscriber->collapsePairs && !notification.isAcquired) {
+        auto it = subscriber->pendingAcquisitions.find(id);
+        if (it != subscriber->pendingAcquisitions.end()) {
+            WakeLockEvent& event = subscriber->pendingEvents[it->second];
+            event.isAcquired = false;
+            event.heldTimeMillis = timeMillis - event.timeMillis;
+            event.timeMillis = timeMillis;
+            subscriber->pendingAcquisitions.erase(it);
+            return;
         }
     }
+
+    if (subscriber->pendingEvents.empty()) {
+        subscriber->flushTime = notification.time + subscriber->maxDelay;
+    }
+    if (subscriber->collapsePairs && notification.isAcquired) {
+        subscriber->pendingAcquisitions[id] = subscriber->pendingEvents.size();
+    }
+    WakeLockEvent event;
+    event.name = notification.name.str();
+    event.isAcquired = notification.isAcquired;
+    event.timeMillis = timeMillis;
+    subscriber->pendingEvents.push_back(std::move(event));
 }
 
-void SuspendControlService::notifyWakeup(bool success, std::vector<std::string>& wakeupReasons) {
-    // A callback could potentially modify mCallbacks (e.g., via registerCallback). That must not
-    // result in a deadlock. To that end, we make a copy of mCallbacks and release mCallbackLock
-    // before calling the copied callbacks.
-    auto callbackLock = std::unique_lock(mCallbackLock);
-    auto callbacksCopy = mCallbacks;
-    callbackLock.unlock();
+void SuspendControlService::flushWakeLockEvents(WakeLockEventSubscriber* subscriber) {
+    if (!subscriber->pendingEvents.empty()) {
+        // ignore errors
+        subscriber->callback->notifyWakeLockEvents(subscriber->pendingEvents).isOk();
+        subscriber->pendingEvents.clear();
+        subscriber->pendingAcquisitions.clear();
+    }
+}
 
-    for (const auto& callback : callbacksCopy) {
-        callback->notifyWakeup(success, wakeupReasons).isOk();  // ignore errors
+void SuspendControlService::deliverWakelockNotifications() {
+    std::deque<WakelockNotification> notifications;
+    // Wake lock event subscribers holding back events until their flush time.
+    std::vector<std::shared_ptr<WakeLockEventSubscriber>> pendingSubscribers;
+    auto notifyCallbacks = [](const std::vector<sp<IWakelockCallback>>& callbacks,
+                              bool isAcquired) {
+        for (const auto& callback : callbacks) {
+            if (isAcquired) {
+                callback->notifyAcquired().isOk();  // ignore errors
+            } else {
+                callback->notifyReleased().isOk();  // ignore errors
+            }
+        }
+    };
+    while (true) {
+        {
+            auto l = std::unique_lock(mWakelockNotificationLock);
+            auto hasNotifications = [this] {
+                android::base::ScopedLockAssertion lock_assertion(mWakelockNotificationLock);
+                return mWakelockNotifierStopped || !mWakelockNotifications.empty();
+            };
+            if (pendingSubscribers.empty()) {
+                mWakelockNotificationCondVar.wait(l, hasNotifications);
+            } else {
+                auto flushTime = (*std::min_element(pendingSubscribers.begin(),
+                                                    pendingSubscribers.end(),
+                                                    [](const auto& a, const auto& b) {
+                                                        return a->flushTime < b->flushTime;
+                                                    }))
+                                     ->flushTime;
+                mWakelockNotificationCondVar.wait_until(l, flushTime, hasNotifications);
+            }
+            if (mWakelockNotifierStopped) {
+                return;
+            }
+            notifications.swap(mWakelockNotifications);
+        }
+
+        // Callbacks may register other callbacks (e.g., via registerCallback) while being called,
+        // which only replaces the registry snapshot.
+        auto wakelockCallbacks = std::atomic_load(&mWakelockCallbacks);
+        auto wakelockPatterns = std::atomic_load(&mWakelockPatterns);
+        for (const auto& notification : notifications) {
+            // Names that match no pattern are skipped using the result cached in the name, only
+            // the names that match are matched against each pattern again.
+            if (!wakelockPatterns->patterns.empty() && matchesWakelockPattern(notification.name)) {
+                for (const auto& patternCallbacks : wakelockPatterns->patterns) {
+                    if (patternCallbacks.pattern.matches(notification.name.str())) {
+                        notifyCallbacks(patternCallbacks.callbacks, notification.isAcquired);
+                    }
+                }
+            }
+
+            auto it = wakelockCallbacks->find(notification.name.id());
+            if (it == wakelockCallbacks->end()) {
+                continue;
+            }
+
+            notifyCallbacks(it->second->callbacks, notification.isAcquired);
+            for (const auto& subscriber : it->second->eventSubscribers) {
+                addWakeLockEvent(subscriber.get(), notification);
+                if (subscriber->pendingEvents.size() >= subscriber->maxBatchSize) {
+                    flushWakeLockEvents(subscriber.get());
+                } else if (!subscriber->hasPendingEvents) {
+                    subscriber->hasPendingEvents = true;
+                    pendingSubscribers.push_back(subscriber);
+                }
+            }
+        }
+        notifications.clear();
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = pendingSubscribers.begin(); it != pendingSubscribers.end();) {
+            auto& subscriber = *it;
+            if (!subscriber->pendingEvents.empty() && subscriber->flushTime <= now) {
+                flushWakeLockEvents(subscriber.get());
+            }
+            if (subscriber->pendingEvents.empty()) {
+                subscriber->hasPendingEvents = false;
+                it = pendingSubscribers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void SuspendControlService::notifyWakeup(bool success,
+                                         const std::vector<std::string_view>& wakeupReasons) {
+    // The callbacks are called from their dispatcher threads, so a callback may modify mCallbacks
+    // (e.g., via registerCallback) and a slow callback does not hold up the suspend loop.
+    auto callbacks = std::atomic_load(&mCallbacks);
+    if (callbacks->empty()) {
+        return;
+    }
+    // The reasons are only copied if there is someone to deliver them to.
+    std::vector<std::string> reasons(wakeupReasons.begin(), wakeupReasons.end());
+    for (const auto& dispatcher : *callbacks) {
+        dispatcher->enqueue(success, reasons);
+    }
+}
+
+void SuspendControlService::getLockStats(std::vector<LockStats>* stats) {
+    for (ProfiledMutex* mutex : {&mCallbackLock, &mWakelockCallbackLock}) {
+        LockStats lockStats;
+        lockStats.name = mutex->name();
+        mutex->addStats(&lockStats);
+        stats->push_back(std::move(lockStats));
+    }
+}
+
+status_t SuspendControlService::dump(int fd, const Vector<String16>& /* args */) {
+    register_sig_handler();
+
+    std::ostringstream callbackStats;
+    for (const auto& dispatcher : *std::atomic_load(&mCallbacks)) {
+        dispatcher->dump(callbackStats);
     }
+    dprintf(fd, "Suspend callbacks:\n%s\n", callbackStats.str().c_str());
+    return OK;
 }
 
 void SuspendControlServiceInternal::setSuspendService(const wp<SystemSuspend>& suspend) {
@@ -174,6 +598,100 @@ binder::Status SuspendControlServiceInternal::getSuspendStats(SuspendInfo* _aidl
     return binder::Status::ok();
 }
 
+binder::Status SuspendControlServiceInternal::getSuspendPhaseStats(
+    std::vector<SuspendPhaseInfo>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    suspendService->getAutosuspendPhaseStats().getPhaseStats(_aidl_return);
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::getSleepTimeConfig(
+    SleepTimeConfigInfo* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    *_aidl_return = toSleepTimeConfigInfo(suspendService->getSleepTimeConfig());
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::setSleepTimeConfig(const SleepTimeConfigInfo& config,
+                                                                 int64_t* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    Result<SleepTimeConfig> sleepTimeConfig = fromSleepTimeConfigInfo(config);
+    if (!sleepTimeConfig.ok()) {
+        return binder::Status::fromExceptionCode(
+            binder::Status::Exception::EX_ILLEGAL_ARGUMENT,
+            String8(sleepTimeConfig.error().message().c_str()));
+    }
+    Result<int64_t> generation = suspendService->setSleepTimeConfig(*sleepTimeConfig);
+    if (!generation.ok()) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_ILLEGAL_ARGUMENT,
+                                                 String8(generation.error().message().c_str()));
+    }
+    return retOk(*generation, _aidl_return);
+}
+
+binder::Status SuspendControlServiceInternal::getStatsMemory(
+    os::ParcelFileDescriptor* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    unique_fd fd = suspendService->getStatsRegionFd();
+    if (fd < 0) {
+        return binder::Status::fromExceptionCode(
+            binder::Status::Exception::EX_UNSUPPORTED_OPERATION,
+            String8("Suspend stats region unavailable"));
+    }
+    *_aidl_return = os::ParcelFileDescriptor(std::move(fd));
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::registerWakeLockEventCallback(
+    const sp<IWakeLockEventCallback>& callback, const std::vector<std::string>& names,
+    int64_t maxDelayMillis, int32_t maxBatchSize, bool collapsePairs, bool* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    if (maxBatchSize < 1) {
+        return retOk(false, _aidl_return);
+    }
+    bool registered = suspendService->getControlService()->registerWakeLockEventCallback(
+        callback, names, std::chrono::milliseconds(maxDelayMillis), maxBatchSize, collapsePairs);
+    return retOk(registered, _aidl_return);
+}
+
+binder::Status SuspendControlServiceInternal::registerWakelockPatternCallback(
+    const sp<IWakelockCallback>& callback, const std::string& pattern, bool* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    bool registered =
+        suspendService->getControlService()->registerWakelockPatternCallback(callback, pattern);
+    return retOk(registered, _aidl_return);
+}
+
 binder::Status SuspendControlServiceInternal::getWakeLockStats(
     std::vector<WakeLockInfo>* _aidl_return) {
     const auto suspendService = mSuspend.promote();
@@ -188,6 +706,46 @@ binder::Status SuspendControlServiceInternal::getWakeLockStats(
     return binder::Status::ok();
 }
 
+binder::Status SuspendControlServiceInternal::getRefreshedWakeLockStats(
+    std::vector<WakeLockInfo>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    suspendService->updateStatsNow();
+    suspendService->getStatsList().getWakeLockStats(_aidl_return, true /* forceRefresh */);
+
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::getWakeLockStatsDelta(
+    int64_t generation, WakeLockStatsDelta* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    suspendService->updateStatsNow();
+    suspendService->getStatsList().getWakeLockStatsDelta(generation, _aidl_return);
+
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::getWakeLockHoldTimeStats(
+    std::vector<WakeLockHoldTimeInfo>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    suspendService->getStatsList().getHoldTimeStats(_aidl_return);
+    return binder::Status::ok();
+}
+
 binder::Status SuspendControlServiceInternal::getWakeupStats(
     std::vector<WakeupInfo>* _aidl_return) {
     const auto suspendService = mSuspend.promote();
@@ -200,13 +758,42 @@ binder::Status SuspendControlServiceInternal::getWakeupStats(
     return binder::Status::ok();
 }
 
+binder::Status SuspendControlServiceInternal::getWakeupComponentStats(
+    std::vector<WakeupComponentInfo>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    suspendService->getWakeupReasonIndex().getComponentStats(_aidl_return);
+    return binder::Status::ok();
+}
+
+static const char* wakeupComponentTypeToString(int32_t type) {
+    switch (type) {
+        case WakeupComponentInfo::TYPE_IRQ:
+            return "irq";
+        case WakeupComponentInfo::TYPE_ABORT:
+            return "abort";
+        default:
+            return "other";
+    }
+}
+
 static std::string dumpUsage() {
     return "\nUsage: adb shell dumpsys suspend_control_internal [option]\n\n"
            "   Options:\n"
            "       --wakelocks        : returns wakelock stats.\n"
+           "       --hold_times       : returns native wakelock hold time percentiles.\n"
            "       --wakeups          : returns wakeup stats.\n"
+           "       --structured       : with --wakeups, returns wakeup stats per IRQ, abort\n"
+           "                            reason or other reason line, the most frequent first.\n"
            "       --kernel_suspends  : returns suspend success/error stats from the kernel\n"
-           "       --suspend_controls : returns suspend control stats\n"
+           "       --suspend_controls : returns suspend control stats and time\n"
+           "                            spent in each phase of the autosuspend loop.\n"
+           "       --locks            : returns lock contention stats, if lock profiling is\n"
+           "                            enabled by suspend.lock_profiling_enabled.\n"
            "       --all or -a        : returns all stats.\n"
            "       --help or -h       : prints this message.\n\n"
            "   Note: All stats are returned  if no or (an\n"
@@ -226,6 +813,9 @@ status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& arg
         OPT_WAKEUPS = 1 << 1,
         OPT_KERNEL_SUSPENDS = 1 << 2,
         OPT_SUSPEND_CONTROLS = 1 << 3,
+        OPT_STRUCTURED = 1 << 4,
+        OPT_HOLD_TIMES = 1 << 5,
+        OPT_LOCKS = 1 << 6,
         OPT_ALL = ~0,
     };
     int opts = 0;
@@ -236,12 +826,18 @@ status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& arg
         for (const auto& arg : args) {
             if (arg == String16("--wakelocks")) {
                 opts |= OPT_WAKELOCKS;
+            } else if (arg == String16("--hold_times")) {
+                opts |= OPT_HOLD_TIMES;
             } else if (arg == String16("--wakeups")) {
                 opts |= OPT_WAKEUPS;
             } else if (arg == String16("--kernel_suspends")) {
                 opts |= OPT_KERNEL_SUSPENDS;
             } else if (arg == String16("--suspend_controls")) {
                 opts |= OPT_SUSPEND_CONTROLS;
+            } else if (arg == String16("--structured")) {
+                opts |= OPT_STRUCTURED;
+            } else if (arg == String16("--locks")) {
+                opts |= OPT_LOCKS;
             } else if (arg == String16("-a") || arg == String16("--all")) {
                 opts = OPT_ALL;
             } else if (arg == String16("-h") || arg == String16("--help")) {
@@ -259,7 +855,21 @@ status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& arg
         dprintf(fd, "\n%s\n", wlStats.str().c_str());
     }
 
-    if (opts & OPT_WAKEUPS) {
+    if (opts & OPT_HOLD_TIMES) {
+        std::ostringstream holdTimeStats;
+        std::vector<WakeLockHoldTimeInfo> holdTimes;
+        suspendService->getStatsList().getHoldTimeStats(&holdTimes);
+        for (const auto& h : holdTimes) {
+            holdTimeStats << h.name << " (pid " << h.pid << "): count " << h.count << ", p50 "
+                          << h.p50Millis << " ms, p90 " << h.p90Millis << " ms, p99 "
+                          << h.p99Millis << " ms, max " << h.maxMillis << " ms (+"
+                          << h.maxErrorPercent << "%)" << std::endl;
+        }
+        dprintf(fd, "Wakelock hold times:\n%s\n", holdTimeStats.str().c_str());
+    }
+
+    // --structured replaces the wakeup stats unless all stats are requested.
+    if ((opts & OPT_WAKEUPS) && (!(opts & OPT_STRUCTURED) || opts == OPT_ALL)) {
         std::ostringstream wakeupStats;
         std::vector<WakeupInfo> wakeups;
         suspendService->getWakeupList().getWakeupStats(&wakeups);
@@ -269,6 +879,24 @@ status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& arg
         dprintf(fd, "Wakeups:\n%s\n", wakeupStats.str().c_str());
     }
 
+    if ((opts & OPT_WAKEUPS) && (opts & OPT_STRUCTURED)) {
+        std::ostringstream componentStats;
+        std::vector<WakeupComponentInfo> components;
+        suspendService->getWakeupReasonIndex().getComponentStats(&components);
+        for (const auto& c : components) {
+            componentStats << wakeupComponentTypeToString(c.type);
+            if (c.type == WakeupComponentInfo::TYPE_IRQ) {
+                componentStats << " " << c.irq;
+            }
+            componentStats << " \"" << c.name << "\": count " << c.count << ", chained "
+                           << c.chainedCount << ", last seen " << c.lastSeenMillis
+                           << " ms, last suspend " << c.lastSuspendTimeMillis
+                           << " ms, total suspend " << c.totalSuspendTimeMillis << " ms"
+                           << std::endl;
+        }
+        dprintf(fd, "Wakeup components:\n%s\n", componentStats.str().c_str());
+    }
+
     if (opts & OPT_KERNEL_SUSPENDS) {
         Result<SuspendStats> res = suspendService->getSuspendStats();
         if (!res.ok()) {
@@ -321,7 +949,56 @@ status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& arg
         suspendInfo << "backoff continuations: " << info.backoffContinueCount << std::endl;
         suspendInfo << "total sleep time between suspends: " << info.sleepTimeMillis << " ms"
                     << std::endl;
+        suspendInfo << "backoff policy: " << info.backoffPolicy << std::endl;
+        suspendInfo << "next sleep time: " << info.nextSleepTimeMillis << " ms" << std::endl;
+        suspendInfo << "sleep time increases: " << info.sleepTimeIncreaseCount << std::endl;
+        suspendInfo << "sleep time decreases: " << info.sleepTimeDecreaseCount << std::endl;
+        suspendInfo << "sleep time config generation: " << info.sleepTimeConfigGeneration
+                    << std::endl;
+        if (const LegacyWakeLocks* legacyWakeLocks = suspendService->getLegacyWakeLocks()) {
+            suspendInfo << "wake_lock/wake_unlock writes: " << legacyWakeLocks->getWriteCount()
+                        << " (" << legacyWakeLocks->getAvoidedWriteCount() << " avoided)"
+                        << std::endl;
+        }
         dprintf(fd, "Suspend Info:\n%s\n", suspendInfo.str().c_str());
+
+        std::vector<SuspendPhaseInfo> phases;
+        suspendService->getAutosuspendPhaseStats().getPhaseStats(&phases);
+        std::ostringstream phaseInfo;
+        for (const SuspendPhaseInfo& phase : phases) {
+            phaseInfo << phase.name << ": count=" << phase.count
+                      << " total=" << phase.totalMicros << "us p50=" << phase.p50Micros
+                      << "us p90=" << phase.p90Micros << "us p99=" << phase.p99Micros
+                      << "us max=" << phase.maxMicros << "us" << std::endl;
+        }
+        dprintf(fd, "Autosuspend Phases:\n%s\n", phaseInfo.str().c_str());
+    }
+
+    if (opts & OPT_LOCKS) {
+        std::ostringstream lockInfo;
+        if (!ProfiledMutex::isProfilingEnabled()) {
+            lockInfo << "lock profiling is disabled" << std::endl;
+        }
+        std::vector<LockStats> locks;
+        suspendService->getLockStats(&locks);
+        for (const LockStats& lock : locks) {
+            lockInfo << lock.name << ": acquired " << lock.acquireCount << " times ("
+                     << lock.contendedCount << " contended)" << std::endl;
+            lockInfo << "  wait: total " << lock.totalWaitMicros << " us, p50 "
+                     << lock.waitTimes.percentile(50) << " us, p99 "
+                     << lock.waitTimes.percentile(99) << " us, max " << lock.waitTimes.max()
+                     << " us" << std::endl;
+            lockInfo << "  hold: total " << lock.totalHoldMicros << " us, p50 "
+                     << lock.holdTimes.percentile(50) << " us, p99 "
+                     << lock.holdTimes.percentile(99) << " us, max " << lock.holdTimes.max()
+                     << " us" << std::endl;
+            for (const LockWaiter& waiter : lock.topWaiters) {
+                lockInfo << "  waiter " << waiter.threadName << " (tid " << waiter.tid
+                         << "): waited " << waiter.count << " times, " << waiter.totalWaitMicros
+                         << " us" << std::endl;
+            }
+        }
+        dprintf(fd, "Lock Contention:\n%s\n", lockInfo.str().c_str());
     }
 
     return OK;
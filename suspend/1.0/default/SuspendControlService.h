@@ -19,16 +19,45 @@
 
 #include <android/system/suspend/BnSuspendControlService.h>
 #include <android/system/suspend/internal/BnSuspendControlServiceInternal.h>
+#include <android/system/suspend/internal/IWakeLockEventCallback.h>
+#include <android/system/suspend/internal/SleepTimeConfigInfo.h>
 #include <android/system/suspend/internal/SuspendInfo.h>
+#include <android/system/suspend/internal/SuspendPhaseInfo.h>
+#include <android/system/suspend/internal/WakeLockEvent.h>
+#include <android/system/suspend/internal/WakeLockHoldTimeInfo.h>
 #include <android/system/suspend/internal/WakeLockInfo.h>
+#include <android/system/suspend/internal/WakeLockStatsDelta.h>
+#include <android/system/suspend/internal/WakeupComponentInfo.h>
 #include <android/system/suspend/internal/WakeupInfo.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "ProfiledMutex.h"
+#include "SuspendCallbackDispatcher.h"
+#include "WakeLockName.h"
+#include "WakeLockNamePattern.h"
+
 using ::android::system::suspend::BnSuspendControlService;
 using ::android::system::suspend::ISuspendCallback;
 using ::android::system::suspend::IWakelockCallback;
 using ::android::system::suspend::internal::BnSuspendControlServiceInternal;
+using ::android::system::suspend::internal::IWakeLockEventCallback;
+using ::android::system::suspend::internal::SleepTimeConfigInfo;
 using ::android::system::suspend::internal::SuspendInfo;
+using ::android::system::suspend::internal::SuspendPhaseInfo;
+using ::android::system::suspend::internal::WakeLockEvent;
+using ::android::system::suspend::internal::WakeLockHoldTimeInfo;
 using ::android::system::suspend::internal::WakeLockInfo;
+using ::android::system::suspend::internal::WakeLockStatsDelta;
+using ::android::system::suspend::internal::WakeupComponentInfo;
 using ::android::system::suspend::internal::WakeupInfo;
 
 namespace android {
@@ -41,29 +70,121 @@ class SystemSuspend;
 class SuspendControlService : public BnSuspendControlService,
                               public virtual IBinder::DeathRecipient {
    public:
-    SuspendControlService() = default;
-    ~SuspendControlService() override = default;
+    // Each ISuspendCallback gets its own delivery thread, see SuspendCallbackDispatcher.
+    static constexpr size_t kMaxSuspendCallbacks = 64;
+
+    explicit SuspendControlService(const SuspendCallbackConfig& callbackConfig = {});
+    ~SuspendControlService() override;
 
     binder::Status registerCallback(const sp<ISuspendCallback>& callback,
                                     bool* _aidl_return) override;
     binder::Status registerWakelockCallback(const sp<IWakelockCallback>& callback,
                                             const std::string& name, bool* _aidl_return) override;
 
+    // See ISuspendControlServiceInternal.registerWakeLockEventCallback().
+    bool registerWakeLockEventCallback(const sp<IWakeLockEventCallback>& callback,
+                                       const std::vector<std::string>& names,
+                                       std::chrono::milliseconds maxDelay, size_t maxBatchSize,
+                                       bool collapsePairs);
+
+    // See ISuspendControlServiceInternal.registerWakelockPatternCallback().
+    bool registerWakelockPatternCallback(const sp<IWakelockCallback>& callback,
+                                         const std::string& pattern);
+
     void binderDied(const wp<IBinder>& who) override;
 
-    void notifyWakelock(const std::string& name, bool isAcquired);
-    void notifyWakeup(bool success, std::vector<std::string>& wakeupReasons);
+    // Queues the wake lock event for the callbacks registered for name, if any. The callbacks are
+    // called in order from a single notifier thread.
+    void notifyWakelock(const WakeLockName& name, bool isAcquired);
+    // Queues the wakeup for every registered ISuspendCallback and returns without waiting for
+    // them to be notified.
+    void notifyWakeup(bool success, const std::vector<std::string_view>& wakeupReasons);
+    // Appends the contention stats of the callback registry locks.
+    void getLockStats(std::vector<LockStats>* stats);
+
+    status_t dump(int fd, const Vector<String16>& args) override;
 
    private:
-    std::map<std::string, std::vector<sp<IWakelockCallback>>> mWakelockCallbacks;
-    std::mutex mCallbackLock;
-    std::mutex mWakelockCallbackLock;
-    std::vector<sp<ISuspendCallback>> mCallbacks;
-    const std::vector<sp<ISuspendCallback>>::iterator findCb(const wp<IBinder>& cb) {
-        return std::find_if(
-            mCallbacks.begin(), mCallbacks.end(),
-            [&cb](const sp<ISuspendCallback>& i) { return cb == IInterface::asBinder(i); });
-    }
+    // A callback registered with registerWakeLockEventCallback(). Its pending events are only
+    // accessed from the notifier thread.
+    struct WakeLockEventSubscriber {
+        sp<IWakeLockEventCallback> callback;
+        std::chrono::milliseconds maxDelay;
+        size_t maxBatchSize;
+        bool collapsePairs;
+        std::vector<WakeLockEvent> pendingEvents;
+        // Index in pendingEvents of the latest pending acquisition of each wake lock, only
+        // tracked if collapsePairs is true.
+        std::unordered_map<WakeLockNameId, size_t> pendingAcquisitions;
+        std::chrono::steady_clock::time_point flushTime;
+        bool hasPendingEvents = false;
+    };
+
+    // Callbacks registered for a wake lock. The name is kept interned for as long as callbacks are
+    // registered so that its id stays valid.
+    struct WakelockCallbacks {
+        WakeLockName name;
+        std::vector<sp<IWakelockCallback>> callbacks;
+        std::vector<std::shared_ptr<WakeLockEventSubscriber>> eventSubscribers;
+    };
+    // Wake lock callbacks keyed by the id of the wake lock name.
+    using WakelockCallbacksMap =
+        std::unordered_map<WakeLockNameId, std::shared_ptr<const WakelockCallbacks>>;
+    using SuspendCallbacks = std::vector<std::shared_ptr<SuspendCallbackDispatcher>>;
+
+    // The callback registries are immutable snapshots, replaced while holding their lock on every
+    // registration and binder death. The published pointers are only accessed through
+    // std::atomic_load() and std::atomic_store(), so that notifying neither locks nor copies.
+    std::shared_ptr<const SuspendCallbacks> mCallbacks;
+    std::shared_ptr<const WakelockCallbacksMap> mWakelockCallbacks;
+    ProfiledMutex mCallbackLock{"SuspendControlService::mCallbackLock"};
+    ProfiledMutex mWakelockCallbackLock{"SuspendControlService::mWakelockCallbackLock"};
+    // Ids of the wake lock names each callback binder is registered for, so that binder deaths are
+    // handled without going through every wake lock. Keyed by weak reference, which unlike the
+    // address is never shared with a binder allocated after the registered one is gone.
+    std::map<wp<IBinder>, std::vector<WakeLockNameId>> mWakelockCallbackNames
+        GUARDED_BY(mWakelockCallbackLock);
+    std::shared_ptr<WakelockCallbacks> copyWakelockCallbacksLocked(const WakelockCallbacksMap& map,
+                                                                   const WakeLockName& name)
+        REQUIRES(mWakelockCallbackLock);
+
+    // Callbacks registered for the wake locks whose name matches a pattern.
+    struct WakelockPatternCallbacks {
+        WakeLockNamePattern pattern;
+        std::vector<sp<IWakelockCallback>> callbacks;
+    };
+    // Every change to the patterns gets a new process wide unique generation, which tags the
+    // match results cached in the interned names.
+    struct WakelockPatterns {
+        uint64_t generation = 0;
+        std::vector<WakelockPatternCallbacks> patterns;
+    };
+    // Snapshot, like mWakelockCallbacks.
+    std::shared_ptr<const WakelockPatterns> mWakelockPatterns;
+    // Generation of mWakelockPatterns, 0 if there are no patterns.
+    std::atomic<uint64_t> mWakelockPatternGeneration{0};
+    void publishWakelockPatternsLocked(std::vector<WakelockPatternCallbacks> patterns)
+        REQUIRES(mWakelockCallbackLock);
+    bool matchesWakelockPattern(const WakeLockName& name);
+    void startWakelockNotifier();
+
+    struct WakelockNotification {
+        WakeLockName name;
+        bool isAcquired;
+        std::chrono::steady_clock::time_point time;
+    };
+    void deliverWakelockNotifications();
+    static void addWakeLockEvent(WakeLockEventSubscriber* subscriber,
+                                 const WakelockNotification& notification);
+    static void flushWakeLockEvents(WakeLockEventSubscriber* subscriber);
+    std::mutex mWakelockNotificationLock;
+    std::condition_variable mWakelockNotificationCondVar;
+    std::deque<WakelockNotification> mWakelockNotifications GUARDED_BY(mWakelockNotificationLock);
+    bool mWakelockNotifierStopped GUARDED_BY(mWakelockNotificationLock) = false;
+    // Started when the first wake lock callback is registered.
+    std::once_flag mWakelockNotifierStarted;
+    std::thread mWakelockNotifier;
+    const SuspendCallbackConfig mCallbackConfig;
 };
 
 class SuspendControlServiceInternal : public BnSuspendControlServiceInternal {
@@ -74,8 +195,27 @@ class SuspendControlServiceInternal : public BnSuspendControlServiceInternal {
     binder::Status enableAutosuspend(const sp<IBinder>& token, bool* _aidl_return) override;
     binder::Status forceSuspend(bool* _aidl_return) override;
     binder::Status getSuspendStats(SuspendInfo* _aidl_return) override;
+    binder::Status getSuspendPhaseStats(std::vector<SuspendPhaseInfo>* _aidl_return) override;
+    binder::Status getStatsMemory(os::ParcelFileDescriptor* _aidl_return) override;
+    binder::Status getSleepTimeConfig(SleepTimeConfigInfo* _aidl_return) override;
+    binder::Status setSleepTimeConfig(const SleepTimeConfigInfo& config,
+                                      int64_t* _aidl_return) override;
+    binder::Status registerWakeLockEventCallback(const sp<IWakeLockEventCallback>& callback,
+                                                 const std::vector<std::string>& names,
+                                                 int64_t maxDelayMillis, int32_t maxBatchSize,
+                                                 bool collapsePairs, bool* _aidl_return) override;
+    binder::Status registerWakelockPatternCallback(const sp<IWakelockCallback>& callback,
+                                                   const std::string& pattern,
+                                                   bool* _aidl_return) override;
     binder::Status getWakeLockStats(std::vector<WakeLockInfo>* _aidl_return) override;
+    binder::Status getRefreshedWakeLockStats(std::vector<WakeLockInfo>* _aidl_return) override;
+    binder::Status getWakeLockStatsDelta(int64_t generation,
+                                         WakeLockStatsDelta* _aidl_return) override;
+    binder::Status getWakeLockHoldTimeStats(
+        std::vector<WakeLockHoldTimeInfo>* _aidl_return) override;
     binder::Status getWakeupStats(std::vector<WakeupInfo>* _aidl_return) override;
+    binder::Status getWakeupComponentStats(
+        std::vector<WakeupComponentInfo>* _aidl_return) override;
 
     void setSuspendService(const wp<SystemSuspend>& suspend);
     status_t dump(int fd, const Vector<String16>& args) override;
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SuspendStatsRegion.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+using ::android::base::Error;
+using ::android::base::ErrnoError;
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// Readers retry while the stats are being published, which only takes a few microseconds.
+static constexpr int kMaxReadAttempts = 1000;
+
+static size_t regionSize(size_t wakeLockCapacity) {
+    return sizeof(SuspendStatsRegionHeader) + wakeLockCapacity * sizeof(SharedWakeLockStat);
+}
+
+static const SharedWakeLockStat* wakeLockStats(const SuspendStatsRegionHeader* header) {
+    return reinterpret_cast<const SharedWakeLockStat*>(header + 1);
+}
+
+static SharedWakeLockStat* wakeLockStats(SuspendStatsRegionHeader* header) {
+    return reinterpret_cast<SharedWakeLockStat*>(header + 1);
+}
+
+/*
+ * Creates the memfd backing the region and maps it. Once mapped, the memfd is sealed so that its
+ * size can not change and it can not be written to or mapped writable through any fd, while the
+ * existing mapping of the service stays writable.
+ */
+Result<std::unique_ptr<SuspendStatsRegion>> SuspendStatsRegion::create(size_t wakeLockCapacity) {
+    size_t size = regionSize(wakeLockCapacity);
+
+    unique_fd fd(memfd_create("suspend_stats", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (fd < 0) {
+        return ErrnoError() << "Failed to create suspend stats memfd";
+    }
+    if (ftruncate(fd, size) < 0) {
+        return ErrnoError() << "Failed to resize suspend stats memfd";
+    }
+
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return ErrnoError() << "Failed to map suspend stats memfd";
+    }
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) <
+        0) {
+        munmap(addr, size);
+        return ErrnoError() << "Failed to seal suspend stats memfd";
+    }
+
+    auto* header = new (addr) SuspendStatsRegionHeader();
+    header->magic = kSuspendStatsRegionMagic;
+    header->version = kSuspendStatsRegionVersion;
+    header->wakeLockCapacity = wakeLockCapacity;
+
+    return std::unique_ptr<SuspendStatsRegion>(
+        new SuspendStatsRegion(std::move(fd), addr, size, wakeLockCapacity));
+}
+
+SuspendStatsRegion::SuspendStatsRegion(unique_fd fd, void* addr, size_t size,
+                                       size_t wakeLockCapacity)
+    : mFd(std::move(fd)), mAddr(addr), mSize(size), mWakeLockCapacity(wakeLockCapacity) {}
+
+SuspendStatsRegion::~SuspendStatsRegion() {
+    munmap(mAddr, mSize);
+}
+
+unique_fd SuspendStatsRegion::dupFd() const {
+    return unique_fd(fcntl(mFd, F_DUPFD_CLOEXEC, 0));
+}
+
+/*
+ * Writes the stats between two increments of the sequence number. Publishers are serialized by
+ * mPublishLock, so there is a single writer at a time as the seqlock requires.
+ */
+void SuspendStatsRegion::publish(const SuspendInfo& suspendInfo,
+                                 const std::vector<WakeLockInfo>& wakeLockStats) {
+    auto* header = static_cast<SuspendStatsRegionHeader*>(mAddr);
+    SharedWakeLockStat* stats = V1_0::wakeLockStats(header);
+    size_t numWakeLocks = std::min(wakeLockStats.size(), mWakeLockCapacity);
+    int64_t publishTimeMillis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    std::chrono::steady_clock::now().time_since_epoch())
+                                    .count();
+
+    std::lock_guard<std::mutex> lock(mPublishLock);
+    uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    header->numWakeLocks = numWakeLocks;
+    header->publishTimeMillis = publishTimeMillis;
+    header->suspendInfo = {
+        .suspendAttemptCount = suspendInfo.suspendAttemptCount,
+        .failedSuspendCount = suspendInfo.failedSuspendCount,
+        .shortSuspendCount = suspendInfo.shortSuspendCount,
+        .suspendTimeMillis = suspendInfo.suspendTimeMillis,
+        .shortSuspendTimeMillis = suspendInfo.shortSuspendTimeMillis,
+        .suspendOverheadTimeMillis = suspendInfo.suspendOverheadTimeMillis,
+        .failedSuspendOverheadTimeMillis = suspendInfo.failedSuspendOverheadTimeMillis,
+        .newBackoffCount = suspendInfo.newBackoffCount,
+        .backoffContinueCount = suspendInfo.backoffContinueCount,
+        .sleepTimeMillis = suspendInfo.sleepTimeMillis,
+    };
+    for (size_t i = 0; i < numWakeLocks; i++) {
+        const WakeLockInfo& info = wakeLockStats[i];
+        SharedWakeLockStat& stat = stats[i];
+        size_t nameLength = std::min(info.name.size(), kSharedWakeLockNameSize - 1);
+        memcpy(stat.name, info.name.data(), nameLength);
+        stat.name[nameLength] = '\0';
+        stat.pid = info.pid;
+        stat.isActive = info.isActive;
+        stat.activeCount = info.activeCount;
+        stat.lastChange = info.lastChange;
+        stat.maxTime = info.maxTime;
+        stat.totalTime = info.totalTime;
+        stat.activeTime = info.activeTime;
+    }
+
+    header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/*
+ * Maps the region read-only and checks that its layout is the one this reader was built for.
+ */
+Result<std::unique_ptr<SuspendStatsRegionReader>> SuspendStatsRegionReader::create(unique_fd fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return ErrnoError() << "Failed to stat suspend stats region";
+    }
+    size_t size = st.st_size;
+    if (size < sizeof(SuspendStatsRegionHeader)) {
+        return Error() << "Suspend stats region too small: " << size;
+    }
+
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return ErrnoError() << "Failed to map suspend stats region";
+    }
+
+    const auto* header = static_cast<const SuspendStatsRegionHeader*>(addr);
+    if (header->magic != kSuspendStatsRegionMagic ||
+        header->version != kSuspendStatsRegionVersion ||
+        size < regionSize(header->wakeLockCapacity)) {
+        munmap(addr, size);
+        return Error() << "Unsupported suspend stats region layout";
+    }
+
+    return std::unique_ptr<SuspendStatsRegionReader>(
+        new SuspendStatsRegionReader(addr, size, header->wakeLockCapacity));
+}
+
+SuspendStatsRegionReader::SuspendStatsRegionReader(const void* addr, size_t size,
+                                                   size_t wakeLockCapacity)
+    : mAddr(addr), mSize(size), mWakeLockCapacity(wakeLockCapacity) {}
+
+SuspendStatsRegionReader::~SuspendStatsRegionReader() {
+    munmap(const_cast<void*>(mAddr), mSize);
+}
+
+/*
+ * Copies the region and only converts the copy once the sequence number shows that it was not
+ * published over while copying.
+ */
+bool SuspendStatsRegionReader::read(SuspendInfo* suspendInfo,
+                                    std::vector<WakeLockInfo>* wakeLockStats,
+                                    int64_t* publishTimeMillis) const {
+    const auto* header = static_cast<const SuspendStatsRegionHeader*>(mAddr);
+    const SharedWakeLockStat* stats = V1_0::wakeLockStats(header);
+
+    std::vector<SharedWakeLockStat> statsCopy;
+    for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+        uint32_t sequence = header->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        size_t numWakeLocks = std::min<size_t>(header->numWakeLocks, mWakeLockCapacity);
+        int64_t publishTime = header->publishTimeMillis;
+        SharedSuspendInfo info = header->suspendInfo;
+        statsCopy.assign(stats, stats + numWakeLocks);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+
+        suspendInfo->suspendAttemptCount = info.suspendAttemptCount;
+        suspendInfo->failedSuspendCount = info.failedSuspendCount;
+        suspendInfo->shortSuspendCount = info.shortSuspendCount;
+        suspendInfo->suspendTimeMillis = info.suspendTimeMillis;
+        suspendInfo->shortSuspendTimeMillis = info.shortSuspendTimeMillis;
+        suspendInfo->suspendOverheadTimeMillis = info.suspendOverheadTimeMillis;
+        suspendInfo->failedSuspendOverheadTimeMillis = info.failedSuspendOverheadTimeMillis;
+        suspendInfo->newBackoffCount = info.newBackoffCount;
+        suspendInfo->backoffContinueCount = info.backoffContinueCount;
+        suspendInfo->sleepTimeMillis = info.sleepTimeMillis;
+
+        wakeLockStats->clear();
+        wakeLockStats->reserve(statsCopy.size());
+        for (const SharedWakeLockStat& stat : statsCopy) {
+            WakeLockInfo& wlInfo = wakeLockStats->emplace_back();
+            wlInfo.name.assign(stat.name, strnlen(stat.name, sizeof(stat.name)));
+            wlInfo.activeCount = stat.activeCount;
+            wlInfo.lastChange = stat.lastChange;
+            wlInfo.maxTime = stat.maxTime;
+            wlInfo.totalTime = stat.totalTime;
+            wlInfo.isActive = stat.isActive;
+            wlInfo.activeTime = stat.activeTime;
+            wlInfo.isKernelWakelock = false;
+            wlInfo.pid = stat.pid;
+            wlInfo.eventCount = 0;
+            wlInfo.expireCount = 0;
+            wlInfo.preventSuspendTime = 0;
+            wlInfo.wakeupCount = 0;
+            wlInfo.sampleAgeMillis = 0;
+        }
+
+        if (publishTimeMillis != nullptr) {
+            *publishTimeMillis = publishTime;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_SUSPEND_STATS_REGION_H
+#define ANDROID_SYSTEM_SUSPEND_SUSPEND_STATS_REGION_H
+
+#include <android-base/result.h>
+#include <android-base/unique_fd.h>
+#include <android/system/suspend/internal/SuspendInfo.h>
+#include <android/system/suspend/internal/WakeLockInfo.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using ::android::base::Result;
+using ::android::base::unique_fd;
+using ::android::system::suspend::internal::SuspendInfo;
+using ::android::system::suspend::internal::WakeLockInfo;
+
+/*
+ * Layout of the shared memory region returned by ISuspendControlServiceInternal.getStatsMemory().
+ * The region starts with a SuspendStatsRegionHeader followed by wakeLockCapacity
+ * SharedWakeLockStat. Only the system suspend service writes to it, readers must use
+ * SuspendStatsRegionReader to get a consistent copy.
+ */
+static constexpr uint32_t kSuspendStatsRegionMagic = 0x53535553;  // "SUSS"
+static constexpr uint32_t kSuspendStatsRegionVersion = 1;
+// Longer wake lock names are truncated.
+static constexpr size_t kSharedWakeLockNameSize = 128;
+
+struct SharedSuspendInfo {
+    int64_t suspendAttemptCount;
+    int64_t failedSuspendCount;
+    int64_t shortSuspendCount;
+    int64_t suspendTimeMillis;
+    int64_t shortSuspendTimeMillis;
+    int64_t suspendOverheadTimeMillis;
+    int64_t failedSuspendOverheadTimeMillis;
+    int64_t newBackoffCount;
+    int64_t backoffContinueCount;
+    int64_t sleepTimeMillis;
+};
+
+// A native wake lock stat, see WakeLockInfo.
+struct SharedWakeLockStat {
+    char name[kSharedWakeLockNameSize];
+    int32_t pid;
+    uint8_t isActive;
+    uint8_t reserved[3];
+    int64_t activeCount;
+    int64_t lastChange;
+    int64_t maxTime;
+    int64_t totalTime;
+    int64_t activeTime;
+};
+
+struct SuspendStatsRegionHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t wakeLockCapacity;
+    // Seqlock, odd while the fields below are being written.
+    std::atomic<uint32_t> sequence;
+    uint32_t numWakeLocks;
+    uint32_t reserved;
+    // Monotonic time (in ms) when the stats were published.
+    int64_t publishTimeMillis;
+    SharedSuspendInfo suspendInfo;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(sizeof(SharedSuspendInfo) == 80);
+static_assert(sizeof(SharedWakeLockStat) == 176);
+static_assert(sizeof(SuspendStatsRegionHeader) == 112);
+
+/*
+ * Writer side of the shared stats region, backed by a sealed memfd that readers can only map
+ * read-only.
+ * This class is thread safe.
+ */
+class SuspendStatsRegion {
+   public:
+    static Result<std::unique_ptr<SuspendStatsRegion>> create(size_t wakeLockCapacity);
+    ~SuspendStatsRegion();
+
+    // Replaces the published stats. Native wake lock stats beyond the capacity are dropped.
+    void publish(const SuspendInfo& suspendInfo, const std::vector<WakeLockInfo>& wakeLockStats);
+    // Returns a new fd to hand out to readers.
+    unique_fd dupFd() const;
+
+   private:
+    SuspendStatsRegion(unique_fd fd, void* addr, size_t size, size_t wakeLockCapacity);
+
+    unique_fd mFd;
+    void* mAddr;
+    size_t mSize;
+    size_t mWakeLockCapacity;
+    std::mutex mPublishLock;
+};
+
+/*
+ * Reads the shared stats region without any IPC.
+ * This class is thread safe.
+ */
+class SuspendStatsRegionReader {
+   public:
+    // fd is the file descriptor returned by ISuspendControlServiceInternal.getStatsMemory().
+    static Result<std::unique_ptr<SuspendStatsRegionReader>> create(unique_fd fd);
+    ~SuspendStatsRegionReader();
+
+    // Copies the latest published stats. Returns false if no consistent copy could be made because
+    // the stats kept being published while reading them.
+    bool read(SuspendInfo* suspendInfo, std::vector<WakeLockInfo>* wakeLockStats,
+              int64_t* publishTimeMillis = nullptr) const;
+
+   private:
+    SuspendStatsRegionReader(const void* addr, size_t size, size_t wakeLockCapacity);
+
+    const void* mAddr;
+    size_t mSize;
+    size_t mWakeLockCapacity;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_SUSPEND_STATS_REGION_H
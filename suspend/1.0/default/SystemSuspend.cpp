@@ -27,8 +27,11 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <charconv>
 #include <chrono>
 #include <string>
+#include <string_view>
 #include <thread>
 using namespace std::chrono_literals;
 
@@ -57,6 +60,7 @@ static constexpr char kSysPowerWakeLock[] = "/sys/power/wake_lock";
 static constexpr char kSysPowerWakeUnlock[] = "/sys/power/wake_unlock";
 static constexpr char kUnknownWakeup[] = "unknown";
 static constexpr char kErrorWakeup[] = "error";
+static constexpr std::chrono::milliseconds kStatsRegionPublishInterval = 1s;
 // This is used to disable autosuspend when zygote is restarted
 // it allows the system to make progress before autosuspend is kicked
 // NOTE: If the name of this wakelock is changed then also update the name
@@ -74,65 +78,94 @@ string readFd(int fd) {
     return string{buf, static_cast<size_t>(n)};
 }
 
-static std::vector<std::string> readWakeupReasons(int fd) {
-    std::vector<std::string> wakeupReasons;
-    std::string reasonlines;
-
-    lseek(fd, 0, SEEK_SET);
-    if (!ReadFdToString(fd, &reasonlines)) {
+// Reads the wakeup reasons into wakeupReasons. Returns false if reading the sysfs node fails, in
+// which case the wakeup reason is recorded as an error.
+static bool readWakeupReasons(int fd, WakeupReasons* wakeupReasons) {
+    if (!wakeupReasons->read(fd)) {
         PLOG(ERROR) << "failed to read wakeup reasons";
-        // Return unknown wakeup reason if we fail to read
-        return {kErrorWakeup};
+        wakeupReasons->parse(kErrorWakeup);
+        return false;
     }
 
-    if (reasonlines.empty()) {
+    // Empty wakeup reason found. Record as unknown wakeup
+    if (wakeupReasons->get().empty()) {
         LOG(ERROR) << "Unknown wakeup reasons";
-        // Return unknown wakeup reason if we fail to read
-        return {kUnknownWakeup};
+        wakeupReasons->parse(kUnknownWakeup);
     }
+    return true;
+}
 
-    std::stringstream ss(reasonlines);
-    for (std::string reasonline; std::getline(ss, reasonline);) {
-        reasonline = ::android::base::Trim(reasonline);
+// Parses a number of seconds printed as "<seconds>.<fraction>", with up to nanosecond precision,
+// from the start of s. Returns a pointer past the number, or nullptr if s does not start with one.
+static const char* parseSeconds(const char* s, const char* end, std::chrono::nanoseconds* out) {
+    while (s != end && isspace(static_cast<unsigned char>(*s))) {
+        s++;
+    }
 
-        // Only include non-empty reason lines
-        if (!reasonline.empty()) {
-            wakeupReasons.push_back(reasonline);
-        }
+    uint64_t seconds = 0;
+    auto [p, ec] = std::from_chars(s, end, seconds);
+    if (ec != std::errc()) {
+        return nullptr;
     }
 
-    // Empty wakeup reason found. Record as unknown wakeup
-    if (wakeupReasons.empty()) {
-        wakeupReasons.push_back(kUnknownWakeup);
+    uint64_t nanos = 0;
+    if (p != end && *p == '.') {
+        p++;
+        const char* fractionEnd = p;
+        while (fractionEnd != end && isdigit(static_cast<unsigned char>(*fractionEnd))) {
+            fractionEnd++;
+        }
+        // Digits beyond nanoseconds are ignored.
+        size_t digits = std::min<size_t>(fractionEnd - p, 9);
+        if (digits > 0 && std::from_chars(p, p + digits, nanos).ec != std::errc()) {
+            return nullptr;
+        }
+        for (size_t i = digits; i < 9; i++) {
+            nanos *= 10;
+        }
+        p = fractionEnd;
     }
 
-    return wakeupReasons;
+    *out = std::chrono::seconds(seconds) + std::chrono::nanoseconds(nanos);
+    return p;
 }
 
 // reads the suspend overhead and suspend time
 // Returns 0s if reading the sysfs node fails (unlikely)
 static struct SuspendTime readSuspendTime(int fd) {
-    std::string content;
-
-    lseek(fd, 0, SEEK_SET);
-    if (!ReadFdToString(fd, &content)) {
+    // Two numbers of seconds, e.g. "0.000123456 12.345678901".
+    char buf[128];
+    ssize_t n = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf), 0));
+    if (n < 0) {
         LOG(ERROR) << "failed to read suspend time";
         return {0ns, 0ns};
     }
 
-    double suspendOverhead, suspendTime;
-    std::stringstream ss(content);
-    if (!(ss >> suspendOverhead) || !(ss >> suspendTime)) {
-        LOG(ERROR) << "failed to parse suspend time " << content;
+    const char* end = buf + n;
+    std::chrono::nanoseconds suspendOverhead, suspendTime;
+    const char* p = parseSeconds(buf, end, &suspendOverhead);
+    if (p == nullptr || parseSeconds(p, end, &suspendTime) == nullptr) {
+        LOG(ERROR) << "failed to parse suspend time " << std::string_view(buf, n);
         return {0ns, 0ns};
     }
 
-    return {std::chrono::duration_cast<std::chrono::nanoseconds>(
-                std::chrono::duration<double>(suspendOverhead)),
-            std::chrono::duration_cast<std::chrono::nanoseconds>(
-                std::chrono::duration<double>(suspendTime))};
+    return {suspendOverhead, suspendTime};
 }
 
+class SystemSuspend::TokenDeathRecipient : public IBinder::DeathRecipient {
+   public:
+    explicit TokenDeathRecipient(SystemSuspend* suspend) : mSuspend(suspend) {}
+
+    void binderDied(const wp<IBinder>& who) override {
+        if (sp<SystemSuspend> suspend = mSuspend.promote()) {
+            suspend->onAutosuspendTokenDied(who);
+        }
+    }
+
+   private:
+    wp<SystemSuspend> mSuspend;
+};
+
 SystemSuspend::SystemSuspend(unique_fd wakeupCountFd, unique_fd stateFd, unique_fd suspendStatsFd,
                              size_t maxStatsEntries, unique_fd kernelWakelockStatsFd,
                              unique_fd wakeupReasonsFd, unique_fd suspendTimeFd,
@@ -145,18 +178,23 @@ SystemSuspend::SystemSuspend(unique_fd wakeupCountFd, unique_fd stateFd, unique_
       mStateFd(std::move(stateFd)),
       mSuspendStatsFd(std::move(suspendStatsFd)),
       mSuspendTimeFd(std::move(suspendTimeFd)),
-      kSleepTimeConfig(sleepTimeConfig),
+      mSleepTimeConfig(sleepTimeConfig),
       mSleepTime(sleepTimeConfig.baseSleepTime),
       mNumConsecutiveBadSuspends(0),
+      mLastSuspendFailed(false),
+      mBackoffPolicy(SuspendBackoffPolicy::create(sleepTimeConfig.backoffPolicy)),
       mControlService(controlService),
       mControlServiceInternal(controlServiceInternal),
       mStatsList(maxStatsEntries, std::move(kernelWakelockStatsFd)),
       mWakeupList(maxStatsEntries),
+      mWakeupReasonIndex(maxStatsEntries),
       mUseSuspendCounter(useSuspendCounter),
       mWakeLockFd(-1),
       mWakeUnlockFd(-1),
       mWakeupReasonsFd(std::move(wakeupReasonsFd)) {
     mControlServiceInternal->setSuspendService(this);
+    mSuspendInfo.backoffPolicy = mBackoffPolicy->name();
+    mSuspendInfo.nextSleepTimeMillis = mSleepTime.count();
 
     if (!mUseSuspendCounter) {
         mWakeLockFd.reset(TEMP_FAILURE_RETRY(open(kSysPowerWakeLock, O_CLOEXEC | O_RDWR)));
@@ -169,6 +207,20 @@ SystemSuspend::SystemSuspend(unique_fd wakeupCountFd, unique_fd stateFd, unique_
     if (mWakeUnlockFd < 0) {
         PLOG(ERROR) << "error opening " << kSysPowerWakeUnlock;
     }
+
+    if (!mUseSuspendCounter) {
+        mLegacyWakeLocks = std::make_unique<LegacyWakeLocks>(mWakeLockFd, mWakeUnlockFd);
+    }
+
+    mTokenDeathRecipient = sp<TokenDeathRecipient>::make(this);
+
+    auto statsRegion = SuspendStatsRegion::create(maxStatsEntries);
+    if (statsRegion.ok()) {
+        mStatsRegion = std::move(*statsRegion);
+        mStatsRegionPublisher = std::thread(&SystemSuspend::statsRegionPublisherLoop, this);
+    } else {
+        LOG(ERROR) << "error creating suspend stats region: " << statsRegion.error().message();
+    }
 }
 
 bool SystemSuspend::enableAutosuspend(const sp<IBinder>& token) {
@@ -187,7 +239,12 @@ bool SystemSuspend::enableAutosuspend(const sp<IBinder>& token) {
                               token) != mAutosuspendClientTokens.end();
 
     if (!hasToken) {
-        mAutosuspendClientTokens.push_back(token);
+        if (token->remoteBinder() && token->linkToDeath(mTokenDeathRecipient) != OK) {
+            // The client is already dead, so its token does not keep autosuspend enabled.
+            LOG(WARNING) << "Cannot link to death of autosuspend client token";
+        } else {
+            mAutosuspendClientTokens.push_back(token);
+        }
     }
 
     if (mAutosuspendEnabled) {
@@ -201,6 +258,11 @@ bool SystemSuspend::enableAutosuspend(const sp<IBinder>& token) {
 }
 
 void SystemSuspend::disableAutosuspendLocked() {
+    for (const sp<IBinder>& token : mAutosuspendClientTokens) {
+        if (token->remoteBinder()) {
+            token->unlinkToDeath(mTokenDeathRecipient);
+        }
+    }
     mAutosuspendClientTokens.clear();
     if (mAutosuspendEnabled) {
         mAutosuspendEnabled = false;
@@ -215,14 +277,26 @@ void SystemSuspend::disableAutosuspend() {
     disableAutosuspendLocked();
 }
 
-void SystemSuspend::checkAutosuspendClientsLivenessLocked() {
-    // Ping autosuspend client tokens, remove any dead tokens from the list.
-    // mAutosuspendLock must not be held when calling this, as that could lead to a deadlock
-    // if pingBinder() can't be processed by system_server because it's Binder thread pool is
-    // exhausted and blocked on acquire/release wakelock calls.
+/**
+ * The suspend loop releases mAutosuspendLock as its last access to this object, so this object can
+ * be destroyed once this returns.
+ */
+void SystemSuspend::waitForAutosuspendLoopExit() {
+    auto autosuspendLock = std::unique_lock(mAutosuspendLock);
+    mAutosuspendCondVar.wait(autosuspendLock, [this]() REQUIRES(mAutosuspendLock) {
+        return !mAutosuspendThreadCreated;
+    });
+}
+
+/**
+ * Only takes mAutosuspendClientTokensLock, which the suspend loop never holds while writing to
+ * sysfs, so a death notification is never delayed by a suspend attempt.
+ */
+void SystemSuspend::onAutosuspendTokenDied(const wp<IBinder>& token) {
+    auto tokensLock = std::lock_guard(mAutosuspendClientTokensLock);
     mAutosuspendClientTokens.erase(
         std::remove_if(mAutosuspendClientTokens.begin(), mAutosuspendClientTokens.end(),
-                       [](const sp<IBinder>& token) { return token->pingBinder() != OK; }),
+                       [&token](const sp<IBinder>& t) { return token == t; }),
         mAutosuspendClientTokens.end());
 }
 
@@ -231,6 +305,15 @@ bool SystemSuspend::hasAliveAutosuspendTokenLocked() {
 }
 
 SystemSuspend::~SystemSuspend(void) {
+    if (mStatsRegionPublisher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mStatsRegionPublisherLock);
+            mStatsRegionPublisherStopped = true;
+        }
+        mStatsRegionPublisherCondVar.notify_all();
+        mStatsRegionPublisher.join();
+    }
+
     auto tokensLock = std::lock_guard(mAutosuspendClientTokensLock);
     auto autosuspendLock = std::unique_lock(mAutosuspendLock);
 
@@ -249,9 +332,11 @@ bool SystemSuspend::forceSuspend() {
     //  or reset mSuspendCounter, it just ignores them.  When the system
     //  returns from suspend, the wakelocks and SuspendCounter will not have
     //  changed.
-    auto autosuspendLock = std::unique_lock(mAutosuspendLock);
+    auto suspendLock = std::unique_lock(mSuspendLock);
+    mSuspendSequence++;
     bool success = WriteStringToFd(kSleepState, mStateFd);
-    autosuspendLock.unlock();
+    mSuspendSequence++;
+    suspendLock.unlock();
 
     if (!success) {
         PLOG(VERBOSE) << "error writing to /sys/power/state for forceSuspend";
@@ -259,26 +344,68 @@ bool SystemSuspend::forceSuspend() {
     return success;
 }
 
-void SystemSuspend::incSuspendCounter(const string& name) {
-    auto l = std::lock_guard(mAutosuspendLock);
+/**
+ * Increments the suspend counter without blocking on the suspend loop.
+ *
+ * The suspend loop increments mSuspendSequence and then checks mSuspendCounter before writing to
+ * /sys/power/state. Here the order is reversed: mSuspendCounter is incremented first and
+ * mSuspendSequence is checked afterwards. Since both are sequentially consistent, at least one
+ * side observes the other. Either the suspend loop sees the wake lock and abandons the suspend
+ * attempt, or this thread sees the attempt in progress and waits for the system to resume before
+ * reporting the wake lock as acquired.
+ */
+void SystemSuspend::acquireSuspendCounter() {
+    mSuspendCounter++;
+    if (mSuspendSequence % 2 != 0) {
+        auto suspendLock = std::lock_guard(mSuspendLock);
+    }
+}
+
+void SystemSuspend::releaseSuspendCounter() {
+    if (--mSuspendCounter == 0) {
+        // mAutosuspendLock is only held by the suspend loop while it is not writing to sysfs,
+        // so waking it up does not block on a suspend attempt.
+        auto l = std::lock_guard(mAutosuspendLock);
+        mAutosuspendCondVar.notify_one();
+    }
+}
+
+void SystemSuspend::incSuspendCounter(const WakeLockName& name) {
     if (mUseSuspendCounter) {
-        mSuspendCounter++;
+        acquireSuspendCounter();
     } else {
-        if (!WriteStringToFd(name, mWakeLockFd)) {
-            PLOG(ERROR) << "error writing " << name << " to " << kSysPowerWakeLock;
-        }
+        mLegacyWakeLocks->acquire(name);
+    }
+}
+
+void SystemSuspend::decSuspendCounter(const WakeLockName& name) {
+    if (mUseSuspendCounter) {
+        releaseSuspendCounter();
+    } else {
+        mLegacyWakeLocks->release(name);
     }
 }
 
-void SystemSuspend::decSuspendCounter(const string& name) {
-    auto l = std::lock_guard(mAutosuspendLock);
+/**
+ * A batch of wake locks holds a single reference to the suspend counter, since suspend is blocked
+ * for as long as any wake lock of the batch is held.
+ */
+void SystemSuspend::incSuspendCounter(const std::vector<WakeLockName>& names) {
     if (mUseSuspendCounter) {
-        if (--mSuspendCounter == 0) {
-            mAutosuspendCondVar.notify_one();
+        acquireSuspendCounter();
+    } else {
+        for (const auto& name : names) {
+            incSuspendCounter(name);
         }
+    }
+}
+
+void SystemSuspend::decSuspendCounter(const std::vector<WakeLockName>& names) {
+    if (mUseSuspendCounter) {
+        releaseSuspendCounter();
     } else {
-        if (!WriteStringToFd(name, mWakeUnlockFd)) {
-            PLOG(ERROR) << "error writing " << name << " to " << kSysPowerWakeUnlock;
+        for (const auto& name : names) {
+            decSuspendCounter(name);
         }
     }
 }
@@ -306,30 +433,47 @@ void SystemSuspend::initAutosuspendLocked() {
 
         while (true) {
             {
-                base::ScopedLockAssertion autosuspendLocked(mAutosuspendLock);
+                ScopedProfiledLockAssertion autosuspendLocked(mAutosuspendLock);
 
                 if (!mAutosuspendEnabled) {
                     mAutosuspendThreadCreated = false;
+                    // See waitForAutosuspendLoopExit().
+                    mAutosuspendCondVar.notify_all();
                     return;
                 }
                 // If we got here by a failed write to /sys/power/wakeup_count; don't sleep
                 // since we didn't attempt to suspend on the last cycle of this loop.
-                if (shouldSleep) {
-                    mAutosuspendCondVar.wait_for(
-                        autosuspendLock, mSleepTime,
-                        [this]() REQUIRES(mAutosuspendLock) { return !mAutosuspendEnabled; });
+                if (shouldSleep && shouldSleepBeforeSuspend()) {
+                    ScopedAutosuspendPhase phase(&mPhaseStats,
+                                                 SuspendPhaseInfo::PHASE_BACKOFF_WAIT);
+                    // A new sleep time config applies to the ongoing wait.
+                    auto waitStart = std::chrono::steady_clock::now();
+                    uint64_t configUpdates;
+                    do {
+                        configUpdates = mSleepTimeConfigUpdates;
+                        mAutosuspendCondVar.wait_until(
+                            autosuspendLock, waitStart + getSleepTime(),
+                            [this, configUpdates]() REQUIRES(mAutosuspendLock) {
+                                return !mAutosuspendEnabled ||
+                                       mSleepTimeConfigUpdates != configUpdates;
+                            });
+                    } while (mAutosuspendEnabled && mSleepTimeConfigUpdates != configUpdates &&
+                             shouldSleepBeforeSuspend());
                 }
 
                 if (!mAutosuspendEnabled) continue;
                 autosuspendLock.unlock();
             }
 
+            ScopedAutosuspendPhase wakeupCountRead(&mPhaseStats,
+                                                   SuspendPhaseInfo::PHASE_WAKEUP_COUNT_READ);
             lseek(mWakeupCountFd, 0, SEEK_SET);
             string wakeupCount = readFd(mWakeupCountFd);
+            wakeupCountRead.end();
 
             {
                 autosuspendLock.lock();
-                base::ScopedLockAssertion autosuspendLocked(mAutosuspendLock);
+                ScopedProfiledLockAssertion autosuspendLocked(mAutosuspendLock);
 
                 if (wakeupCount.empty()) {
                     PLOG(ERROR) << "error reading from /sys/power/wakeup_count";
@@ -338,6 +482,7 @@ void SystemSuspend::initAutosuspendLocked() {
 
                 shouldSleep = false;
 
+                ScopedAutosuspendPhase phase(&mPhaseStats, SuspendPhaseInfo::PHASE_WAKE_LOCK_WAIT);
                 mAutosuspendCondVar.wait(autosuspendLock, [this]() REQUIRES(mAutosuspendLock) {
                     return mSuspendCounter == 0 || !mAutosuspendEnabled;
                 });
@@ -346,56 +491,91 @@ void SystemSuspend::initAutosuspendLocked() {
                 autosuspendLock.unlock();
             }
 
-            bool success;
             {
+                ScopedAutosuspendPhase phase(&mPhaseStats, SuspendPhaseInfo::PHASE_TOKEN_CHECK);
                 auto tokensLock = std::lock_guard(mAutosuspendClientTokensLock);
-                // TODO: Clean up client tokens after soaking the new approach
-                // checkAutosuspendClientsLivenessLocked();
 
                 autosuspendLock.lock();
-                base::ScopedLockAssertion autosuspendLocked(mAutosuspendLock);
+                ScopedProfiledLockAssertion autosuspendLocked(mAutosuspendLock);
 
                 if (!hasAliveAutosuspendTokenLocked()) {
                     disableAutosuspendLocked();
                     continue;
                 }
 
-                // Check suspend counter hasn't increased while checking client liveness
-                if (mSuspendCounter > 0) {
-                    continue;
-                }
+                autosuspendLock.unlock();
+            }
 
-                // The mutex is locked and *MUST* remain locked until we write to /sys/power/state.
-                // Otherwise, a WakeLock might be acquired after we check mSuspendCounter and before
-                // we write to /sys/power/state.
+            bool attempted = false;
+            bool success = false;
+            {
+                auto suspendLock = std::lock_guard(mSuspendLock);
 
-                if (!WriteStringToFd(wakeupCount, mWakeupCountFd)) {
-                    PLOG(VERBOSE) << "error writing to /sys/power/wakeup_count";
-                    continue;
+                // mSuspendSequence *MUST* be odd when we check mSuspendCounter and remain odd
+                // until we are done writing to /sys/power/state. Otherwise, a WakeLock might be
+                // acquired after we check mSuspendCounter and before we write to /sys/power/state.
+                // See incSuspendCounter().
+                mSuspendSequence++;
+
+                // Check suspend counter hasn't increased while checking client liveness
+                if (mSuspendCounter == 0) {
+                    ScopedAutosuspendPhase wakeupCountWrite(
+                        &mPhaseStats, SuspendPhaseInfo::PHASE_WAKEUP_COUNT_WRITE);
+                    if (WriteStringToFd(wakeupCount, mWakeupCountFd)) {
+                        wakeupCountWrite.end();
+                        ScopedAutosuspendPhase stateWrite(&mPhaseStats,
+                                                          SuspendPhaseInfo::PHASE_STATE_WRITE);
+                        success = WriteStringToFd(kSleepState, mStateFd);
+                        attempted = true;
+                        // Log before ending the phase, tracing may overwrite errno.
+                        if (!success) {
+                            PLOG(VERBOSE) << "error writing to /sys/power/state";
+                        }
+                    } else {
+                        PLOG(VERBOSE) << "error writing to /sys/power/wakeup_count";
+                    }
                 }
-                success = WriteStringToFd(kSleepState, mStateFd);
-                shouldSleep = true;
 
-                autosuspendLock.unlock();
+                mSuspendSequence++;
             }
 
-            if (!success) {
-                PLOG(VERBOSE) << "error writing to /sys/power/state";
+            if (!attempted) {
+                autosuspendLock.lock();
+                continue;
             }
+            shouldSleep = true;
 
+            ScopedAutosuspendPhase suspendTimeRead(&mPhaseStats,
+                                                   SuspendPhaseInfo::PHASE_SUSPEND_TIME_READ);
             struct SuspendTime suspendTime = readSuspendTime(mSuspendTimeFd);
-            updateSleepTime(success, suspendTime);
+            suspendTimeRead.end();
 
-            std::vector<std::string> wakeupReasons = readWakeupReasons(mWakeupReasonsFd);
-            if (wakeupReasons == std::vector<std::string>({kErrorWakeup})) {
+            ScopedAutosuspendPhase wakeupReasonsRead(&mPhaseStats,
+                                                     SuspendPhaseInfo::PHASE_WAKEUP_REASONS_READ);
+            if (!readWakeupReasons(mWakeupReasonsFd, &mWakeupReasons)) {
                 LOG(INFO) << "Unknown/empty wakeup reason. Re-opening wakeup_reason file.";
 
                 mWakeupReasonsFd =
                     std::move(reopenFileUsingFd(mWakeupReasonsFd.get(), O_CLOEXEC | O_RDONLY));
             }
-            mWakeupList.update(wakeupReasons);
+            wakeupReasonsRead.end();
 
-            mControlService->notifyWakeup(success, wakeupReasons);
+            ScopedAutosuspendPhase statsUpdate(&mPhaseStats, SuspendPhaseInfo::PHASE_STATS_UPDATE);
+            updateSleepTime(success, suspendTime);
+            requestStatsRegionPublish();
+            mWakeupList.update(mWakeupReasons);
+            mWakeupReasonIndex.update(
+                mWakeupReasons,
+                success ? std::chrono::round<std::chrono::milliseconds>(suspendTime.suspendTime)
+                        : 0ms,
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count());
+            statsUpdate.end();
+
+            ScopedAutosuspendPhase notify(&mPhaseStats, SuspendPhaseInfo::PHASE_NOTIFY);
+            mControlService->notifyWakeup(success, mWakeupReasons.get());
+            notify.end();
 
             // Take the lock before returning to the start of the loop
             autosuspendLock.lock();
@@ -407,33 +587,26 @@ void SystemSuspend::initAutosuspendLocked() {
 }
 
 /**
- * Updates sleep time depending on the result of suspend attempt.
- * Time (in milliseconds) between suspend attempts is described the formula
- * t[n] = { B, 0 < n <= N
- *        { min(B * (S**(n - N)), M), n > N
- * where:
- *   n is the number of consecutive bad suspend attempts,
- *   B = kBaseSleepTime,
- *   N = kSuspendBackoffThreshold,
- *   S = kSleepTimeScaleFactor,
- *   M = kMaxSleepTime
+ * Updates sleep time depending on the result of suspend attempt, as chosen by mBackoffPolicy.
  *
- * kFailedSuspendBackoffEnabled determines whether a failed suspend is counted as a bad suspend
+ * failedSuspendBackoffEnabled determines whether a failed suspend is counted as a bad suspend
  *
- * kShortSuspendBackoffEnabled determines whether a suspend whose duration
- * t < kShortSuspendThreshold is counted as a bad suspend
+ * shortSuspendBackoffEnabled determines whether a suspend whose duration
+ * t < shortSuspendThreshold is counted as a bad suspend
  */
 void SystemSuspend::updateSleepTime(bool success, const struct SuspendTime& suspendTime) {
     std::scoped_lock lock(mSuspendInfoLock);
     mSuspendInfo.suspendAttemptCount++;
-    mSuspendInfo.sleepTimeMillis +=
-        std::chrono::round<std::chrono::milliseconds>(mSleepTime).count();
+    if (shouldSleepBeforeSuspendLocked()) {
+        mSuspendInfo.sleepTimeMillis +=
+            std::chrono::round<std::chrono::milliseconds>(mSleepTime).count();
+    }
 
     bool shortSuspend = success && (suspendTime.suspendTime > 0ns) &&
-                        (suspendTime.suspendTime < kSleepTimeConfig.shortSuspendThreshold);
+                        (suspendTime.suspendTime < mSleepTimeConfig.shortSuspendThreshold);
 
-    bool badSuspend = (kSleepTimeConfig.failedSuspendBackoffEnabled && !success) ||
-                      (kSleepTimeConfig.shortSuspendBackoffEnabled && shortSuspend);
+    bool badSuspend = (mSleepTimeConfig.failedSuspendBackoffEnabled && !success) ||
+                      (mSleepTimeConfig.shortSuspendBackoffEnabled && shortSuspend);
 
     auto suspendTimeMillis =
         std::chrono::round<std::chrono::milliseconds>(suspendTime.suspendTime).count();
@@ -453,46 +626,105 @@ void SystemSuspend::updateSleepTime(bool success, const struct SuspendTime& susp
         mSuspendInfo.shortSuspendTimeMillis += suspendTimeMillis;
     }
 
+    SuspendAttempt attempt = {
+        .success = success,
+        .bad = badSuspend,
+        .numConsecutiveBadSuspends = static_cast<uint32_t>(mNumConsecutiveBadSuspends),
+        .suspendTime = suspendTime.suspendTime,
+        .suspendOverhead = suspendTime.suspendOverhead,
+    };
+    std::chrono::milliseconds sleepTime =
+        mBackoffPolicy->nextSleepTime(mSleepTimeConfig, attempt, mSleepTime);
+    if (sleepTime > mSleepTime) {
+        mSuspendInfo.sleepTimeIncreaseCount++;
+    } else if (sleepTime < mSleepTime) {
+        mSuspendInfo.sleepTimeDecreaseCount++;
+    }
+    mSleepTime = sleepTime;
+    mSuspendInfo.nextSleepTimeMillis = mSleepTime.count();
+
+    mLastSuspendFailed = !success;
+
     if (!badSuspend) {
         mNumConsecutiveBadSuspends = 0;
-        mSleepTime = kSleepTimeConfig.baseSleepTime;
         return;
     }
 
     // Suspend attempt was bad (failed or short suspend)
-    if (mNumConsecutiveBadSuspends >= kSleepTimeConfig.backoffThreshold) {
-        if (mNumConsecutiveBadSuspends == kSleepTimeConfig.backoffThreshold) {
+    if (mNumConsecutiveBadSuspends >= mSleepTimeConfig.backoffThreshold) {
+        if (mNumConsecutiveBadSuspends == mSleepTimeConfig.backoffThreshold) {
             mSuspendInfo.newBackoffCount++;
         } else {
             mSuspendInfo.backoffContinueCount++;
         }
-
-        mSleepTime = std::min(std::chrono::round<std::chrono::milliseconds>(
-                                  mSleepTime * kSleepTimeConfig.sleepTimeScaleFactor),
-                              kSleepTimeConfig.maxSleepTime);
     }
 
     mNumConsecutiveBadSuspends++;
 }
 
-void SystemSuspend::updateWakeLockStatOnAcquire(const std::string& name, int pid) {
+/**
+ * In event driven mode the suspend loop is woken up only by the suspend counter dropping to zero,
+ * autosuspend being disabled or the end of a backoff period. The loop therefore sleeps only after
+ * a bad suspend, for the duration computed by updateSleepTime(), or after a failed suspend even if
+ * failed suspends do not count as bad, so that it does not spin on a driver refusing to suspend.
+ * Otherwise, the loop sleeps before every suspend attempt.
+ */
+bool SystemSuspend::shouldSleepBeforeSuspend() {
+    std::scoped_lock lock(mSuspendInfoLock);
+    return shouldSleepBeforeSuspendLocked();
+}
+
+bool SystemSuspend::shouldSleepBeforeSuspendLocked() {
+    return !mSleepTimeConfig.eventDrivenAutosuspendEnabled || mNumConsecutiveBadSuspends > 0 ||
+           mLastSuspendFailed;
+}
+
+void SystemSuspend::updateWakeLockStatOnAcquire(const WakeLockName& name, int pid) {
     // Update the stats first so that the stat time is right after
     // suspend counter being incremented.
     mStatsList.updateOnAcquire(name, pid);
     mControlService->notifyWakelock(name, true);
+    markStatsRegionStale();
 }
 
-void SystemSuspend::updateWakeLockStatOnRelease(const std::string& name, int pid) {
+void SystemSuspend::updateWakeLockStatOnRelease(const WakeLockName& name, int pid) {
     // Update the stats first so that the stat time is right after
     // suspend counter being decremented.
     mStatsList.updateOnRelease(name, pid);
     mControlService->notifyWakelock(name, false);
+    markStatsRegionStale();
+}
+
+void SystemSuspend::updateWakeLockStatsOnAcquire(const std::vector<WakeLockName>& names,
+                                                 int pid) {
+    mStatsList.updateOnAcquire(names, pid);
+    for (const auto& name : names) {
+        mControlService->notifyWakelock(name, true);
+    }
+    markStatsRegionStale();
+}
+
+void SystemSuspend::updateWakeLockStatsOnRelease(const std::vector<WakeLockName>& names,
+                                                 int pid) {
+    mStatsList.updateOnRelease(names, pid);
+    for (const auto& name : names) {
+        mControlService->notifyWakelock(name, false);
+    }
+    markStatsRegionStale();
 }
 
 const WakeLockEntryList& SystemSuspend::getStatsList() const {
     return mStatsList;
 }
 
+void SystemSuspend::startKernelWakelockSampler(std::chrono::milliseconds interval) {
+    mStatsList.startKernelWakelockSampler(interval);
+}
+
+void SystemSuspend::setWakeLockHoldTimeHistogramSize(size_t bytesPerEntry) {
+    mStatsList.setHoldTimeHistogramSize(bytesPerEntry);
+}
+
 void SystemSuspend::updateStatsNow() {
     mStatsList.updateNow();
 }
@@ -503,10 +735,116 @@ void SystemSuspend::getSuspendInfo(SuspendInfo* info) {
     *info = mSuspendInfo;
 }
 
+/**
+ * Returns true if one of the published native wake locks is active, i.e. if its times will have
+ * changed by the next publish.
+ */
+bool SystemSuspend::publishStatsRegion() {
+    if (!mStatsRegion) {
+        return false;
+    }
+
+    SuspendInfo suspendInfo;
+    getSuspendInfo(&suspendInfo);
+    std::vector<WakeLockInfo> wakeLockStats;
+    mStatsList.updateNow();
+    mStatsList.getNativeWakeLockStats(&wakeLockStats);
+    mStatsRegion->publish(suspendInfo, wakeLockStats);
+    return std::any_of(wakeLockStats.begin(), wakeLockStats.end(),
+                       [](const WakeLockInfo& info) { return info.isActive; });
+}
+
+void SystemSuspend::markStatsRegionStale() {
+    // Only written once per publish, so that concurrent wake lock updates do not keep bouncing
+    // the flag between cores.
+    if (!mStatsRegionStale.load(std::memory_order_relaxed)) {
+        mStatsRegionStale.store(true, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Wakes up statsRegionPublisherLoop() to publish the stats region right away, so that the suspend
+ * loop never copies the stats itself.
+ */
+void SystemSuspend::requestStatsRegionPublish() {
+    if (!mStatsRegion) {
+        return;
+    }
+
+    markStatsRegionStale();
+    {
+        std::lock_guard<std::mutex> lock(mStatsRegionPublisherLock);
+        mStatsRegionPublishRequested = true;
+    }
+    mStatsRegionPublisherCondVar.notify_one();
+}
+
+/**
+ * Publishes the stats region on request, and every kStatsRegionPublishInterval if wake locks were
+ * updated or are held since the last publish, so that wake lock updates never copy the stats
+ * themselves.
+ */
+void SystemSuspend::statsRegionPublisherLoop() {
+    bool hasActiveWakeLocks = false;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mStatsRegionPublisherLock);
+            mStatsRegionPublisherCondVar.wait_for(lock, kStatsRegionPublishInterval, [this] {
+                android::base::ScopedLockAssertion lock_assertion(mStatsRegionPublisherLock);
+                return mStatsRegionPublisherStopped || mStatsRegionPublishRequested;
+            });
+            if (mStatsRegionPublisherStopped) {
+                return;
+            }
+            mStatsRegionPublishRequested = false;
+        }
+        if (mStatsRegionStale.exchange(false) || hasActiveWakeLocks) {
+            hasActiveWakeLocks = publishStatsRegion();
+        }
+    }
+}
+
+unique_fd SystemSuspend::getStatsRegionFd() {
+    if (!mStatsRegion) {
+        return unique_fd();
+    }
+
+    publishStatsRegion();
+    return mStatsRegion->dupFd();
+}
+
 const WakeupList& SystemSuspend::getWakeupList() const {
     return mWakeupList;
 }
 
+const WakeupReasonIndex& SystemSuspend::getWakeupReasonIndex() const {
+    return mWakeupReasonIndex;
+}
+
+const AutosuspendPhaseStats& SystemSuspend::getAutosuspendPhaseStats() const {
+    return mPhaseStats;
+}
+
+const LegacyWakeLocks* SystemSuspend::getLegacyWakeLocks() const {
+    return mLegacyWakeLocks.get();
+}
+
+void SystemSuspend::getLockStats(std::vector<LockStats>* stats) {
+    stats->clear();
+
+    LockStats autosuspendStats;
+    autosuspendStats.name = mAutosuspendLock.name();
+    mAutosuspendLock.addStats(&autosuspendStats);
+    stats->push_back(std::move(autosuspendStats));
+
+    mStatsList.getLockStats(stats);
+    mControlService->getLockStats(stats);
+}
+
+const sp<SuspendControlService>& SystemSuspend::getControlService() const {
+    return mControlService;
+}
+
 /**
  * Returns suspend stats.
  */
@@ -588,10 +926,54 @@ Result<SuspendStats> SystemSuspend::getSuspendStats() {
     return stats;
 }
 
-std::chrono::milliseconds SystemSuspend::getSleepTime() const {
+std::chrono::milliseconds SystemSuspend::getSleepTime() {
+    std::scoped_lock lock(mSuspendInfoLock);
     return mSleepTime;
 }
 
+SleepTimeConfig SystemSuspend::getSleepTimeConfig() {
+    std::scoped_lock lock(mSuspendInfoLock);
+    return mSleepTimeConfig;
+}
+
+/**
+ * A new backoff policy starts without any history. The current sleep time is reset to the new
+ * base sleep time unless backing off, in which case it is only brought within the new bounds.
+ * A wait between suspend attempts that is already under way is shortened or extended to match.
+ */
+Result<int64_t> SystemSuspend::setSleepTimeConfig(const SleepTimeConfig& config) {
+    if (auto valid = validateSleepTimeConfig(config); !valid.ok()) {
+        return Error() << valid.error().message();
+    }
+
+    auto lock = std::unique_lock(mSuspendInfoLock);
+    if (config.backoffPolicy != mSleepTimeConfig.backoffPolicy) {
+        mBackoffPolicy = SuspendBackoffPolicy::create(config.backoffPolicy);
+    }
+    mSleepTimeConfig = config;
+    if (mNumConsecutiveBadSuspends == 0) {
+        mSleepTime = config.baseSleepTime;
+    } else {
+        mSleepTime = std::clamp(mSleepTime, config.baseSleepTime, config.maxSleepTime);
+    }
+
+    mSuspendInfo.sleepTimeConfigGeneration++;
+    mSuspendInfo.backoffPolicy = mBackoffPolicy->name();
+    mSuspendInfo.nextSleepTimeMillis = mSleepTime.count();
+    LOG(INFO) << "SystemSuspend: Sleep time config generation "
+              << mSuspendInfo.sleepTimeConfigGeneration << ", base " << config.baseSleepTime.count()
+              << " ms, max " << config.maxSleepTime.count() << " ms, policy "
+              << mBackoffPolicy->name();
+    int64_t generation = mSuspendInfo.sleepTimeConfigGeneration;
+    lock.unlock();
+
+    // Wake up the suspend loop if it is waiting between suspend attempts.
+    auto autosuspendLock = std::lock_guard(mAutosuspendLock);
+    mSleepTimeConfigUpdates++;
+    mAutosuspendCondVar.notify_all();
+    return generation;
+}
+
 }  // namespace V1_0
 }  // namespace suspend
 }  // namespace system
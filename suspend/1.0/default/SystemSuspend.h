@@ -27,10 +27,20 @@
 #include <condition_variable>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "AutosuspendPhaseStats.h"
+#include "LegacyWakeLocks.h"
+#include "ProfiledMutex.h"
+#include "SuspendBackoffPolicy.h"
 #include "SuspendControlService.h"
+#include "SuspendStatsRegion.h"
 #include "WakeLockEntryList.h"
+#include "WakeLockName.h"
 #include "WakeupList.h"
+#include "WakeupReasonIndex.h"
+#include "WakeupReasons.h"
 
 namespace android {
 namespace system {
@@ -61,16 +71,6 @@ struct SuspendStats {
     std::string lastFailedStep;
 };
 
-struct SleepTimeConfig {
-    std::chrono::milliseconds baseSleepTime;
-    std::chrono::milliseconds maxSleepTime;
-    double sleepTimeScaleFactor;
-    uint32_t backoffThreshold;
-    std::chrono::milliseconds shortSuspendThreshold;
-    bool failedSuspendBackoffEnabled;
-    bool shortSuspendBackoffEnabled;
-};
-
 std::string readFd(int fd);
 
 class SystemSuspend : public RefBase {
@@ -82,43 +82,84 @@ class SystemSuspend : public RefBase {
                   const sp<SuspendControlService>& controlService,
                   const sp<SuspendControlServiceInternal>& controlServiceInternal,
                   bool useSuspendCounter = true);
-    void incSuspendCounter(const std::string& name);
-    void decSuspendCounter(const std::string& name);
+    void incSuspendCounter(const WakeLockName& name);
+    void decSuspendCounter(const WakeLockName& name);
+    void incSuspendCounter(const std::vector<WakeLockName>& names);
+    void decSuspendCounter(const std::vector<WakeLockName>& names);
     bool enableAutosuspend(const sp<IBinder>& token);
+    // Called when a remote token passed to enableAutosuspend() dies. Autosuspend is disabled by
+    // the suspend loop once no token is left.
+    void onAutosuspendTokenDied(const wp<IBinder>& token);
     void disableAutosuspend();
+    // Waits for the suspend loop to exit after autosuspend was disabled.
+    void waitForAutosuspendLoopExit();
     bool forceSuspend();
 
     const WakeupList& getWakeupList() const;
+    const WakeupReasonIndex& getWakeupReasonIndex() const;
+    const AutosuspendPhaseStats& getAutosuspendPhaseStats() const;
+    // Returns the contention stats of the locks profiled by ProfiledMutex.
+    void getLockStats(std::vector<LockStats>* stats);
+    // Returns null unless native wake locks are taken through /sys/power/wake_lock.
+    const LegacyWakeLocks* getLegacyWakeLocks() const;
+    const sp<SuspendControlService>& getControlService() const;
     const WakeLockEntryList& getStatsList() const;
-    void updateWakeLockStatOnAcquire(const std::string& name, int pid);
-    void updateWakeLockStatOnRelease(const std::string& name, int pid);
+    void updateWakeLockStatOnAcquire(const WakeLockName& name, int pid);
+    void updateWakeLockStatOnRelease(const WakeLockName& name, int pid);
+    void updateWakeLockStatsOnAcquire(const std::vector<WakeLockName>& names, int pid);
+    void updateWakeLockStatsOnRelease(const std::vector<WakeLockName>& names, int pid);
     void updateStatsNow();
+    void startKernelWakelockSampler(std::chrono::milliseconds interval);
+    void setWakeLockHoldTimeHistogramSize(size_t bytesPerEntry);
     Result<SuspendStats> getSuspendStats();
     void getSuspendInfo(SuspendInfo* info);
-    std::chrono::milliseconds getSleepTime() const;
+    // Publishes the latest stats to the shared stats region and returns an fd to read it, or an
+    // invalid fd if the region could not be created.
+    unique_fd getStatsRegionFd();
+    std::chrono::milliseconds getSleepTime();
+    SleepTimeConfig getSleepTimeConfig();
+    // Replaces the sleep time config while the suspend loop runs, keeping all stats. Returns the
+    // generation of the new config, or an error if it is out of bounds.
+    Result<int64_t> setSleepTimeConfig(const SleepTimeConfig& config);
     unique_fd reopenFileUsingFd(const int fd, int permission);
 
    private:
     ~SystemSuspend(void) override;
 
     std::mutex mAutosuspendClientTokensLock;
-    std::mutex mAutosuspendLock ACQUIRED_AFTER(mAutosuspendClientTokensLock);
+    ProfiledMutex mAutosuspendLock ACQUIRED_AFTER(mAutosuspendClientTokensLock){
+        "SystemSuspend::mAutosuspendLock"};
     std::mutex mSuspendInfoLock;
 
+    void acquireSuspendCounter();
+    void releaseSuspendCounter();
+
     void initAutosuspendLocked()
         EXCLUSIVE_LOCKS_REQUIRED(mAutosuspendClientTokensLock, mAutosuspendLock);
     void disableAutosuspendLocked()
         EXCLUSIVE_LOCKS_REQUIRED(mAutosuspendClientTokensLock, mAutosuspendLock);
-    void checkAutosuspendClientsLivenessLocked()
-        EXCLUSIVE_LOCKS_REQUIRED(mAutosuspendClientTokensLock);
     bool hasAliveAutosuspendTokenLocked() EXCLUSIVE_LOCKS_REQUIRED(mAutosuspendClientTokensLock);
 
-    std::condition_variable mAutosuspendCondVar GUARDED_BY(mAutosuspendLock);
-    uint32_t mSuspendCounter GUARDED_BY(mAutosuspendLock);
+    std::condition_variable_any mAutosuspendCondVar GUARDED_BY(mAutosuspendLock);
+    // Number of native wake locks held. Native wake locks are acquired without taking any lock
+    // shared with the suspend loop, see incSuspendCounter().
+    std::atomic<uint32_t> mSuspendCounter;
 
+    // Held while writing to /sys/power/wakeup_count and /sys/power/state.
+    std::mutex mSuspendLock;
+    // Incremented before and after every write to /sys/power/state, i.e. odd while the system
+    // might be going to sleep.
+    std::atomic<uint64_t> mSuspendSequence{0};
+
+    // Remote tokens are linked to mTokenDeathRecipient and removed when they die, so that the
+    // suspend loop never pings them.
     std::vector<sp<IBinder>> mAutosuspendClientTokens GUARDED_BY(mAutosuspendClientTokensLock);
+    class TokenDeathRecipient;
+    sp<TokenDeathRecipient> mTokenDeathRecipient;
     std::atomic<bool> mAutosuspendEnabled GUARDED_BY(mAutosuspendLock){false};
     std::atomic<bool> mAutosuspendThreadCreated GUARDED_BY(mAutosuspendLock){false};
+    // Incremented by setSleepTimeConfig() to wake up the suspend loop while it waits.
+    uint64_t mSleepTimeConfigUpdates GUARDED_BY(mAutosuspendLock) = 0;
 
     unique_fd mWakeupCountFd;
     unique_fd mStateFd;
@@ -128,20 +169,46 @@ class SystemSuspend : public RefBase {
 
     SuspendInfo mSuspendInfo GUARDED_BY(mSuspendInfoLock);
 
-    const SleepTimeConfig kSleepTimeConfig;
+    SleepTimeConfig mSleepTimeConfig GUARDED_BY(mSuspendInfoLock);
 
     // Amount of thread sleep time between consecutive iterations of the suspend loop
-    std::chrono::milliseconds mSleepTime;
+    std::chrono::milliseconds mSleepTime GUARDED_BY(mSuspendInfoLock);
     int32_t mNumConsecutiveBadSuspends GUARDED_BY(mSuspendInfoLock);
+    bool mLastSuspendFailed GUARDED_BY(mSuspendInfoLock);
+    std::unique_ptr<SuspendBackoffPolicy> mBackoffPolicy GUARDED_BY(mSuspendInfoLock);
 
     // Updates thread sleep time and suspend stats depending on the result of suspend attempt
     void updateSleepTime(bool success, const struct SuspendTime& suspendTime);
 
+    // Returns true if the suspend loop must wait mSleepTime before the next suspend attempt
+    bool shouldSleepBeforeSuspend();
+    bool shouldSleepBeforeSuspendLocked() REQUIRES(mSuspendInfoLock);
+
+    bool publishStatsRegion();
+    // Called on wake lock updates, only sets a flag for statsRegionPublisherLoop().
+    void markStatsRegionStale();
+    // Called by the suspend loop after each suspend attempt.
+    void requestStatsRegionPublish();
+    void statsRegionPublisherLoop();
+
     sp<SuspendControlService> mControlService;
     sp<SuspendControlServiceInternal> mControlServiceInternal;
 
     WakeLockEntryList mStatsList;
     WakeupList mWakeupList;
+    WakeupReasonIndex mWakeupReasonIndex;
+    AutosuspendPhaseStats mPhaseStats;
+
+    // Shared memory copy of the suspend and native wake lock stats, null if it could not be
+    // created. Published by mStatsRegionPublisher after every suspend attempt, and at most once
+    // per kStatsRegionPublishInterval while wake locks are updated or held.
+    std::unique_ptr<SuspendStatsRegion> mStatsRegion;
+    std::atomic<bool> mStatsRegionStale{false};
+    std::thread mStatsRegionPublisher;
+    std::mutex mStatsRegionPublisherLock;
+    std::condition_variable mStatsRegionPublisherCondVar;
+    bool mStatsRegionPublisherStopped GUARDED_BY(mStatsRegionPublisherLock) = false;
+    bool mStatsRegionPublishRequested GUARDED_BY(mStatsRegionPublisherLock) = false;
 
     // If true, use mSuspendCounter to keep track of native wake locks. Otherwise, rely on
     // /sys/power/wake_lock interface to block suspend.
@@ -149,7 +216,11 @@ class SystemSuspend : public RefBase {
     bool mUseSuspendCounter;
     unique_fd mWakeLockFd;
     unique_fd mWakeUnlockFd;
+    // Only set if mUseSuspendCounter is false.
+    std::unique_ptr<LegacyWakeLocks> mLegacyWakeLocks;
     unique_fd mWakeupReasonsFd;
+    // Only used by the autosuspend thread, reused across resumes.
+    WakeupReasons mWakeupReasons;
 };
 
 }  // namespace V1_0
@@ -27,7 +27,7 @@ static inline int getCallingPid() {
     return ::android::IPCThreadState::self()->getCallingPid();
 }
 
-WakeLock::WakeLock(SystemSuspend* systemSuspend, const std::string& name, int pid)
+WakeLock::WakeLock(SystemSuspend* systemSuspend, const WakeLockName& name, int pid)
     : mReleased(), mSystemSuspend(systemSuspend), mName(name), mPid(pid) {
     mSystemSuspend->incSuspendCounter(mName);
 }
@@ -48,6 +48,28 @@ void WakeLock::releaseOnce() {
     });
 }
 
+WakeLockBatch::WakeLockBatch(SystemSuspend* systemSuspend, std::vector<WakeLockName> names,
+                             int pid)
+    : mReleased(), mSystemSuspend(systemSuspend), mNames(std::move(names)), mPid(pid) {
+    mSystemSuspend->incSuspendCounter(mNames);
+}
+
+WakeLockBatch::~WakeLockBatch() {
+    releaseOnce();
+}
+
+ndk::ScopedAStatus WakeLockBatch::release() {
+    releaseOnce();
+    return ndk::ScopedAStatus::ok();
+}
+
+void WakeLockBatch::releaseOnce() {
+    std::call_once(mReleased, [this]() {
+        mSystemSuspend->decSuspendCounter(mNames);
+        mSystemSuspend->updateWakeLockStatsOnRelease(mNames, mPid);
+    });
+}
+
 SystemSuspendAidl::SystemSuspendAidl(SystemSuspend* systemSuspend)
     : mSystemSuspend(systemSuspend) {}
 
@@ -58,8 +80,22 @@ ndk::ScopedAStatus SystemSuspendAidl::acquireWakeLock(WakeLockType /* type */,
     if (_aidl_return == nullptr) {
         return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_ILLEGAL_ARGUMENT));
     }
-    *_aidl_return = ndk::SharedRefBase::make<WakeLock>(mSystemSuspend, name, pid);
-    mSystemSuspend->updateWakeLockStatOnAcquire(name, pid);
+    WakeLockName wlName(name);
+    *_aidl_return = ndk::SharedRefBase::make<WakeLock>(mSystemSuspend, wlName, pid);
+    mSystemSuspend->updateWakeLockStatOnAcquire(wlName, pid);
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus SystemSuspendAidl::acquireWakeLocks(WakeLockType /* type */,
+                                                       const std::vector<std::string>& names,
+                                                       std::shared_ptr<IWakeLock>* _aidl_return) {
+    auto pid = getCallingPid();
+    if (_aidl_return == nullptr || names.empty()) {
+        return ndk::ScopedAStatus(AStatus_fromExceptionCode(EX_ILLEGAL_ARGUMENT));
+    }
+    std::vector<WakeLockName> wlNames(names.begin(), names.end());
+    *_aidl_return = ndk::SharedRefBase::make<WakeLockBatch>(mSystemSuspend, wlNames, pid);
+    mSystemSuspend->updateWakeLockStatsOnAcquire(wlNames, pid);
     return ndk::ScopedAStatus::ok();
 }
 
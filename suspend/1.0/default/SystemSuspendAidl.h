@@ -20,6 +20,7 @@
 #include <aidl/android/system/suspend/BnWakeLock.h>
 
 #include <string>
+#include <vector>
 
 #include "SystemSuspend.h"
 
@@ -29,10 +30,11 @@ namespace system {
 namespace suspend {
 
 using ::android::system::suspend::V1_0::SystemSuspend;
+using ::android::system::suspend::V1_0::WakeLockName;
 
 class WakeLock : public BnWakeLock {
    public:
-    WakeLock(SystemSuspend* systemSuspend, const std::string& name, int pid);
+    WakeLock(SystemSuspend* systemSuspend, const WakeLockName& name, int pid);
     ~WakeLock();
 
     ndk::ScopedAStatus release() override;
@@ -42,7 +44,24 @@ class WakeLock : public BnWakeLock {
     std::once_flag mReleased;
 
     SystemSuspend* mSystemSuspend;
-    std::string mName;
+    WakeLockName mName;
+    int mPid;
+};
+
+// Single IWakeLock holding a batch of named wake locks.
+class WakeLockBatch : public BnWakeLock {
+   public:
+    WakeLockBatch(SystemSuspend* systemSuspend, std::vector<WakeLockName> names, int pid);
+    ~WakeLockBatch();
+
+    ndk::ScopedAStatus release() override;
+
+   private:
+    inline void releaseOnce();
+    std::once_flag mReleased;
+
+    SystemSuspend* mSystemSuspend;
+    std::vector<WakeLockName> mNames;
     int mPid;
 };
 
@@ -51,6 +70,8 @@ class SystemSuspendAidl : public BnSystemSuspend {
     SystemSuspendAidl(SystemSuspend* systemSuspend);
     ndk::ScopedAStatus acquireWakeLock(WakeLockType type, const std::string& name,
                                        std::shared_ptr<IWakeLock>* _aidl_return) override;
+    ndk::ScopedAStatus acquireWakeLocks(WakeLockType type, const std::vector<std::string>& names,
+                                        std::shared_ptr<IWakeLock>* _aidl_return) override;
 
    private:
     SystemSuspend* mSystemSuspend;
@@ -16,24 +16,67 @@
 
 #include <aidl/android/system/suspend/ISystemSuspend.h>
 #include <aidl/android/system/suspend/IWakeLock.h>
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
 #include <android/binder_manager.h>
+#include <android/system/suspend/BnWakelockCallback.h>
 #include <android/system/suspend/internal/ISuspendControlServiceInternal.h>
 #include <benchmark/benchmark.h>
 #include <binder/IServiceManager.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <thread>
+
+#include "SuspendControlService.h"
+#include "SuspendStatsRegion.h"
+#include "SystemSuspend.h"
+#include "SystemSuspendAidl.h"
 
 using aidl::android::system::suspend::ISystemSuspend;
 using aidl::android::system::suspend::IWakeLock;
+using aidl::android::system::suspend::SystemSuspendAidl;
 using aidl::android::system::suspend::WakeLockType;
+using android::BBinder;
 using android::IBinder;
 using android::sp;
+using android::binder::Status;
+using android::base::Socketpair;
+using android::base::unique_fd;
+using android::base::WriteStringToFd;
+using android::base::WriteStringToFile;
+using android::system::suspend::BnWakelockCallback;
 using android::system::suspend::internal::ISuspendControlServiceInternal;
+using android::system::suspend::internal::SuspendInfo;
 using android::system::suspend::internal::WakeLockInfo;
+using android::system::suspend::V1_0::readFd;
+using android::system::suspend::V1_0::SleepTimeConfig;
+using android::system::suspend::V1_0::SuspendBackoffPolicyType;
+using android::system::suspend::V1_0::SuspendControlService;
+using android::system::suspend::V1_0::SuspendControlServiceInternal;
+using android::system::suspend::V1_0::SuspendStatsRegionReader;
+using android::system::suspend::V1_0::SystemSuspend;
+using namespace std::chrono_literals;
 
-static void BM_acquireWakeLock(benchmark::State& state) {
+static std::shared_ptr<ISystemSuspend> getSuspendService() {
     static const std::string suspendInstance =
         std::string() + ISystemSuspend::descriptor + "/default";
     static std::shared_ptr<ISystemSuspend> suspendService = ISystemSuspend::fromBinder(
         ndk::SpAIBinder(AServiceManager_waitForService(suspendInstance.c_str())));
+    return suspendService;
+}
+
+static std::vector<std::string> getBenchmarkWakeLockNames(size_t count) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; i++) {
+        names.push_back("BenchmarkWakeLock" + std::to_string(i));
+    }
+    return names;
+}
+
+static void BM_acquireWakeLock(benchmark::State& state) {
+    std::shared_ptr<ISystemSuspend> suspendService = getSuspendService();
 
     while (state.KeepRunning()) {
         std::shared_ptr<IWakeLock> wl = nullptr;
@@ -42,6 +85,36 @@ static void BM_acquireWakeLock(benchmark::State& state) {
 }
 BENCHMARK(BM_acquireWakeLock);
 
+// Acquires and releases range(0) wake locks one transaction at a time.
+static void BM_acquireWakeLocksPerLock(benchmark::State& state) {
+    std::shared_ptr<ISystemSuspend> suspendService = getSuspendService();
+    const std::vector<std::string> names = getBenchmarkWakeLockNames(state.range(0));
+
+    while (state.KeepRunning()) {
+        std::vector<std::shared_ptr<IWakeLock>> wls(names.size());
+        for (size_t i = 0; i < names.size(); i++) {
+            suspendService->acquireWakeLock(WakeLockType::PARTIAL, names[i], &wls[i]);
+        }
+        for (const auto& wl : wls) {
+            wl->release();
+        }
+    }
+}
+BENCHMARK(BM_acquireWakeLocksPerLock)->Arg(1)->Arg(4)->Arg(16);
+
+// Acquires and releases range(0) wake locks in a single batch.
+static void BM_acquireWakeLocksBatched(benchmark::State& state) {
+    std::shared_ptr<ISystemSuspend> suspendService = getSuspendService();
+    const std::vector<std::string> names = getBenchmarkWakeLockNames(state.range(0));
+
+    while (state.KeepRunning()) {
+        std::shared_ptr<IWakeLock> wl = nullptr;
+        suspendService->acquireWakeLocks(WakeLockType::PARTIAL, names, &wl);
+        wl->release();
+    }
+}
+BENCHMARK(BM_acquireWakeLocksBatched)->Arg(1)->Arg(4)->Arg(16);
+
 static void BM_getWakeLockStats(benchmark::State& state) {
     static sp<IBinder> controlInternal =
         android::defaultServiceManager()->getService(android::String16("suspend_control_internal"));
@@ -55,4 +128,228 @@ static void BM_getWakeLockStats(benchmark::State& state) {
 }
 BENCHMARK(BM_getWakeLockStats);
 
+// Reads the suspend and native wake lock stats from the shared stats region, without any binder
+// call, for comparison with BM_getWakeLockStats.
+static void BM_readStatsMemory(benchmark::State& state) {
+    static sp<IBinder> controlInternal =
+        android::defaultServiceManager()->getService(android::String16("suspend_control_internal"));
+    static sp<ISuspendControlServiceInternal> controlServiceInternal =
+        android::interface_cast<ISuspendControlServiceInternal>(controlInternal);
+
+    android::os::ParcelFileDescriptor statsMemory;
+    if (!controlServiceInternal->getStatsMemory(&statsMemory).isOk()) {
+        state.SkipWithError("Suspend stats region unavailable");
+        return;
+    }
+    auto reader = SuspendStatsRegionReader::create(statsMemory.release());
+    if (!reader.ok()) {
+        state.SkipWithError(reader.error().message().c_str());
+        return;
+    }
+
+    while (state.KeepRunning()) {
+        SuspendInfo suspendInfo;
+        std::vector<WakeLockInfo> wlStats;
+        (*reader)->read(&suspendInfo, &wlStats);
+    }
+}
+BENCHMARK(BM_readStatsMemory);
+
+// Measures the time between the release of the last wake lock and the suspend loop writing to
+// /sys/power/state. range(0) selects the event driven suspend loop.
+static void BM_releaseToSuspendLatency(benchmark::State& state) {
+    unique_fd wakeupCountTestFd, wakeupCountServiceFd, stateTestFd, stateServiceFd;
+    Socketpair(SOCK_STREAM, &wakeupCountTestFd, &wakeupCountServiceFd);
+    Socketpair(SOCK_STREAM, &stateTestFd, &stateServiceFd);
+
+    TemporaryFile wakeupReasonsFile;
+    TemporaryFile suspendTimeFile;
+    WriteStringToFile("benchmark", wakeupReasonsFile.path);
+    // Report long suspends only, so that the suspend loop never backs off.
+    WriteStringToFile("0.001 10.0", suspendTimeFile.path);
+
+    const SleepTimeConfig sleepTimeConfig = {
+        .baseSleepTime = 10ms,
+        .maxSleepTime = 500ms,
+        .sleepTimeScaleFactor = 2.0,
+        .backoffThreshold = 1,
+        .shortSuspendThreshold = 50ms,
+        .failedSuspendBackoffEnabled = true,
+        .shortSuspendBackoffEnabled = true,
+        .eventDrivenAutosuspendEnabled = state.range(0) != 0,
+        .backoffPolicy = SuspendBackoffPolicyType::EXPONENTIAL,
+    };
+
+    sp<SuspendControlService> suspendControl = new SuspendControlService();
+    sp<SuspendControlServiceInternal> suspendControlInternal = new SuspendControlServiceInternal();
+    sp<SystemSuspend> systemSuspend = new SystemSuspend(
+        std::move(wakeupCountServiceFd), std::move(stateServiceFd),
+        unique_fd(-1) /* suspendStatsFd */, 1 /* maxStatsEntries */,
+        unique_fd(-1) /* kernelWakelockStatsFd */,
+        unique_fd(TEMP_FAILURE_RETRY(open(wakeupReasonsFile.path, O_CLOEXEC | O_RDONLY))),
+        unique_fd(TEMP_FAILURE_RETRY(open(suspendTimeFile.path, O_CLOEXEC | O_RDONLY))),
+        sleepTimeConfig, suspendControl, suspendControlInternal);
+    std::shared_ptr<SystemSuspendAidl> suspendAidl =
+        ndk::SharedRefBase::make<SystemSuspendAidl>(systemSuspend.get());
+    systemSuspend->enableAutosuspend(new BBinder());
+
+    const std::string wakeupCount = "42";
+    for (auto _ : state) {
+        std::shared_ptr<IWakeLock> wl = nullptr;
+        suspendAidl->acquireWakeLock(WakeLockType::PARTIAL, "BenchmarkWakeLock", &wl);
+        WriteStringToFd(wakeupCount, wakeupCountTestFd);
+
+        auto start = std::chrono::steady_clock::now();
+        wl->release();
+        readFd(stateTestFd);
+        auto end = std::chrono::steady_clock::now();
+
+        // Drain the wakeup count written back by the suspend loop.
+        readFd(wakeupCountTestFd);
+        state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+    }
+
+    systemSuspend->disableAutosuspend();
+    // Unblock the suspend loop so that it can observe that autosuspend was disabled, and wait for
+    // it to exit before dropping systemSuspend.
+    WriteStringToFd(wakeupCount, wakeupCountTestFd);
+    systemSuspend->waitForAutosuspendLoopExit();
+}
+BENCHMARK(BM_releaseToSuspendLatency)->Arg(0)->Arg(1)->UseManualTime();
+
+class NoopWakelockCallback : public BnWakelockCallback {
+   public:
+    Status notifyAcquired() override { return Status::ok(); }
+    Status notifyReleased() override { return Status::ok(); }
+};
+
+// Acquires and releases a wake lock that range(0) callbacks are registered for.
+static void BM_acquireWakeLockWithCallbacks(benchmark::State& state) {
+    unique_fd wakeupCountTestFd, wakeupCountServiceFd, stateTestFd, stateServiceFd;
+    Socketpair(SOCK_STREAM, &wakeupCountTestFd, &wakeupCountServiceFd);
+    Socketpair(SOCK_STREAM, &stateTestFd, &stateServiceFd);
+
+    const SleepTimeConfig sleepTimeConfig = {
+        .baseSleepTime = 10ms,
+        .maxSleepTime = 500ms,
+        .sleepTimeScaleFactor = 2.0,
+        .backoffThreshold = 1,
+        .shortSuspendThreshold = 50ms,
+        .failedSuspendBackoffEnabled = true,
+        .shortSuspendBackoffEnabled = true,
+    };
+
+    sp<SuspendControlService> suspendControl = new SuspendControlService();
+    sp<SuspendControlServiceInternal> suspendControlInternal = new SuspendControlServiceInternal();
+    sp<SystemSuspend> systemSuspend = new SystemSuspend(
+        std::move(wakeupCountServiceFd), std::move(stateServiceFd),
+        unique_fd(-1) /* suspendStatsFd */, 1 /* maxStatsEntries */,
+        unique_fd(-1) /* kernelWakelockStatsFd */, unique_fd(-1) /* wakeupReasonsFd */,
+        unique_fd(-1) /* suspendTimeFd */, sleepTimeConfig, suspendControl,
+        suspendControlInternal);
+    std::shared_ptr<SystemSuspendAidl> suspendAidl =
+        ndk::SharedRefBase::make<SystemSuspendAidl>(systemSuspend.get());
+
+    for (int64_t i = 0; i < state.range(0); i++) {
+        bool registered = false;
+        suspendControl->registerWakelockCallback(new NoopWakelockCallback(), "BenchmarkWakeLock",
+                                                 &registered);
+    }
+
+    for (auto _ : state) {
+        std::shared_ptr<IWakeLock> wl = nullptr;
+        suspendAidl->acquireWakeLock(WakeLockType::PARTIAL, "BenchmarkWakeLock", &wl);
+        wl->release();
+    }
+}
+BENCHMARK(BM_acquireWakeLockWithCallbacks)->Arg(0)->Arg(1)->Arg(10);
+
+// In-process SystemSuspend whose suspend loop keeps attempting to suspend against a simulated
+// kernel whenever no wake lock is held.
+class ActiveSuspendLoop {
+   public:
+    ActiveSuspendLoop() {
+        // Reads of /sys/power/wakeup_count never block, as when no wakeup event is in progress, so
+        // that the loop keeps running after a wake lock acquired during an attempt made it skip
+        // the attempt without writing to /sys/power/state.
+        unique_fd wakeupCountServiceFd{
+            TEMP_FAILURE_RETRY(open("/dev/zero", O_CLOEXEC | O_RDWR))};
+        unique_fd stateServiceFd;
+        Socketpair(SOCK_STREAM, &mStateFd, &stateServiceFd);
+        WriteStringToFile("benchmark", mWakeupReasonsFile.path);
+        WriteStringToFile("0.001 10.0", mSuspendTimeFile.path);
+
+        const SleepTimeConfig sleepTimeConfig = {
+            .baseSleepTime = 0ms,
+            .maxSleepTime = 0ms,
+            .sleepTimeScaleFactor = 1.0,
+            .backoffThreshold = 1,
+            .shortSuspendThreshold = 0ms,
+            .failedSuspendBackoffEnabled = false,
+            .shortSuspendBackoffEnabled = false,
+            .eventDrivenAutosuspendEnabled = true,
+            .backoffPolicy = SuspendBackoffPolicyType::EXPONENTIAL,
+        };
+
+        sp<SuspendControlService> suspendControl = new SuspendControlService();
+        sp<SuspendControlServiceInternal> suspendControlInternal =
+            new SuspendControlServiceInternal();
+        mSystemSuspend = new SystemSuspend(
+            std::move(wakeupCountServiceFd), std::move(stateServiceFd),
+            unique_fd(-1) /* suspendStatsFd */, 1 /* maxStatsEntries */,
+            unique_fd(-1) /* kernelWakelockStatsFd */,
+            unique_fd(TEMP_FAILURE_RETRY(open(mWakeupReasonsFile.path, O_CLOEXEC | O_RDONLY))),
+            unique_fd(TEMP_FAILURE_RETRY(open(mSuspendTimeFile.path, O_CLOEXEC | O_RDONLY))),
+            sleepTimeConfig, suspendControl, suspendControlInternal);
+        mSuspendAidl = ndk::SharedRefBase::make<SystemSuspendAidl>(mSystemSuspend.get());
+        mSystemSuspend->enableAutosuspend(new BBinder());
+
+        // Complete every suspend attempt immediately, until the socket is shut down.
+        mKernelThread = std::thread([this] {
+            while (!readFd(mStateFd).empty()) {
+            }
+        });
+    }
+
+    ~ActiveSuspendLoop() {
+        mSystemSuspend->disableAutosuspend();
+        // The kernel thread keeps completing suspend attempts until the loop exits.
+        mSystemSuspend->waitForAutosuspendLoopExit();
+        shutdown(mStateFd, SHUT_RDWR);
+        mKernelThread.join();
+    }
+
+    const std::shared_ptr<SystemSuspendAidl>& getSuspendAidl() const { return mSuspendAidl; }
+
+   private:
+    unique_fd mStateFd;
+    TemporaryFile mWakeupReasonsFile;
+    TemporaryFile mSuspendTimeFile;
+    sp<SystemSuspend> mSystemSuspend;
+    std::shared_ptr<SystemSuspendAidl> mSuspendAidl;
+    std::thread mKernelThread;
+};
+
+// Measures wake lock acquire/release from many threads, standing in for binder threads, while
+// the suspend loop is active.
+static void BM_acquireWakeLockDuringSuspendLoop(benchmark::State& state) {
+    static ActiveSuspendLoop* suspendLoop = nullptr;
+    if (state.thread_index() == 0) {
+        suspendLoop = new ActiveSuspendLoop();
+    }
+
+    for (auto _ : state) {
+        std::shared_ptr<IWakeLock> wl = nullptr;
+        suspendLoop->getSuspendAidl()->acquireWakeLock(WakeLockType::PARTIAL, "BenchmarkWakeLock",
+                                                       &wl);
+        wl->release();
+    }
+
+    if (state.thread_index() == 0) {
+        delete suspendLoop;
+        suspendLoop = nullptr;
+    }
+}
+BENCHMARK(BM_acquireWakeLockDuringSuspendLoop)->ThreadRange(1, 16)->UseRealTime();
+
 BENCHMARK_MAIN();
@@ -42,7 +42,7 @@ class WakeLock : public IWakeLock {
     std::once_flag mReleased;
 
     SystemSuspend* mSystemSuspend;
-    std::string mName;
+    WakeLockName mName;
     int mPid;
 };
 
@@ -22,6 +22,7 @@
 #include <android/binder_stability.h>
 #include <android/system/suspend/BnSuspendCallback.h>
 #include <android/system/suspend/BnWakelockCallback.h>
+#include <android/system/suspend/internal/BnWakeLockEventCallback.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
 #include <binder/ProcessState.h>
@@ -30,22 +31,36 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <hidl/HidlTransportSupport.h>
+#include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <chrono>
 #include <cmath>
 #include <csignal>
 #include <cstdlib>
 #include <future>
+#include <limits>
 #include <string>
 #include <thread>
 
+#include "AutosuspendPhaseStats.h"
+#include "DurationHistogram.h"
+#include "LegacyWakeLocks.h"
+#include "ProfiledMutex.h"
+#include "SuspendBackoffPolicy.h"
+#include "SuspendCallbackDispatcher.h"
 #include "SuspendControlService.h"
+#include "SuspendStatsRegion.h"
 #include "SystemSuspend.h"
 #include "SystemSuspendAidl.h"
+#include "WakeLockEntryList.h"
+#include "WakeLockNamePattern.h"
 #include "WakeupList.h"
+#include "WakeupReasonIndex.h"
+#include "WakeupReasons.h"
 
 using aidl::android::system::suspend::ISystemSuspend;
 using aidl::android::system::suspend::IWakeLock;
@@ -64,17 +79,48 @@ using android::hardware::Void;
 using android::system::suspend::BnSuspendCallback;
 using android::system::suspend::BnWakelockCallback;
 using android::system::suspend::ISuspendControlService;
+using android::system::suspend::internal::BnWakeLockEventCallback;
 using android::system::suspend::internal::ISuspendControlServiceInternal;
+using android::system::suspend::internal::SleepTimeConfigInfo;
+using android::system::suspend::internal::SuspendPhaseInfo;
+using android::system::suspend::internal::WakeLockEvent;
+using android::system::suspend::internal::WakeLockHoldTimeInfo;
 using android::system::suspend::internal::WakeLockInfo;
+using android::system::suspend::internal::WakeLockStatsDelta;
+using android::system::suspend::internal::WakeupComponentInfo;
 using android::system::suspend::internal::WakeupInfo;
+using android::system::suspend::V1_0::AdaptiveBackoffPolicy;
+using android::system::suspend::V1_0::AutosuspendPhaseStats;
+using android::system::suspend::V1_0::DurationHistogram;
+using android::system::suspend::V1_0::ExponentialBackoffPolicy;
+using android::system::suspend::V1_0::LegacyWakeLocks;
+using android::system::suspend::V1_0::LockStats;
+using android::system::suspend::V1_0::ProfiledMutex;
 using android::system::suspend::V1_0::readFd;
+using android::system::suspend::V1_0::ScopedAutosuspendPhase;
 using android::system::suspend::V1_0::SleepTimeConfig;
+using android::system::suspend::V1_0::SuspendAttempt;
+using android::system::suspend::V1_0::SuspendBackoffPolicy;
+using android::system::suspend::V1_0::SuspendBackoffPolicyType;
+using android::system::suspend::V1_0::SuspendCallbackConfig;
+using android::system::suspend::V1_0::SuspendCallbackDispatcher;
 using android::system::suspend::V1_0::SuspendControlService;
 using android::system::suspend::V1_0::SuspendControlServiceInternal;
+using android::system::suspend::V1_0::kSharedWakeLockNameSize;
 using android::system::suspend::V1_0::SuspendStats;
+using android::system::suspend::V1_0::SuspendStatsRegion;
+using android::system::suspend::V1_0::SuspendStatsRegionHeader;
+using android::system::suspend::V1_0::SuspendStatsRegionReader;
 using android::system::suspend::V1_0::SystemSuspend;
 using android::system::suspend::V1_0::TimestampType;
+using android::system::suspend::V1_0::validateSleepTimeConfig;
+using android::system::suspend::V1_0::WakeLockEntryList;
+using android::system::suspend::V1_0::WakeLockName;
+using android::system::suspend::V1_0::WakeLockNamePattern;
+using android::system::suspend::V1_0::WakeLockNameTable;
 using android::system::suspend::V1_0::WakeupList;
+using android::system::suspend::V1_0::WakeupReasonIndex;
+using android::system::suspend::V1_0::WakeupReasons;
 using namespace std::chrono_literals;
 
 namespace android {
@@ -290,6 +336,8 @@ class SystemSuspendTest : public ::testing::Test {
         .shortSuspendThreshold = 100ms,
         .failedSuspendBackoffEnabled = true,
         .shortSuspendBackoffEnabled = true,
+        .eventDrivenAutosuspendEnabled = false,
+        .backoffPolicy = SuspendBackoffPolicyType::EXPONENTIAL,
     };
 };
 
@@ -338,14 +386,9 @@ TEST_F(SystemSuspendTest, DisableAutosuspendBlocksSuspend) {
     ASSERT_TRUE(enabled);
 }
 
-// TODO: Clean up binder tokens after soaking new implementation
-/*
+// Death notifications are only sent for remote binders, the tests simulate them for local tokens.
 TEST_F(SystemSuspendTest, BlockAutosuspendIfBinderIsDead) {
-    class DeadBinder : public BBinder {
-        android::status_t pingBinder() override { return android::UNKNOWN_ERROR; }
-    };
-
-    auto token = sp<DeadBinder>::make();
+    auto token = sp<BBinder>::make();
 
     systemSuspend->disableAutosuspend();
     unblockSystemSuspendFromWakeupCount();
@@ -353,62 +396,43 @@ TEST_F(SystemSuspendTest, BlockAutosuspendIfBinderIsDead) {
 
     bool enabled = false;
     controlServiceInternal->enableAutosuspend(token, &enabled);
-    unblockSystemSuspendFromWakeupCount();
+    ASSERT_TRUE(enabled);
+    checkLoop(1);
 
+    systemSuspend->onAutosuspendTokenDied(token);
+    unblockSystemSuspendFromWakeupCount();
     ASSERT_TRUE(isSystemSuspendBlocked(150));
-}
-
-TEST_F(SystemSuspendTest, UnresponsiveClientDoesNotBlockAcquireRelease) {
-    static std::mutex _lock;
-    static std::condition_variable inPingBinderCondVar;
-    static bool inPingBinder = false;
 
-    class UnresponsiveBinder : public BBinder {
-        android::status_t pingBinder() override {
-            auto lock = std::unique_lock(_lock);
-            inPingBinder = true;
-            inPingBinderCondVar.notify_all();
+    // Re-enable autosuspend
+    controlServiceInternal->enableAutosuspend(new BBinder(), &enabled);
+    ASSERT_TRUE(enabled);
+}
 
-            // Block pingBinder until test finishes and releases its lock
-            inPingBinderCondVar.wait(lock);
-            return android::UNKNOWN_ERROR;
-        }
-    };
+TEST_F(SystemSuspendTest, AutosuspendContinuesWhileATokenIsAlive) {
+    auto token1 = sp<BBinder>::make();
+    auto token2 = sp<BBinder>::make();
 
     systemSuspend->disableAutosuspend();
     unblockSystemSuspendFromWakeupCount();
     ASSERT_TRUE(isSystemSuspendBlocked());
 
-    auto token = sp<UnresponsiveBinder>::make();
     bool enabled = false;
-    controlServiceInternal->enableAutosuspend(token, &enabled);
-    unblockSystemSuspendFromWakeupCount();
-
-    auto lock = std::unique_lock(_lock);
-    // wait until pingBinder has been called.
-    if (!inPingBinder) {
-        inPingBinderCondVar.wait(lock);
-    }
-    // let pingBinder finish once we release the test lock
-    inPingBinderCondVar.notify_all();
+    controlServiceInternal->enableAutosuspend(token1, &enabled);
+    ASSERT_TRUE(enabled);
+    controlServiceInternal->enableAutosuspend(token2, &enabled);
+    ASSERT_FALSE(enabled);
 
-    std::condition_variable wakeLockAcquired;
-    std::thread(
-        [this](std::condition_variable& wakeLockAcquired) {
-            std::shared_ptr<IWakeLock> testLock = acquireWakeLock("testLock");
-            testLock->release();
-            wakeLockAcquired.notify_all();
-        },
-        std::ref(wakeLockAcquired))
-        .detach();
+    systemSuspend->onAutosuspendTokenDied(token1);
+    checkLoop(1);
 
-    std::mutex _acquireReleaseLock;
-    auto acquireReleaseLock = std::unique_lock(_acquireReleaseLock);
-    bool timedOut = wakeLockAcquired.wait_for(acquireReleaseLock, 200ms) == std::cv_status::timeout;
+    systemSuspend->onAutosuspendTokenDied(token2);
+    unblockSystemSuspendFromWakeupCount();
+    ASSERT_TRUE(isSystemSuspendBlocked(150));
 
-    ASSERT_FALSE(timedOut);
+    // Re-enable autosuspend
+    controlServiceInternal->enableAutosuspend(new BBinder(), &enabled);
+    ASSERT_TRUE(enabled);
 }
-*/
 
 TEST_F(SystemSuspendTest, AutosuspendLoop) {
     checkLoop(5);
@@ -452,6 +476,26 @@ TEST_F(SystemSuspendTest, MultipleWakeLocks) {
     ASSERT_FALSE(isSystemSuspendBlocked());
 }
 
+// Tests that a batch of WakeLocks blocks SystemSuspend HAL until the batch is released.
+TEST_F(SystemSuspendTest, BatchedWakeLocksRelease) {
+    std::shared_ptr<IWakeLock> wl = nullptr;
+    ASSERT_TRUE(
+        suspendService->acquireWakeLocks(WakeLockType::PARTIAL, {"TestLock1", "TestLock2"}, &wl)
+            .isOk());
+    ASSERT_NE(wl, nullptr);
+    unblockSystemSuspendFromWakeupCount();
+    ASSERT_TRUE(isSystemSuspendBlocked());
+    wl->release();
+    ASSERT_FALSE(isSystemSuspendBlocked());
+}
+
+// Tests that an empty batch of WakeLocks is rejected.
+TEST_F(SystemSuspendTest, EmptyBatchedWakeLocks) {
+    std::shared_ptr<IWakeLock> wl = nullptr;
+    ASSERT_FALSE(suspendService->acquireWakeLocks(WakeLockType::PARTIAL, {}, &wl).isOk());
+    ASSERT_EQ(wl, nullptr);
+}
+
 // Tests that upon thread deallocation WakeLock is destructed and SystemSuspend HAL is unblocked.
 TEST_F(SystemSuspendTest, ThreadCleanup) {
     std::thread clientThread([this] {
@@ -545,14 +589,29 @@ TEST_F(SystemSuspendTest, SuspendBackoffMaxTest) {
 // are destroyed, i.e. the test needs to control lifetime of the mock object.
 // MockCallbackImpl can be destroyed independently of its wrapper MockCallback which is passed to
 // SystemSuspend.
+// Wakeups are delivered from the callback's dispatcher thread, so the test waits for them.
 struct MockCallbackImpl {
     binder::Status notifyWakeup([[maybe_unused]] bool success,
                                 const std::vector<std::string>& wakeupReasons) {
+        auto l = std::lock_guard(mLock);
         mWakeupReasons = wakeupReasons;
         mNumWakeups++;
+        mCondVar.notify_all();
         return binder::Status::ok();
     }
 
+    bool waitForWakeups(int numWakeups) {
+        auto l = std::unique_lock(mLock);
+        return mCondVar.wait_for(l, 5s, [&] { return mNumWakeups >= numWakeups; });
+    }
+
+    std::vector<std::string> getWakeupReasons() {
+        auto l = std::lock_guard(mLock);
+        return mWakeupReasons;
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCondVar;
     std::vector<std::string> mWakeupReasons;
     int mNumWakeups = 0;
 };
@@ -569,7 +628,7 @@ class MockCallback : public BnSuspendCallback {
 
    private:
     MockCallbackImpl* mImpl;
-    bool mDisabled;
+    std::atomic<bool> mDisabled;
 };
 
 // Tests that nullptr can't be registered as callbacks.
@@ -588,11 +647,10 @@ TEST_F(SystemSuspendTest, CallbackNotifyWakeup) {
     controlService->registerCallback(cb, &retval);
     ASSERT_TRUE(retval);
     checkLoop(numWakeups + 1);
-    cb->disable();
     // SystemSuspend should suspend numWakeup + 1 times. However, it might
-    // only be able to notify numWakeup times. The test case might have
-    // finished by the time last notification completes.
-    ASSERT_GE(impl.mNumWakeups, numWakeups);
+    // only have queued numWakeup notifications by the time checkLoop returns.
+    ASSERT_TRUE(impl.waitForWakeups(numWakeups));
+    cb->disable();
 }
 
 // Tests that SystemSuspend HAL correctly notifies wakeup subscribers with wakeup reasons.
@@ -622,46 +680,53 @@ TEST_F(SystemSuspendTest, CallbackNotifyWakeupReason) {
     ASSERT_TRUE(retval);
 
     // wakeupReason0 empty wakeup reason
-    // Following assert check may happen before a callback been executed, iterate few checkLoop to
-    // make sure at least one callback been finished.
-    checkLoop(3);
-    ASSERT_EQ(impl.mWakeupReasons.size(), 1);
-    ASSERT_EQ(impl.mWakeupReasons[0], referenceWakeupUnknown);
+    // The wakeup reasons may be read before being written, iterate few checkLoop and wait for the
+    // wakeups that were queued after the reasons had been written.
+    int numSuspends = 0;
+    auto checkLoopAndWait = [&] {
+        checkLoop(3);
+        numSuspends += 3;
+        // The wakeup of the last suspend may not have been queued yet.
+        ASSERT_TRUE(impl.waitForWakeups(numSuspends - 1));
+    };
+    checkLoopAndWait();
+    ASSERT_EQ(impl.getWakeupReasons().size(), 1);
+    ASSERT_EQ(impl.getWakeupReasons()[0], referenceWakeupUnknown);
 
     // wakeupReason1 single invalid wakeup reason with only space.
     ASSERT_TRUE(WriteStringToFd(wakeupReason1, wakeupReasonsWriteFd));
-    checkLoop(3);
-    ASSERT_EQ(impl.mWakeupReasons.size(), 1);
-    ASSERT_EQ(impl.mWakeupReasons[0], referenceWakeupUnknown);
+    checkLoopAndWait();
+    ASSERT_EQ(impl.getWakeupReasons().size(), 1);
+    ASSERT_EQ(impl.getWakeupReasons()[0], referenceWakeupUnknown);
 
     // wakeupReason2 two empty wakeup reasons.
     lseek(wakeupReasonsWriteFd, 0, SEEK_SET);
     ASSERT_TRUE(WriteStringToFd(wakeupReason2, wakeupReasonsWriteFd));
-    checkLoop(3);
-    ASSERT_EQ(impl.mWakeupReasons.size(), 1);
-    ASSERT_EQ(impl.mWakeupReasons[0], referenceWakeupUnknown);
+    checkLoopAndWait();
+    ASSERT_EQ(impl.getWakeupReasons().size(), 1);
+    ASSERT_EQ(impl.getWakeupReasons()[0], referenceWakeupUnknown);
 
     // wakeupReason3 single wakeup reasons.
     lseek(wakeupReasonsWriteFd, 0, SEEK_SET);
     ASSERT_TRUE(WriteStringToFd(wakeupReason3, wakeupReasonsWriteFd));
-    checkLoop(3);
-    ASSERT_EQ(impl.mWakeupReasons.size(), 1);
-    ASSERT_EQ(impl.mWakeupReasons[0], referenceWakeupReason3);
+    checkLoopAndWait();
+    ASSERT_EQ(impl.getWakeupReasons().size(), 1);
+    ASSERT_EQ(impl.getWakeupReasons()[0], referenceWakeupReason3);
 
     // wakeupReason4 two wakeup reasons with one empty.
     lseek(wakeupReasonsWriteFd, 0, SEEK_SET);
     ASSERT_TRUE(WriteStringToFd(wakeupReason4, wakeupReasonsWriteFd));
-    checkLoop(3);
-    ASSERT_EQ(impl.mWakeupReasons.size(), 1);
-    ASSERT_EQ(impl.mWakeupReasons[0], referenceWakeupReason4);
+    checkLoopAndWait();
+    ASSERT_EQ(impl.getWakeupReasons().size(), 1);
+    ASSERT_EQ(impl.getWakeupReasons()[0], referenceWakeupReason4);
 
     // wakeupReason5 two wakeup reasons.
     lseek(wakeupReasonsWriteFd, 0, SEEK_SET);
     ASSERT_TRUE(WriteStringToFd(wakeupReason5, wakeupReasonsWriteFd));
-    checkLoop(3);
-    ASSERT_EQ(impl.mWakeupReasons.size(), 2);
+    checkLoopAndWait();
+    ASSERT_EQ(impl.getWakeupReasons().size(), 2);
     i = 0;
-    for (auto wakeupReason : impl.mWakeupReasons) {
+    for (auto wakeupReason : impl.getWakeupReasons()) {
         ASSERT_EQ(wakeupReason, referenceWakeupReason5[i++]);
     }
     cb->disable();
@@ -730,7 +795,30 @@ class MockWakelockCallback : public BnWakelockCallback {
 
    private:
     MockWakelockCallbackImpl* mImpl;
-    bool mDisabled;
+    std::atomic<bool> mDisabled;
+};
+
+// Wakelock callbacks are notified in order from a single thread, so once a wakelock callback has
+// been notified of a release, the callbacks of every earlier wakelock event have been called.
+class WakelockBarrierCb : public BnWakelockCallback {
+   public:
+    binder::Status notifyAcquired(void) { return binder::Status::ok(); }
+    binder::Status notifyReleased(void) {
+        auto l = std::lock_guard(mLock);
+        mReleased = true;
+        mCondVar.notify_all();
+        return binder::Status::ok();
+    }
+
+    bool waitForRelease() {
+        auto l = std::unique_lock(mLock);
+        return mCondVar.wait_for(l, 5s, [this] { return mReleased; });
+    }
+
+   private:
+    std::mutex mLock;
+    std::condition_variable mCondVar;
+    bool mReleased = false;
 };
 
 // Tests that nullptr can't be registered as wakelock callbacks.
@@ -856,6 +944,12 @@ TEST_F(SystemSuspendTest, CallbackNotifyWakelock) {
     checkWakelockLoop(4, "testLock1");
     checkWakelockLoop(3, "testLock2");
 
+    sp<WakelockBarrierCb> barrier = new WakelockBarrierCb();
+    controlService->registerWakelockCallback(barrier, "testLockBarrier", &retval);
+    ASSERT_TRUE(retval);
+    checkWakelockLoop(1, "testLockBarrier");
+    ASSERT_TRUE(barrier->waitForRelease());
+
     cb1->disable();
     cb2->disable();
 }
@@ -1088,6 +1182,8 @@ class SystemSuspendSameThreadTest : public ::testing::Test {
         .shortSuspendThreshold = 100ms,
         .failedSuspendBackoffEnabled = true,
         .shortSuspendBackoffEnabled = true,
+        .eventDrivenAutosuspendEnabled = false,
+        .backoffPolicy = SuspendBackoffPolicyType::EXPONENTIAL,
     };
 };
 
@@ -1137,6 +1233,33 @@ TEST_F(SystemSuspendSameThreadTest, GetNativeWakeLockStats) {
     ASSERT_EQ(nwlInfo.wakeupCount, 0);
 }
 
+// Test that getWakeLockStats has correct information about batched Native WakeLocks.
+TEST_F(SystemSuspendSameThreadTest, GetBatchedNativeWakeLockStats) {
+    std::string fakeWlName = "FakeLock";
+    {
+        std::shared_ptr<IWakeLock> fakeLock = nullptr;
+        ASSERT_TRUE(
+            suspendService->acquireWakeLocks(WakeLockType::PARTIAL, {fakeWlName}, &fakeLock)
+                .isOk());
+        std::vector<WakeLockInfo> wlStats = getWakelockStats();
+        ASSERT_EQ(wlStats.size(), 1);
+
+        WakeLockInfo nwlInfo;
+        ASSERT_TRUE(findWakeLockInfoByName(wlStats, fakeWlName, &nwlInfo));
+        ASSERT_EQ(nwlInfo.activeCount, 1);
+        ASSERT_EQ(nwlInfo.isActive, true);
+        ASSERT_EQ(nwlInfo.pid, getpid());
+    }
+    std::vector<WakeLockInfo> wlStats = getWakelockStats();
+    ASSERT_EQ(wlStats.size(), 1);
+
+    WakeLockInfo nwlInfo;
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, fakeWlName, &nwlInfo));
+    ASSERT_EQ(nwlInfo.activeCount, 1);
+    ASSERT_EQ(nwlInfo.isActive, false);
+    ASSERT_EQ(nwlInfo.activeTime, 0);  // No longer active
+}
+
 // Test that getWakeLockStats has correct information about Kernel WakeLocks.
 TEST_F(SystemSuspendSameThreadTest, GetKernelWakeLockStats) {
     std::string fakeKwlName1 = "fakeKwl1";
@@ -1185,6 +1308,34 @@ TEST_F(SystemSuspendSameThreadTest, GetKernelWakeLockStats) {
     ASSERT_EQ(kwlInfo2.wakeupCount, 42);
 }
 
+// Test that kernel wakelock stats follow wakeup sources being added and removed between queries.
+TEST_F(SystemSuspendSameThreadTest, KernelWakeLockStatsTrackWakeupSources) {
+    WakeLockInfo kwlInfo;
+
+    ASSERT_TRUE(addKernelWakelock("fakeKwl1", 10 /* activeCount */));
+    std::vector<WakeLockInfo> wlStats = getWakelockStats();
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "fakeKwl1", &kwlInfo));
+    ASSERT_EQ(kwlInfo.activeCount, 10);
+
+    ASSERT_TRUE(addKernelWakelock("fakeKwl2", 20 /* activeCount */));
+    wlStats = getWakelockStats();
+    ASSERT_EQ(wlStats.size(), 2);
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "fakeKwl1", &kwlInfo));
+    ASSERT_EQ(kwlInfo.activeCount, 10);
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "fakeKwl2", &kwlInfo));
+    ASSERT_EQ(kwlInfo.activeCount, 20);
+
+    ASSERT_TRUE(clearDirectory(kernelWakelockStatsDir.path));
+    ASSERT_TRUE(addKernelWakelock("fakeKwl3", 30 /* activeCount */));
+    wlStats = getWakelockStats();
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_FALSE(findWakeLockInfoByName(wlStats, "fakeKwl1", &kwlInfo));
+    ASSERT_FALSE(findWakeLockInfoByName(wlStats, "fakeKwl2", &kwlInfo));
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "fakeKwl3", &kwlInfo));
+    ASSERT_EQ(kwlInfo.activeCount, 30);
+}
+
 // Test that getWakeLockStats has correct information about Native AND Kernel WakeLocks.
 TEST_F(SystemSuspendSameThreadTest, GetNativeAndKernelWakeLockStats) {
     std::string fakeNwlName = "fakeNwl";
@@ -1319,6 +1470,46 @@ TEST_F(SystemSuspendSameThreadTest, GetSuspendStats) {
     ASSERT_EQ(stats.lastFailedStep, "fakeStep");
 }
 
+// Test that the shared stats region holds the native wake lock stats.
+TEST_F(SystemSuspendSameThreadTest, GetStatsMemory) {
+    std::shared_ptr<IWakeLock> fakeLock = acquireWakeLock("FakeLock");
+
+    android::os::ParcelFileDescriptor statsMemory;
+    ASSERT_TRUE(controlServiceInternal->getStatsMemory(&statsMemory).isOk());
+    auto reader = SuspendStatsRegionReader::create(statsMemory.release());
+    ASSERT_RESULT_OK(reader);
+
+    SuspendInfo suspendInfo;
+    std::vector<WakeLockInfo> wlStats;
+    ASSERT_TRUE((*reader)->read(&suspendInfo, &wlStats));
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_EQ(wlStats[0].name, "FakeLock");
+    ASSERT_EQ(wlStats[0].pid, getpid());
+    ASSERT_TRUE(wlStats[0].isActive);
+    ASSERT_EQ(suspendInfo.suspendAttemptCount, 0);
+}
+
+// Test that the shared stats region is republished in the background after wake lock updates.
+TEST_F(SystemSuspendSameThreadTest, StatsMemoryPublishedAfterRelease) {
+    std::shared_ptr<IWakeLock> fakeLock = acquireWakeLock("FakeLock");
+
+    android::os::ParcelFileDescriptor statsMemory;
+    ASSERT_TRUE(controlServiceInternal->getStatsMemory(&statsMemory).isOk());
+    auto reader = SuspendStatsRegionReader::create(statsMemory.release());
+    ASSERT_RESULT_OK(reader);
+    fakeLock->release();
+
+    SuspendInfo suspendInfo;
+    std::vector<WakeLockInfo> wlStats;
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    do {
+        std::this_thread::sleep_for(100ms);
+        ASSERT_TRUE((*reader)->read(&suspendInfo, &wlStats));
+        ASSERT_EQ(wlStats.size(), 1);
+    } while (wlStats[0].isActive && std::chrono::steady_clock::now() < deadline);
+    ASSERT_FALSE(wlStats[0].isActive);
+}
+
 class SuspendWakeupTest : public ::testing::Test {
    public:
     virtual void SetUp() override {
@@ -1339,7 +1530,8 @@ class SuspendWakeupTest : public ::testing::Test {
             std::move(wakeupCountServiceFd), std::move(stateServiceFd),
             unique_fd(-1) /* suspendStatsFd */, 100 /* maxStatsEntries */,
             unique_fd(-1) /* kernelWakelockStatsFd */, std::move(wakeupReasonsFd),
-            std::move(suspendTimeFd), kSleepTimeConfig, suspendControl, suspendControlInternal);
+            std::move(suspendTimeFd), getSleepTimeConfig(), suspendControl,
+            suspendControlInternal);
 
         // Start auto-suspend.
         bool enabled = false;
@@ -1349,6 +1541,8 @@ class SuspendWakeupTest : public ::testing::Test {
 
     virtual void TearDown() override { systemSuspend->disableAutosuspend(); }
 
+    virtual SleepTimeConfig getSleepTimeConfig() const { return kSleepTimeConfig; }
+
     std::shared_ptr<IWakeLock> acquireWakeLock(const std::string& name = "TestLock") {
         auto suspendService = ndk::SharedRefBase::make<SystemSuspendAidl>(systemSuspend.get());
         std::shared_ptr<IWakeLock> wl = nullptr;
@@ -1428,6 +1622,8 @@ class SuspendWakeupTest : public ::testing::Test {
         .shortSuspendThreshold = 100ms,
         .failedSuspendBackoffEnabled = true,
         .shortSuspendBackoffEnabled = true,
+        .eventDrivenAutosuspendEnabled = false,
+        .backoffPolicy = SuspendBackoffPolicyType::EXPONENTIAL,
     };
 
     const int64_t kLongSuspendMillis = 10000;  // >= kSleepTimeConfig.shortSuspendThreshold
@@ -1501,6 +1697,138 @@ TEST_F(SuspendWakeupTest, ShortSuspendBackoffContinueStat) {
     checkSuspendInfo(expected);
 }
 
+TEST_F(SuspendWakeupTest, BackoffDecisionStat) {
+    suspendFor(std::chrono::milliseconds(kShortSuspendMillis),
+               std::chrono::milliseconds(kSuspendOverheadMillis), 2);
+    SuspendInfo info;
+    systemSuspend->getSuspendInfo(&info);
+    ASSERT_EQ(info.backoffPolicy, "exponential");
+    ASSERT_EQ(info.nextSleepTimeMillis,
+              std::chrono::round<std::chrono::milliseconds>(kSleepTimeConfig.baseSleepTime *
+                                                            kSleepTimeConfig.sleepTimeScaleFactor)
+                  .count());
+    ASSERT_EQ(info.sleepTimeIncreaseCount, 1);
+    ASSERT_EQ(info.sleepTimeDecreaseCount, 0);
+
+    suspendFor(std::chrono::milliseconds(kLongSuspendMillis),
+               std::chrono::milliseconds(kSuspendOverheadMillis), 1);
+    systemSuspend->getSuspendInfo(&info);
+    ASSERT_EQ(info.nextSleepTimeMillis, kSleepTimeConfig.baseSleepTime.count());
+    ASSERT_EQ(info.sleepTimeIncreaseCount, 1);
+    ASSERT_EQ(info.sleepTimeDecreaseCount, 1);
+}
+
+TEST_F(SuspendWakeupTest, SetSleepTimeConfig) {
+    SleepTimeConfigInfo config;
+    ASSERT_TRUE(suspendControlInternal->getSleepTimeConfig(&config).isOk());
+    ASSERT_EQ(config.baseSleepTimeMillis, kSleepTimeConfig.baseSleepTime.count());
+    ASSERT_EQ(config.maxSleepTimeMillis, kSleepTimeConfig.maxSleepTime.count());
+    ASSERT_EQ(config.backoffPolicy, "exponential");
+
+    int64_t generation = 0;
+    SleepTimeConfigInfo invalid = config;
+    invalid.maxSleepTimeMillis = config.baseSleepTimeMillis - 1;
+    binder::Status status = suspendControlInternal->setSleepTimeConfig(invalid, &generation);
+    ASSERT_EQ(status.exceptionCode(), binder::Status::Exception::EX_ILLEGAL_ARGUMENT);
+    invalid = config;
+    invalid.backoffPolicy = "linear";
+    status = suspendControlInternal->setSleepTimeConfig(invalid, &generation);
+    ASSERT_EQ(status.exceptionCode(), binder::Status::Exception::EX_ILLEGAL_ARGUMENT);
+    invalid = config;
+    invalid.backoffThreshold = -1;
+    status = suspendControlInternal->setSleepTimeConfig(invalid, &generation);
+    ASSERT_EQ(status.exceptionCode(), binder::Status::Exception::EX_ILLEGAL_ARGUMENT);
+
+    SuspendInfo info;
+    systemSuspend->getSuspendInfo(&info);
+    ASSERT_EQ(info.sleepTimeConfigGeneration, 0);
+
+    // The new scale factor applies to the next backoff.
+    config.sleepTimeScaleFactor = 3.0;
+    ASSERT_TRUE(suspendControlInternal->setSleepTimeConfig(config, &generation).isOk());
+    ASSERT_EQ(generation, 1);
+    suspendFor(std::chrono::milliseconds(kShortSuspendMillis),
+               std::chrono::milliseconds(kSuspendOverheadMillis), 2);
+    systemSuspend->getSuspendInfo(&info);
+    ASSERT_EQ(info.sleepTimeConfigGeneration, 1);
+    ASSERT_EQ(info.nextSleepTimeMillis, config.baseSleepTimeMillis * 3);
+
+    config.backoffPolicy = "adaptive";
+    ASSERT_TRUE(suspendControlInternal->setSleepTimeConfig(config, &generation).isOk());
+    ASSERT_EQ(generation, 2);
+    systemSuspend->getSuspendInfo(&info);
+    ASSERT_EQ(info.sleepTimeConfigGeneration, 2);
+    ASSERT_EQ(info.backoffPolicy, "adaptive");
+
+    SleepTimeConfigInfo actual;
+    ASSERT_TRUE(suspendControlInternal->getSleepTimeConfig(&actual).isOk());
+    ASSERT_EQ(actual.sleepTimeScaleFactor, 3.0);
+    ASSERT_EQ(actual.backoffPolicy, "adaptive");
+}
+
+// Tests that a new sleep time config applies to a wait between suspend attempts under way.
+TEST_F(SuspendWakeupTest, SetSleepTimeConfigDuringWait) {
+    SleepTimeConfigInfo config;
+    ASSERT_TRUE(suspendControlInternal->getSleepTimeConfig(&config).isOk());
+    SleepTimeConfigInfo longWait = config;
+    longWait.baseSleepTimeMillis = 30000;
+    longWait.maxSleepTimeMillis = 30000;
+    int64_t generation = 0;
+    ASSERT_TRUE(suspendControlInternal->setSleepTimeConfig(longWait, &generation).isOk());
+
+    // The suspend loop now waits the long base sleep time before the next suspend attempt.
+    suspendFor(std::chrono::milliseconds(kLongSuspendMillis),
+               std::chrono::milliseconds(kSuspendOverheadMillis), 1);
+    ASSERT_TRUE(suspendControlInternal->setSleepTimeConfig(config, &generation).isOk());
+
+    auto start = std::chrono::steady_clock::now();
+    checkLoop(1);
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+}
+
+class EventDrivenSuspendWakeupTest : public SuspendWakeupTest {
+   public:
+    SleepTimeConfig getSleepTimeConfig() const override {
+        SleepTimeConfig config = kSleepTimeConfig;
+        config.eventDrivenAutosuspendEnabled = true;
+        return config;
+    }
+};
+
+// Tests that the suspend loop does not wait between suspend attempts if there is no backoff.
+TEST_F(EventDrivenSuspendWakeupTest, LongSuspendStat) {
+    suspendFor(std::chrono::milliseconds(kLongSuspendMillis),
+               std::chrono::milliseconds(kSuspendOverheadMillis), 2);
+    SuspendInfo expected;
+    expected.suspendAttemptCount = 2;
+    expected.suspendTimeMillis = kLongSuspendMillis * 2;
+    expected.suspendOverheadTimeMillis = kSuspendOverheadMillis * 2;
+    expected.sleepTimeMillis = 0;
+    checkSuspendInfo(expected);
+}
+
+// Tests that the suspend loop still backs off after bad suspends.
+TEST_F(EventDrivenSuspendWakeupTest, ShortSuspendBackoffContinueStat) {
+    suspendFor(std::chrono::milliseconds(kShortSuspendMillis),
+               std::chrono::milliseconds(kSuspendOverheadMillis), 3);
+    SuspendInfo expected;
+    expected.suspendAttemptCount = 3;
+    expected.shortSuspendCount = 3;
+    expected.shortSuspendTimeMillis = kShortSuspendMillis * 3;
+    expected.suspendTimeMillis = kShortSuspendMillis * 3;
+    expected.suspendOverheadTimeMillis = kSuspendOverheadMillis * 3;
+    expected.newBackoffCount = 1;
+    expected.backoffContinueCount = 1;
+    // No sleep before the first attempt, base sleep time after the first short suspend and scaled
+    // sleep time once the backoff threshold is crossed.
+    expected.sleepTimeMillis =
+        kSleepTimeConfig.baseSleepTime.count() +
+        std::chrono::round<std::chrono::milliseconds>(kSleepTimeConfig.baseSleepTime *
+                                                      kSleepTimeConfig.sleepTimeScaleFactor)
+            .count();
+    checkSuspendInfo(expected);
+}
+
 TEST_F(SuspendWakeupTest, GetSingleWakeupReasonStat) {
     wakeup("abc");
 
@@ -1542,6 +1870,67 @@ TEST_F(SuspendWakeupTest, GetMultipleWakeupReasonStats) {
     ASSERT_EQ(wStats[3].count, 1);
 }
 
+TEST_F(SuspendWakeupTest, GetWakeupComponentStats) {
+    ASSERT_TRUE(WriteStringToFile("0.001 2.000000", suspendTimeFile.path));
+    wakeup("100 :android,wakeup-reason-1");
+    wakeup("100 :android,wakeup-reason-1\nAbort: android,wakeup-reason-2\n");
+    wakeup("abc");
+
+    std::vector<WakeupComponentInfo> components;
+    ASSERT_TRUE(suspendControlInternal->getWakeupComponentStats(&components).isOk());
+    ASSERT_EQ(components.size(), 3);
+
+    // The most frequent component comes first.
+    ASSERT_EQ(components[0].type, WakeupComponentInfo::TYPE_IRQ);
+    ASSERT_EQ(components[0].irq, 100);
+    ASSERT_EQ(components[0].name, ":android,wakeup-reason-1");
+    ASSERT_EQ(components[0].count, 2);
+    ASSERT_EQ(components[0].chainedCount, 1);
+    ASSERT_EQ(components[0].lastSuspendTimeMillis, 2000);
+    ASSERT_EQ(components[0].totalSuspendTimeMillis, 4000);
+
+    auto abort = std::find_if(components.begin(), components.end(), [](const auto& c) {
+        return c.type == WakeupComponentInfo::TYPE_ABORT;
+    });
+    ASSERT_NE(abort, components.end());
+    ASSERT_EQ(abort->irq, -1);
+    ASSERT_EQ(abort->name, "android,wakeup-reason-2");
+    ASSERT_EQ(abort->count, 1);
+    ASSERT_EQ(abort->chainedCount, 1);
+
+    auto other = std::find_if(components.begin(), components.end(), [](const auto& c) {
+        return c.type == WakeupComponentInfo::TYPE_OTHER;
+    });
+    ASSERT_NE(other, components.end());
+    ASSERT_EQ(other->name, "abc");
+    ASSERT_EQ(other->count, 1);
+    ASSERT_EQ(other->chainedCount, 0);
+    ASSERT_GE(other->lastSeenMillis, components[0].lastSeenMillis);
+}
+
+TEST_F(SuspendWakeupTest, GetSuspendPhaseStats) {
+    checkLoop(2);
+
+    std::vector<SuspendPhaseInfo> phases;
+    ASSERT_TRUE(suspendControlInternal->getSuspendPhaseStats(&phases).isOk());
+    ASSERT_EQ(phases.size(), static_cast<size_t>(SuspendPhaseInfo::NUM_PHASES));
+
+    for (int32_t i = 0; i < SuspendPhaseInfo::NUM_PHASES; i++) {
+        const SuspendPhaseInfo& phase = phases[i];
+        ASSERT_EQ(phase.phase, i);
+        ASSERT_EQ(phase.name, AutosuspendPhaseStats::phaseName(i));
+        ASSERT_LE(phase.p50Micros, phase.p90Micros);
+        ASSERT_LE(phase.p90Micros, phase.p99Micros);
+        ASSERT_LE(phase.p99Micros, phase.maxMicros);
+        ASSERT_LE(phase.maxMicros, phase.totalMicros);
+        // The loop is blocked reading /sys/power/wakeup_count of its third iteration. The backoff
+        // wait depends on the sleep time config.
+        if (i != SuspendPhaseInfo::PHASE_BACKOFF_WAIT) {
+            ASSERT_EQ(phase.count, 2) << phase.name;
+        }
+    }
+}
+
 TEST(WakeupListTest, TestEmpty) {
     WakeupList wakeupList(3);
 
@@ -1648,6 +2037,1009 @@ TEST(WakeupListTest, TestLRUEvict) {
     ASSERT_EQ(wakeups[2].count, 2);
 }
 
+TEST(WakeupListTest, TestParsedReasons) {
+    WakeupList wakeupList(3);
+    WakeupReasons reasons;
+
+    reasons.parse(" 100 :a\n\nAbort: b\n");
+    wakeupList.update(reasons);
+    wakeupList.update({"100 :a", "Abort: b"});
+    // A single reason that reads like the joined reasons is recorded as the same wakeup.
+    reasons.parse("100 :a;Abort: b");
+    wakeupList.update(reasons);
+    reasons.parse("100 :a");
+    wakeupList.update(reasons);
+
+    std::vector<WakeupInfo> wakeups;
+    wakeupList.getWakeupStats(&wakeups);
+
+    ASSERT_EQ(wakeups.size(), 2);
+    ASSERT_EQ(wakeups[0].name, "100 :a");
+    ASSERT_EQ(wakeups[0].count, 1);
+    ASSERT_EQ(wakeups[1].name, "100 :a;Abort: b");
+    ASSERT_EQ(wakeups[1].count, 3);
+}
+
+TEST(WakeupReasonsTest, TestParse) {
+    WakeupReasons reasons;
+
+    reasons.parse(" \n\t\n");
+    ASSERT_TRUE(reasons.get().empty());
+
+    reasons.parse("999 :android,wakeup-reason-3\n  Abort: android,wakeup-reason-3 \n\n");
+    ASSERT_EQ(reasons.get(), std::vector<std::string_view>({"999 :android,wakeup-reason-3",
+                                                            "Abort: android,wakeup-reason-3"}));
+    ASSERT_EQ(reasons.join(), "999 :android,wakeup-reason-3;Abort: android,wakeup-reason-3");
+    ASSERT_TRUE(reasons.equalsJoined(reasons.join()));
+    ASSERT_FALSE(reasons.equalsJoined("999 :android,wakeup-reason-3"));
+
+    WakeupReasons sameReasons;
+    sameReasons.parse("999 :android,wakeup-reason-3\nAbort: android,wakeup-reason-3");
+    ASSERT_EQ(reasons.hash(), sameReasons.hash());
+}
+
+TEST(WakeupReasonsTest, TestRead) {
+    TemporaryFile file;
+    // Longer than the initial read buffer.
+    std::string longReason(10000, 'x');
+    ASSERT_TRUE(WriteStringToFile("100 :a\n" + longReason + "\n", file.path));
+    unique_fd fd(TEMP_FAILURE_RETRY(open(file.path, O_CLOEXEC | O_RDONLY)));
+
+    WakeupReasons reasons;
+    // Reads from the start of the file every time.
+    for (int i = 0; i < 2; i++) {
+        ASSERT_TRUE(reasons.read(fd));
+        ASSERT_EQ(reasons.get(), std::vector<std::string_view>({"100 :a", longReason}));
+    }
+
+    ASSERT_FALSE(reasons.read(-1));
+    ASSERT_TRUE(reasons.get().empty());
+}
+
+TEST(WakeupReasonIndexTest, TestParseComponent) {
+    int32_t type, irq;
+    std::string_view name;
+
+    WakeupReasonIndex::parseComponent("170 qcom,glink", &type, &irq, &name);
+    ASSERT_EQ(type, WakeupComponentInfo::TYPE_IRQ);
+    ASSERT_EQ(irq, 170);
+    ASSERT_EQ(name, "qcom,glink");
+
+    WakeupReasonIndex::parseComponent("Abort: Last active Wakeup Source: a", &type, &irq, &name);
+    ASSERT_EQ(type, WakeupComponentInfo::TYPE_ABORT);
+    ASSERT_EQ(irq, -1);
+    ASSERT_EQ(name, "Last active Wakeup Source: a");
+
+    for (std::string_view line : {"170", "-1 qcom,glink", "170qcom", "unknown"}) {
+        WakeupReasonIndex::parseComponent(line, &type, &irq, &name);
+        ASSERT_EQ(type, WakeupComponentInfo::TYPE_OTHER) << line;
+        ASSERT_EQ(irq, -1);
+        ASSERT_EQ(name, line);
+    }
+}
+
+TEST(WakeupReasonIndexTest, TestCapacity) {
+    WakeupReasonIndex index(2);
+    WakeupReasons reasons;
+
+    reasons.parse("1 a");
+    index.update(reasons, 10ms, 1);
+    reasons.parse("2 b");
+    index.update(reasons, 20ms, 2);
+    reasons.parse("1 a");
+    index.update(reasons, 30ms, 3);
+    // Evicts "2 b", which was seen least recently.
+    reasons.parse("3 c");
+    index.update(reasons, 40ms, 4);
+
+    std::vector<WakeupComponentInfo> components;
+    index.getComponentStats(&components);
+
+    ASSERT_EQ(components.size(), 2);
+    ASSERT_EQ(components[0].irq, 1);
+    ASSERT_EQ(components[0].count, 2);
+    ASSERT_EQ(components[0].lastSeenMillis, 3);
+    ASSERT_EQ(components[0].lastSuspendTimeMillis, 30);
+    ASSERT_EQ(components[0].totalSuspendTimeMillis, 40);
+    ASSERT_EQ(components[1].irq, 3);
+    ASSERT_EQ(components[1].count, 1);
+}
+
+TEST(WakeLockNameTest, TestInterning) {
+    WakeLockName a1("WakeLockNameTest_a");
+    WakeLockName a2("WakeLockNameTest_a");
+    WakeLockName b("WakeLockNameTest_b");
+
+    ASSERT_EQ(a1, a2);
+    ASSERT_EQ(a1.id(), a2.id());
+    ASSERT_EQ(&a1.str(), &a2.str());
+    ASSERT_NE(a1, b);
+    ASSERT_NE(a1.id(), b.id());
+    ASSERT_EQ(a1.str(), "WakeLockNameTest_a");
+    ASSERT_EQ(b.str(), "WakeLockNameTest_b");
+}
+
+TEST(WakeLockNameTest, TestRelease) {
+    WakeLockNameTable& table = WakeLockNameTable::getInstance();
+    size_t size = table.size();
+    {
+        WakeLockName name("WakeLockNameTest_release");
+        ASSERT_EQ(table.size(), size + 1);
+        {
+            WakeLockName copy = name;
+            WakeLockName moved = std::move(copy);
+            ASSERT_EQ(moved, name);
+        }
+        ASSERT_EQ(table.size(), size + 1);
+    }
+    ASSERT_EQ(table.size(), size);
+}
+
+TEST(WakeLockNameTest, TestWatchers) {
+    WakeLockName name("WakeLockNameTest_watchers");
+    ASSERT_FALSE(name.hasWatchers());
+    {
+        WakeLockName watched("WakeLockNameTest_watchers");
+        watched.addWatcher();
+        watched.addWatcher();
+        watched.removeWatcher();
+    }
+    // Watchers are tracked per name, not per handle.
+    ASSERT_TRUE(name.hasWatchers());
+    name.removeWatcher();
+    ASSERT_FALSE(name.hasWatchers());
+}
+
+TEST(WakeLockNamePatternTest, TestMatches) {
+    ASSERT_FALSE(WakeLockNamePattern::isPattern("NetworkStats"));
+    ASSERT_TRUE(WakeLockNamePattern::isPattern("NetworkStats.*"));
+    ASSERT_TRUE(WakeLockNamePattern::isPattern("wl?"));
+
+    WakeLockNamePattern prefix("NetworkStats.*");
+    ASSERT_TRUE(prefix.matches("NetworkStats."));
+    ASSERT_TRUE(prefix.matches("NetworkStats.poll"));
+    ASSERT_FALSE(prefix.matches("NetworkStats"));
+    ASSERT_FALSE(prefix.matches("xNetworkStats.poll"));
+
+    WakeLockNamePattern infix("*AudioMix*");
+    ASSERT_TRUE(infix.matches("AudioMix"));
+    ASSERT_TRUE(infix.matches("hal_AudioMix_out"));
+    ASSERT_FALSE(infix.matches("AudioMi"));
+
+    WakeLockNamePattern glob("a?c*c");
+    ASSERT_TRUE(glob.matches("abcc"));
+    ASSERT_TRUE(glob.matches("axc_xyz_c"));
+    ASSERT_FALSE(glob.matches("abc"));
+    ASSERT_FALSE(glob.matches("abcd"));
+}
+
+TEST(WakelockPatternCallbackTest, TestPatternCallbacks) {
+    sp<SuspendControlService> controlService = new SuspendControlService();
+    MockWakelockCallbackImpl impl;
+    sp<MockWakelockCallback> cb = new MockWakelockCallback(&impl);
+    ASSERT_TRUE(controlService->registerWakelockPatternCallback(cb, "PatternTest.*"));
+    ASSERT_FALSE(controlService->registerWakelockPatternCallback(cb, "PatternTest.*"));
+    // registerWakelockCallback() takes names literally, even if they look like patterns.
+    MockWakelockCallbackImpl exactImpl;
+    sp<MockWakelockCallback> exactCb = new MockWakelockCallback(&exactImpl);
+    bool retval = false;
+    controlService->registerWakelockCallback(exactCb, "PatternTest.*", &retval);
+    ASSERT_TRUE(retval);
+    sp<WakelockBarrierCb> barrier = new WakelockBarrierCb();
+    controlService->registerWakelockCallback(barrier, "PatternTestBarrier", &retval);
+    ASSERT_TRUE(retval);
+
+    EXPECT_CALL(impl, notifyAcquired).Times(4);
+    EXPECT_CALL(impl, notifyReleased).Times(1);
+    EXPECT_CALL(exactImpl, notifyAcquired).Times(1);
+
+    WakeLockName wl1("PatternTest.wl1");
+    WakeLockName wl2("PatternTest.wl2");
+    WakeLockName other("PatternTestOther");
+    // Matching wl1 again uses the result cached in the name.
+    controlService->notifyWakelock(wl1, true);
+    controlService->notifyWakelock(wl1, false);
+    controlService->notifyWakelock(wl1, true);
+    controlService->notifyWakelock(other, true);
+    controlService->notifyWakelock(wl2, true);
+    controlService->notifyWakelock(WakeLockName("PatternTest.*"), true);
+    controlService->notifyWakelock(WakeLockName("PatternTestBarrier"), false);
+    ASSERT_TRUE(barrier->waitForRelease());
+
+    cb->disable();
+    exactCb->disable();
+}
+
+TEST(WakeLockNameTest, TestConcurrentInterning) {
+    WakeLockNameTable& table = WakeLockNameTable::getInstance();
+    size_t size = table.size();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([] {
+            for (int i = 0; i < 1000; i++) {
+                WakeLockName name("WakeLockNameTest_" + std::to_string(i % 10));
+                WakeLockName copy = name;
+                ASSERT_EQ(copy.str(), "WakeLockNameTest_" + std::to_string(i % 10));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(table.size(), size);
+}
+
+TEST(AutosuspendPhaseStatsTest, TestScopedPhase) {
+    AutosuspendPhaseStats stats;
+    {
+        ScopedAutosuspendPhase phase(&stats, SuspendPhaseInfo::PHASE_STATE_WRITE);
+        std::this_thread::sleep_for(2ms);
+        phase.end();
+        phase.end();
+    }
+    { ScopedAutosuspendPhase phase(&stats, SuspendPhaseInfo::PHASE_STATE_WRITE); }
+    // Unknown phases are not recorded.
+    { ScopedAutosuspendPhase phase(&stats, SuspendPhaseInfo::NUM_PHASES); }
+    ASSERT_EQ(AutosuspendPhaseStats::phaseName(SuspendPhaseInfo::NUM_PHASES), nullptr);
+
+    std::vector<SuspendPhaseInfo> phases;
+    stats.getPhaseStats(&phases);
+    ASSERT_EQ(phases.size(), static_cast<size_t>(SuspendPhaseInfo::NUM_PHASES));
+    for (const SuspendPhaseInfo& phase : phases) {
+        if (phase.phase == SuspendPhaseInfo::PHASE_STATE_WRITE) {
+            ASSERT_EQ(phase.count, 2);
+            ASSERT_GE(phase.maxMicros, 2000);
+            ASSERT_GE(phase.totalMicros, phase.maxMicros);
+        } else {
+            ASSERT_EQ(phase.count, 0);
+            ASSERT_EQ(phase.totalMicros, 0);
+        }
+    }
+}
+
+TEST(DurationHistogramTest, TestSize) {
+    ASSERT_EQ(DurationHistogram::precisionForSize(0), 0);
+    ASSERT_EQ(DurationHistogram::precisionForSize(512), 3);
+    ASSERT_LE(DurationHistogram::sizeForPrecision(3), 512);
+    ASSERT_GT(DurationHistogram::sizeForPrecision(4), 512);
+
+    DurationHistogram disabled(0);
+    disabled.record(10);
+    ASSERT_EQ(disabled.count(), 0);
+    ASSERT_EQ(disabled.percentile(50), 0);
+}
+
+TEST(DurationHistogramTest, TestPercentiles) {
+    DurationHistogram histogram(4);
+    ASSERT_EQ(histogram.percentile(50), 0);
+
+    // Exact below 2^4 ms.
+    for (int64_t millis = 1; millis <= 10; millis++) {
+        histogram.record(millis);
+    }
+    ASSERT_EQ(histogram.count(), 10);
+    ASSERT_EQ(histogram.percentile(50), 5);
+    ASSERT_EQ(histogram.percentile(100), 10);
+
+    // Within 1/8 above that, but never above the longest duration.
+    for (int i = 0; i < 90; i++) {
+        histogram.record(1000);
+    }
+    ASSERT_GE(histogram.percentile(50), 1000);
+    ASSERT_LE(histogram.percentile(50), 1000 + 1000 / 8);
+    ASSERT_EQ(histogram.percentile(99), 1000);
+    ASSERT_EQ(histogram.max(), 1000);
+
+    histogram.record(int64_t{1} << 40);
+    ASSERT_EQ(histogram.max(), int64_t{1} << 40);
+    ASSERT_GE(histogram.percentile(100), (int64_t{1} << 32) - (int64_t{1} << 29));
+}
+
+TEST(DurationHistogramTest, TestMerge) {
+    DurationHistogram a(5);
+    DurationHistogram b(5);
+    for (int64_t i = 1; i <= 50; i++) {
+        a.record(i);
+        b.record(i + 50);
+    }
+    a.merge(b);
+    ASSERT_EQ(a.count(), 100);
+    ASSERT_EQ(a.max(), 100);
+    ASSERT_EQ(a.percentile(50), 50);
+
+    // Histograms of different precisions are not merged.
+    DurationHistogram c(4);
+    c.record(1000);
+    a.merge(c);
+    ASSERT_EQ(a.count(), 100);
+    ASSERT_EQ(a.max(), 100);
+}
+
+TEST(LegacyWakeLocksTest, TestRefCounting) {
+    unique_fd wakeLockTestFd, wakeLockFd, wakeUnlockTestFd, wakeUnlockFd;
+    ASSERT_TRUE(Socketpair(SOCK_STREAM, &wakeLockTestFd, &wakeLockFd));
+    ASSERT_TRUE(Socketpair(SOCK_STREAM, &wakeUnlockTestFd, &wakeUnlockFd));
+    LegacyWakeLocks wakeLocks(wakeLockFd, wakeUnlockFd);
+    WakeLockName a("a");
+    WakeLockName b("b");
+
+    wakeLocks.acquire(a);
+    ASSERT_EQ(readFd(wakeLockTestFd), "a");
+    wakeLocks.acquire(a);
+    wakeLocks.acquire(b);
+    ASSERT_EQ(readFd(wakeLockTestFd), "b");
+
+    wakeLocks.release(a);
+    ASSERT_TRUE(isReadBlocked(wakeUnlockTestFd));
+    wakeLocks.release(a);
+    ASSERT_EQ(readFd(wakeUnlockTestFd), "a");
+    wakeLocks.release(b);
+    ASSERT_EQ(readFd(wakeUnlockTestFd), "b");
+
+    // Releasing a name that is not held is not written.
+    wakeLocks.release(a);
+    ASSERT_TRUE(isReadBlocked(wakeUnlockTestFd));
+    ASSERT_TRUE(isReadBlocked(wakeLockTestFd));
+
+    ASSERT_EQ(wakeLocks.getWriteCount(), 4);
+    ASSERT_EQ(wakeLocks.getAvoidedWriteCount(), 2);
+}
+
+static constexpr SleepTimeConfig kBackoffPolicyTestConfig = {
+    .baseSleepTime = 100ms,
+    .maxSleepTime = 10000ms,
+    .sleepTimeScaleFactor = 2.0,
+    .backoffThreshold = 1,
+    .shortSuspendThreshold = 100ms,
+    .failedSuspendBackoffEnabled = true,
+    .shortSuspendBackoffEnabled = true,
+    .eventDrivenAutosuspendEnabled = false,
+    .backoffPolicy = SuspendBackoffPolicyType::EXPONENTIAL,
+};
+
+TEST(SuspendBackoffPolicyTest, TestParseType) {
+    SuspendBackoffPolicyType type = SuspendBackoffPolicyType::EXPONENTIAL;
+    ASSERT_TRUE(SuspendBackoffPolicy::parseType("adaptive", &type));
+    ASSERT_EQ(type, SuspendBackoffPolicyType::ADAPTIVE);
+    ASSERT_TRUE(SuspendBackoffPolicy::parseType("exponential", &type));
+    ASSERT_EQ(type, SuspendBackoffPolicyType::EXPONENTIAL);
+    ASSERT_FALSE(SuspendBackoffPolicy::parseType("linear", &type));
+    ASSERT_EQ(type, SuspendBackoffPolicyType::EXPONENTIAL);
+
+    ASSERT_STREQ(SuspendBackoffPolicy::create(SuspendBackoffPolicyType::ADAPTIVE)->name(),
+                 "adaptive");
+    ASSERT_STREQ(SuspendBackoffPolicy::create(SuspendBackoffPolicyType::EXPONENTIAL)->name(),
+                 "exponential");
+}
+
+TEST(SuspendBackoffPolicyTest, TestValidateConfig) {
+    SleepTimeConfig config = kBackoffPolicyTestConfig;
+    ASSERT_TRUE(validateSleepTimeConfig(config).ok());
+
+    config.baseSleepTime = -1ms;
+    ASSERT_FALSE(validateSleepTimeConfig(config).ok());
+    // A base sleep time of 0 would never grow when backing off.
+    config.baseSleepTime = 0ms;
+    ASSERT_FALSE(validateSleepTimeConfig(config).ok());
+    config = kBackoffPolicyTestConfig;
+    config.maxSleepTime = config.baseSleepTime - 1ms;
+    ASSERT_FALSE(validateSleepTimeConfig(config).ok());
+    config = kBackoffPolicyTestConfig;
+    config.maxSleepTime = 1h;
+    ASSERT_FALSE(validateSleepTimeConfig(config).ok());
+    config = kBackoffPolicyTestConfig;
+    config.sleepTimeScaleFactor = 0.5;
+    ASSERT_FALSE(validateSleepTimeConfig(config).ok());
+    config.sleepTimeScaleFactor = std::numeric_limits<double>::infinity();
+    ASSERT_FALSE(validateSleepTimeConfig(config).ok());
+    config = kBackoffPolicyTestConfig;
+    config.shortSuspendThreshold = -1ms;
+    ASSERT_FALSE(validateSleepTimeConfig(config).ok());
+}
+
+TEST(SuspendBackoffPolicyTest, TestExponential) {
+    const SleepTimeConfig& config = kBackoffPolicyTestConfig;
+    ExponentialBackoffPolicy policy;
+    SuspendAttempt good = {.success = true, .bad = false, .suspendTime = 10s};
+    SuspendAttempt bad = {.success = false, .bad = true};
+
+    ASSERT_EQ(policy.nextSleepTime(config, good, 800ms), config.baseSleepTime);
+    // No backoff below the threshold.
+    bad.numConsecutiveBadSuspends = 0;
+    ASSERT_EQ(policy.nextSleepTime(config, bad, config.baseSleepTime), config.baseSleepTime);
+    bad.numConsecutiveBadSuspends = 1;
+    ASSERT_EQ(policy.nextSleepTime(config, bad, config.baseSleepTime), 200ms);
+    bad.numConsecutiveBadSuspends = 2;
+    ASSERT_EQ(policy.nextSleepTime(config, bad, 200ms), 400ms);
+    ASSERT_EQ(policy.nextSleepTime(config, bad, 8000ms), config.maxSleepTime);
+}
+
+TEST(SuspendBackoffPolicyTest, TestAdaptive) {
+    const SleepTimeConfig& config = kBackoffPolicyTestConfig;
+    AdaptiveBackoffPolicy policy;
+    SuspendAttempt good = {.success = true, .bad = false, .suspendTime = 60s,
+                           .suspendOverhead = 200ms};
+    SuspendAttempt bad = {.success = false, .bad = true, .suspendOverhead = 200ms};
+
+    // Long suspends make the overhead negligible.
+    ASSERT_EQ(policy.nextSleepTime(config, good, config.baseSleepTime), config.baseSleepTime);
+    bad.numConsecutiveBadSuspends = 1;
+    ASSERT_EQ(policy.nextSleepTime(config, bad, config.baseSleepTime), config.baseSleepTime);
+
+    // Expensive failed attempts push the wait up to the maximum.
+    std::chrono::milliseconds sleepTime = config.baseSleepTime;
+    for (uint32_t i = 2; i < 50; i++) {
+        bad.numConsecutiveBadSuspends = i;
+        std::chrono::milliseconds next = policy.nextSleepTime(config, bad, sleepTime);
+        ASSERT_GE(next, sleepTime);
+        ASSERT_LE(next, config.maxSleepTime);
+        sleepTime = next;
+    }
+    ASSERT_GT(policy.getBadSuspendRate(), 0.9);
+    ASSERT_GT(sleepTime, 1000ms);
+    ASSERT_LT(sleepTime, config.maxSleepTime);
+
+    // Back to the base sleep time after a good suspend.
+    ASSERT_EQ(policy.nextSleepTime(config, good, sleepTime), config.baseSleepTime);
+}
+
+class ProfiledMutexTest : public ::testing::Test {
+   protected:
+    void TearDown() override { ProfiledMutex::setProfilingEnabled(false); }
+};
+
+TEST_F(ProfiledMutexTest, TestDisabled) {
+    ProfiledMutex mutex("test");
+    {
+        auto lock = std::lock_guard(mutex);
+    }
+    ASSERT_TRUE(mutex.try_lock());
+    // Enabling profiling while the mutex is held does not record a hold.
+    ProfiledMutex::setProfilingEnabled(true);
+    mutex.unlock();
+
+    LockStats stats;
+    mutex.addStats(&stats);
+    ASSERT_EQ(stats.acquireCount, 0);
+    ASSERT_EQ(stats.waitTimes.count(), 0);
+    ASSERT_EQ(stats.holdTimes.count(), 0);
+}
+
+TEST_F(ProfiledMutexTest, TestContention) {
+    ProfiledMutex::setProfilingEnabled(true);
+    ProfiledMutex mutex("test");
+
+    mutex.lock();
+    std::atomic<bool> waiting = false;
+    std::atomic<pid_t> waiterTid = 0;
+    std::thread waiter([&] {
+        waiterTid = gettid();
+        waiting = true;
+        auto lock = std::lock_guard(mutex);
+    });
+    while (!waiting) {
+    }
+    std::this_thread::sleep_for(20ms);
+    mutex.unlock();
+    waiter.join();
+    ASSERT_TRUE(mutex.try_lock());
+    mutex.unlock();
+
+    LockStats stats;
+    mutex.addStats(&stats);
+    ASSERT_EQ(stats.acquireCount, 3);
+    ASSERT_EQ(stats.contendedCount, 1);
+    ASSERT_EQ(stats.waitTimes.count(), 3);
+    ASSERT_EQ(stats.holdTimes.count(), 3);
+    ASSERT_GE(stats.holdTimes.max(), 20000);
+    ASSERT_GE(stats.waitTimes.max(), 10000);
+    ASSERT_EQ(stats.totalWaitMicros, stats.waitTimes.max());
+    ASSERT_GE(stats.totalHoldMicros, stats.holdTimes.max());
+
+    ASSERT_EQ(stats.topWaiters.size(), 1);
+    ASSERT_EQ(stats.topWaiters[0].tid, waiterTid);
+    ASSERT_EQ(stats.topWaiters[0].count, 1);
+    ASSERT_EQ(stats.topWaiters[0].totalWaitMicros, stats.totalWaitMicros);
+
+    // Stats of several mutexes add up.
+    mutex.addStats(&stats);
+    ASSERT_EQ(stats.acquireCount, 6);
+    ASSERT_EQ(stats.topWaiters.size(), 1);
+    ASSERT_EQ(stats.topWaiters[0].count, 2);
+}
+
+TEST(WakeLockEntryListTest, TestHoldTimeHistograms) {
+    WakeLockEntryList entryList(3, unique_fd());
+    const WakeLockName untracked("WakeLockEntryListTest_untracked");
+    const WakeLockName tracked("WakeLockEntryListTest_tracked");
+
+    // Only entries created after the histogram size is set record hold times.
+    entryList.updateOnAcquire(untracked, 0);
+    entryList.setHoldTimeHistogramSize(512);
+    entryList.updateOnRelease(untracked, 0);
+    for (int i = 0; i < 2; i++) {
+        entryList.updateOnAcquire(tracked, 0);
+        std::this_thread::sleep_for(20ms);
+        entryList.updateOnRelease(tracked, 0);
+    }
+    // Still held, not recorded yet.
+    entryList.updateOnAcquire(tracked, 0);
+
+    std::vector<WakeLockHoldTimeInfo> holdTimes;
+    entryList.getHoldTimeStats(&holdTimes);
+    ASSERT_EQ(holdTimes.size(), 1);
+    ASSERT_EQ(holdTimes[0].name, tracked.str());
+    ASSERT_EQ(holdTimes[0].pid, 0);
+    ASSERT_EQ(holdTimes[0].count, 2);
+    ASSERT_GE(holdTimes[0].p50Millis, 20);
+    ASSERT_GE(holdTimes[0].maxMillis, holdTimes[0].p99Millis);
+    ASSERT_EQ(holdTimes[0].maxErrorPercent, 25);
+}
+
+TEST(WakeLockEntryListTest, TestWakeupSourcesTable) {
+    TemporaryFile table;
+    ASSERT_TRUE(WriteStringToFile(
+        "name\t\tactive_count\tevent_count\twakeup_count\texpire_count\tactive_since\t"
+        "total_time\tmax_time\tlast_change\tprevent_suspend_time\tunknown_column\n"
+        "fakeKwl1    \t1\t2\t3\t4\t5\t6\t7\t8\t9\t10\n"
+        "fake Kwl2   \t11\t0\t0\t0\t0\t12\t0\t0\t0\t0\n",
+        table.path));
+    WakeLockEntryList entryList(1, unique_fd(open(table.path, O_CLOEXEC | O_RDONLY)));
+
+    std::vector<WakeLockInfo> wlStats;
+    entryList.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats.size(), 2);
+
+    ASSERT_EQ(wlStats[0].name, "fakeKwl1");
+    ASSERT_EQ(wlStats[0].activeCount, 1);
+    ASSERT_EQ(wlStats[0].eventCount, 2);
+    ASSERT_EQ(wlStats[0].wakeupCount, 3);
+    ASSERT_EQ(wlStats[0].expireCount, 4);
+    ASSERT_EQ(wlStats[0].activeTime, 5);
+    ASSERT_EQ(wlStats[0].totalTime, 6);
+    ASSERT_EQ(wlStats[0].maxTime, 7);
+    ASSERT_EQ(wlStats[0].lastChange, 8);
+    ASSERT_EQ(wlStats[0].preventSuspendTime, 9);
+    ASSERT_TRUE(wlStats[0].isActive);
+    ASSERT_TRUE(wlStats[0].isKernelWakelock);
+    ASSERT_EQ(wlStats[0].pid, -1);
+
+    ASSERT_EQ(wlStats[1].name, "fake Kwl2");
+    ASSERT_EQ(wlStats[1].activeCount, 11);
+    ASSERT_EQ(wlStats[1].totalTime, 12);
+    ASSERT_FALSE(wlStats[1].isActive);
+
+    // The table is read again on every query.
+    ASSERT_TRUE(WriteStringToFile(
+        "name\t\tactive_count\tevent_count\twakeup_count\texpire_count\tactive_since\t"
+        "total_time\tmax_time\tlast_change\tprevent_suspend_time\n"
+        "fakeKwl3    \t13\t0\t0\t0\t0\t0\t0\t0\t0\n",
+        table.path));
+    wlStats.clear();
+    entryList.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_EQ(wlStats[0].name, "fakeKwl3");
+    ASSERT_EQ(wlStats[0].activeCount, 13);
+}
+
+TEST(WakeLockEntryListTest, TestKernelWakelockSampler) {
+    static const std::string kHeader =
+        "name\t\tactive_count\tevent_count\twakeup_count\texpire_count\tactive_since\t"
+        "total_time\tmax_time\tlast_change\tprevent_suspend_time\n";
+    TemporaryFile table;
+    ASSERT_TRUE(WriteStringToFile(kHeader + "fakeKwl1    \t1\t0\t0\t0\t0\t0\t0\t0\t0\n",
+                                  table.path));
+    WakeLockEntryList entryList(1, unique_fd(open(table.path, O_CLOEXEC | O_RDONLY)));
+    entryList.startKernelWakelockSampler(std::chrono::hours(1));
+
+    ASSERT_TRUE(WriteStringToFile(kHeader + "fakeKwl1    \t2\t0\t0\t0\t0\t0\t0\t0\t0\n",
+                                  table.path));
+
+    // Regular queries are served from the last sample.
+    std::vector<WakeLockInfo> wlStats;
+    entryList.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_EQ(wlStats[0].activeCount, 1);
+    ASSERT_GE(wlStats[0].sampleAgeMillis, 0);
+
+    // A forced refresh reads the kernel stats at query time and replaces the sample.
+    wlStats.clear();
+    entryList.getWakeLockStats(&wlStats, true /* forceRefresh */);
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_EQ(wlStats[0].activeCount, 2);
+    ASSERT_EQ(wlStats[0].sampleAgeMillis, 0);
+
+    wlStats.clear();
+    entryList.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_EQ(wlStats[0].activeCount, 2);
+}
+
+TEST(WakeLockEntryListTest, TestWakeLockStatsDelta) {
+    WakeLockEntryList entryList(3, unique_fd());
+    for (const char* name : {"a", "b", "c"}) {
+        entryList.updateOnAcquire(WakeLockName(name), 1);
+        entryList.updateOnRelease(WakeLockName(name), 1);
+    }
+
+    WakeLockStatsDelta delta;
+    entryList.getWakeLockStatsDelta(0, &delta);
+    ASSERT_TRUE(delta.isFullUpdate);
+    ASSERT_EQ(delta.stats.size(), 3);
+
+    entryList.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.isFullUpdate);
+    ASSERT_EQ(delta.stats.size(), 0);
+
+    // Active wake locks are reported by every delta, since their times keep changing.
+    entryList.updateOnAcquire(WakeLockName("b"), 1);
+    entryList.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.isFullUpdate);
+    ASSERT_EQ(delta.stats.size(), 1);
+    ASSERT_EQ(delta.stats[0].name, "b");
+    ASSERT_TRUE(delta.stats[0].isActive);
+    entryList.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_EQ(delta.stats.size(), 1);
+
+    entryList.updateOnRelease(WakeLockName("b"), 1);
+    entryList.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.isFullUpdate);
+    ASSERT_EQ(delta.stats.size(), 1);
+    ASSERT_EQ(delta.stats[0].name, "b");
+    ASSERT_FALSE(delta.stats[0].isActive);
+    entryList.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_EQ(delta.stats.size(), 0);
+
+    // Evicting "a" can not be expressed as a delta.
+    entryList.updateOnAcquire(WakeLockName("d"), 1);
+    entryList.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_TRUE(delta.isFullUpdate);
+    ASSERT_EQ(delta.stats.size(), 3);
+    ASSERT_EQ(delta.stats[0].name, "d");
+    ASSERT_EQ(delta.stats[1].name, "b");
+    ASSERT_EQ(delta.stats[2].name, "c");
+}
+
+TEST(WakeLockEntryListTest, TestKernelWakelockStatsDelta) {
+    static const std::string kHeader = "name\t\tactive_count\n";
+    TemporaryFile table;
+    ASSERT_TRUE(WriteStringToFile(kHeader + "fakeKwl1\t1\nfakeKwl2\t1\n", table.path));
+    WakeLockEntryList entryList(1, unique_fd(open(table.path, O_CLOEXEC | O_RDONLY)));
+
+    WakeLockStatsDelta delta;
+    entryList.getWakeLockStatsDelta(0, &delta);
+    ASSERT_TRUE(delta.isFullUpdate);
+    ASSERT_EQ(delta.stats.size(), 2);
+
+    entryList.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.isFullUpdate);
+    ASSERT_EQ(delta.stats.size(), 0);
+
+    ASSERT_TRUE(WriteStringToFile(kHeader + "fakeKwl1\t1\nfakeKwl2\t2\n", table.path));
+    entryList.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.isFullUpdate);
+    ASSERT_EQ(delta.stats.size(), 1);
+    ASSERT_EQ(delta.stats[0].name, "fakeKwl2");
+    ASSERT_EQ(delta.stats[0].activeCount, 2);
+
+    ASSERT_TRUE(WriteStringToFile(kHeader + "fakeKwl2\t2\n", table.path));
+    entryList.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_TRUE(delta.isFullUpdate);
+    ASSERT_EQ(delta.stats.size(), 1);
+    ASSERT_EQ(delta.stats[0].name, "fakeKwl2");
+}
+
+TEST(SuspendStatsRegionTest, TestPublishAndRead) {
+    auto region = SuspendStatsRegion::create(2);
+    ASSERT_RESULT_OK(region);
+    auto reader = SuspendStatsRegionReader::create((*region)->dupFd());
+    ASSERT_RESULT_OK(reader);
+
+    SuspendInfo suspendInfo;
+    std::vector<WakeLockInfo> wlStats;
+    ASSERT_TRUE((*reader)->read(&suspendInfo, &wlStats));
+    ASSERT_EQ(suspendInfo.suspendAttemptCount, 0);
+    ASSERT_EQ(wlStats.size(), 0);
+
+    SuspendInfo publishedInfo;
+    publishedInfo.suspendAttemptCount = 3;
+    publishedInfo.failedSuspendCount = 1;
+    publishedInfo.sleepTimeMillis = 42;
+    std::vector<WakeLockInfo> publishedStats(3);
+    publishedStats[0].name = "wl0";
+    publishedStats[0].pid = 10;
+    publishedStats[0].isActive = true;
+    publishedStats[0].activeCount = 5;
+    publishedStats[1].name = std::string(kSharedWakeLockNameSize * 2, 'x');
+    publishedStats[1].totalTime = 7;
+    publishedStats[2].name = "dropped";
+    (*region)->publish(publishedInfo, publishedStats);
+
+    int64_t publishTime = 0;
+    ASSERT_TRUE((*reader)->read(&suspendInfo, &wlStats, &publishTime));
+    ASSERT_GT(publishTime, 0);
+    ASSERT_EQ(suspendInfo.suspendAttemptCount, 3);
+    ASSERT_EQ(suspendInfo.failedSuspendCount, 1);
+    ASSERT_EQ(suspendInfo.sleepTimeMillis, 42);
+    // Stats beyond the capacity are dropped and long names are truncated.
+    ASSERT_EQ(wlStats.size(), 2);
+    ASSERT_EQ(wlStats[0].name, "wl0");
+    ASSERT_EQ(wlStats[0].pid, 10);
+    ASSERT_TRUE(wlStats[0].isActive);
+    ASSERT_EQ(wlStats[0].activeCount, 5);
+    ASSERT_FALSE(wlStats[0].isKernelWakelock);
+    ASSERT_EQ(wlStats[1].name, std::string(kSharedWakeLockNameSize - 1, 'x'));
+    ASSERT_EQ(wlStats[1].totalTime, 7);
+
+    // Readers can not write to the region.
+    unique_fd fd = (*region)->dupFd();
+    ASSERT_EQ(mmap(nullptr, sizeof(SuspendStatsRegionHeader), PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0),
+              MAP_FAILED);
+    ASSERT_LT(write(fd, "x", 1), 0);
+}
+
+// Callback that blocks in notifyWakeup() until unblocked, to let wakeups pile up in the dispatcher.
+class BlockingCallback : public BnSuspendCallback {
+   public:
+    binder::Status notifyWakeup([[maybe_unused]] bool success,
+                                const std::vector<std::string>& wakeupReasons) override {
+        auto l = std::unique_lock(mLock);
+        mWakeupReasons.push_back(wakeupReasons[0]);
+        mCondVar.notify_all();
+        mCondVar.wait(l, [this] { return !mBlocked; });
+        return binder::Status::ok();
+    }
+
+    bool waitForWakeups(size_t numWakeups) {
+        auto l = std::unique_lock(mLock);
+        return mCondVar.wait_for(l, 5s, [&] { return mWakeupReasons.size() >= numWakeups; });
+    }
+
+    void unblock() {
+        auto l = std::lock_guard(mLock);
+        mBlocked = false;
+        mCondVar.notify_all();
+    }
+
+    std::vector<std::string> getWakeupReasons() {
+        auto l = std::lock_guard(mLock);
+        return mWakeupReasons;
+    }
+
+   private:
+    std::mutex mLock;
+    std::condition_variable mCondVar;
+    bool mBlocked = true;
+    std::vector<std::string> mWakeupReasons;
+};
+
+static std::string dumpDispatcher(const SuspendCallbackDispatcher& dispatcher) {
+    std::ostringstream out;
+    dispatcher.dump(out);
+    return out.str();
+}
+
+TEST(SuspendCallbackDispatcherTest, TestQueueOverflow) {
+    sp<BlockingCallback> cb = new BlockingCallback();
+    SuspendCallbackDispatcher dispatcher(cb, {.queueCapacity = 2});
+
+    dispatcher.enqueue(true, {"wakeup0"});
+    ASSERT_TRUE(cb->waitForWakeups(1));
+    // The enqueuer never waits for the blocked callback, the oldest wakeup is dropped instead.
+    dispatcher.enqueue(true, {"wakeup1"});
+    dispatcher.enqueue(true, {"wakeup2"});
+    dispatcher.enqueue(true, {"wakeup3"});
+    ASSERT_NE(dumpDispatcher(dispatcher).find("pending 2, dropped 1"), std::string::npos);
+
+    cb->unblock();
+    ASSERT_TRUE(cb->waitForWakeups(3));
+    ASSERT_EQ(cb->getWakeupReasons(), std::vector<std::string>({"wakeup0", "wakeup2", "wakeup3"}));
+}
+
+TEST(SuspendCallbackDispatcherTest, TestCoalescing) {
+    sp<BlockingCallback> cb = new BlockingCallback();
+    SuspendCallbackDispatcher dispatcher(cb, {.coalesceWakeups = true});
+
+    dispatcher.enqueue(true, {"wakeup0"});
+    ASSERT_TRUE(cb->waitForWakeups(1));
+    dispatcher.enqueue(true, {"wakeup1"});
+    dispatcher.enqueue(false, {"wakeup2"});
+    ASSERT_NE(dumpDispatcher(dispatcher).find("pending 1, dropped 0, coalesced 1"),
+              std::string::npos);
+
+    cb->unblock();
+    ASSERT_TRUE(cb->waitForWakeups(2));
+    ASSERT_EQ(cb->getWakeupReasons(), std::vector<std::string>({"wakeup0", "wakeup2"}));
+}
+
+TEST(SuspendCallbackDispatcherTest, TestExpiredAndLateWakeups) {
+    sp<BlockingCallback> cb = new BlockingCallback();
+    SuspendCallbackDispatcher dispatcher(cb, {.deliveryDeadline = 100ms});
+
+    dispatcher.enqueue(true, {"wakeup0"});
+    ASSERT_TRUE(cb->waitForWakeups(1));
+    // The blocked callback returns from wakeup0 late and keeps wakeup1 queued past the deadline.
+    dispatcher.enqueue(true, {"wakeup1"});
+    std::this_thread::sleep_for(200ms);
+    dispatcher.enqueue(true, {"wakeup2"});
+    cb->unblock();
+    ASSERT_TRUE(cb->waitForWakeups(2));
+    ASSERT_EQ(cb->getWakeupReasons(), std::vector<std::string>({"wakeup0", "wakeup2"}));
+
+    // Wait for the dispatcher to account for the second delivery.
+    std::string dump;
+    for (int i = 0; i < 100; i++) {
+        dump = dumpDispatcher(dispatcher);
+        if (dump.find("delivered 2") != std::string::npos) {
+            break;
+        }
+        std::this_thread::sleep_for(10ms);
+    }
+    ASSERT_NE(dump.find("delivered 2"), std::string::npos);
+    ASSERT_NE(dump.find("expired 1, late 1"), std::string::npos);
+}
+
+// Tests that a callback registered twice keeps a single dispatcher and that the number of
+// dispatchers is capped.
+TEST(SuspendControlServiceTest, TestRegisterCallbackLimit) {
+    sp<SuspendControlService> controlService = new SuspendControlService();
+    std::vector<sp<MockCallback>> cbs;
+    for (size_t i = 0; i < SuspendControlService::kMaxSuspendCallbacks; i++) {
+        sp<MockCallback> cb = new MockCallback(nullptr);
+        cb->disable();
+        cbs.push_back(cb);
+    }
+    bool retval = false;
+    controlService->registerCallback(cbs[0], &retval);
+    ASSERT_TRUE(retval);
+    controlService->registerCallback(cbs[0], &retval);
+    ASSERT_TRUE(retval);
+    for (size_t i = 1; i < cbs.size(); i++) {
+        controlService->registerCallback(cbs[i], &retval);
+        ASSERT_TRUE(retval);
+    }
+
+    sp<MockCallback> cb = new MockCallback(nullptr);
+    cb->disable();
+    controlService->registerCallback(cb, &retval);
+    ASSERT_FALSE(retval);
+    controlService->registerCallback(cbs[0], &retval);
+    ASSERT_TRUE(retval);
+}
+
+class WakeLockEventCallback : public BnWakeLockEventCallback {
+   public:
+    binder::Status notifyWakeLockEvents(const std::vector<WakeLockEvent>& events) override {
+        auto l = std::lock_guard(mLock);
+        mBatches.push_back(events);
+        mCondVar.notify_all();
+        return binder::Status::ok();
+    }
+
+    // Returns the first numBatches batches of events, or fewer if they are not delivered in time.
+    std::vector<std::vector<WakeLockEvent>> waitForBatches(size_t numBatches) {
+        auto l = std::unique_lock(mLock);
+        mCondVar.wait_for(l, 5s, [&] { return mBatches.size() >= numBatches; });
+        return mBatches;
+    }
+
+   private:
+    std::mutex mLock;
+    std::condition_variable mCondVar;
+    std::vector<std::vector<WakeLockEvent>> mBatches;
+};
+
+TEST(WakeLockEventCallbackTest, TestMaxBatchSize) {
+    sp<SuspendControlService> controlService = new SuspendControlService();
+    sp<WakeLockEventCallback> cb = new WakeLockEventCallback();
+    ASSERT_FALSE(controlService->registerWakeLockEventCallback(cb, {"wl1"}, 1h, 0, false));
+    ASSERT_TRUE(controlService->registerWakeLockEventCallback(cb, {"wl1", "wl2", "wl1"}, 1h, 3,
+                                                              false /* collapsePairs */));
+    ASSERT_FALSE(controlService->registerWakeLockEventCallback(cb, {"wl3"}, 1h, 3, false));
+
+    WakeLockName wl1("wl1");
+    WakeLockName wl2("wl2");
+    WakeLockName wl3("wl3");
+    ASSERT_TRUE(wl1.hasWatchers());
+    ASSERT_FALSE(wl3.hasWatchers());
+    controlService->notifyWakelock(wl1, true);
+    controlService->notifyWakelock(wl3, true);
+    controlService->notifyWakelock(wl2, true);
+    controlService->notifyWakelock(wl1, false);
+    controlService->notifyWakelock(wl2, false);
+
+    // The last event is held back until more events arrive or an hour has passed.
+    auto batches = cb->waitForBatches(1);
+    ASSERT_EQ(batches.size(), 1);
+    ASSERT_EQ(batches[0].size(), 3);
+    ASSERT_EQ(batches[0][0].name, "wl1");
+    ASSERT_TRUE(batches[0][0].isAcquired);
+    ASSERT_EQ(batches[0][0].heldTimeMillis, -1);
+    ASSERT_EQ(batches[0][1].name, "wl2");
+    ASSERT_TRUE(batches[0][1].isAcquired);
+    ASSERT_EQ(batches[0][2].name, "wl1");
+    ASSERT_FALSE(batches[0][2].isAcquired);
+    ASSERT_GE(batches[0][2].timeMillis, batches[0][0].timeMillis);
+}
+
+TEST(WakeLockEventCallbackTest, TestCollapsePairs) {
+    sp<SuspendControlService> controlService = new SuspendControlService();
+    sp<WakeLockEventCallback> cb = new WakeLockEventCallback();
+    ASSERT_TRUE(controlService->registerWakeLockEventCallback(cb, {"wl1"}, 200ms, 100,
+                                                              true /* collapsePairs */));
+
+    WakeLockName wl1("wl1");
+    controlService->notifyWakelock(wl1, true);
+    std::this_thread::sleep_for(5ms);
+    controlService->notifyWakelock(wl1, false);
+    controlService->notifyWakelock(wl1, true);
+
+    auto batches = cb->waitForBatches(1);
+    ASSERT_EQ(batches.size(), 1);
+    ASSERT_EQ(batches[0].size(), 2);
+    ASSERT_FALSE(batches[0][0].isAcquired);
+    ASSERT_GE(batches[0][0].heldTimeMillis, 5);
+    ASSERT_TRUE(batches[0][1].isAcquired);
+    ASSERT_EQ(batches[0][1].heldTimeMillis, -1);
+
+    // A release whose acquisition was already delivered is not collapsed.
+    controlService->notifyWakelock(wl1, false);
+    batches = cb->waitForBatches(2);
+    ASSERT_EQ(batches.size(), 2);
+    ASSERT_EQ(batches[1].size(), 1);
+    ASSERT_FALSE(batches[1][0].isAcquired);
+    ASSERT_EQ(batches[1][0].heldTimeMillis, -1);
+}
+
+TEST(WakeLockEntryListTest, TestLRUEvictAcrossShards) {
+    WakeLockEntryList entryList(3, unique_fd());
+
+    for (int i = 0; i < 64; i++) {
+        entryList.updateOnAcquire(WakeLockName("wl" + std::to_string(i)), 1);
+    }
+    entryList.updateOnRelease(WakeLockName("wl61"), 1);
+
+    std::vector<WakeLockInfo> wlStats;
+    entryList.getWakeLockStats(&wlStats);
+
+    ASSERT_EQ(wlStats.size(), 3);
+    ASSERT_EQ(wlStats[0].name, "wl61");
+    ASSERT_FALSE(wlStats[0].isActive);
+    ASSERT_EQ(wlStats[1].name, "wl63");
+    ASSERT_EQ(wlStats[2].name, "wl62");
+}
+
+TEST(WakeLockEntryListTest, TestConcurrentUpdatesRespectCapacity) {
+    constexpr size_t kCapacity = 8;
+    constexpr int kNumThreads = 8;
+    WakeLockEntryList entryList(kCapacity, unique_fd());
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+        threads.emplace_back([&entryList, t] {
+            for (int i = 0; i < 100; i++) {
+                WakeLockName name("wl" + std::to_string(i));
+                entryList.updateOnAcquire(name, t);
+                entryList.updateOnRelease(name, t);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<WakeLockInfo> wlStats;
+    entryList.getWakeLockStats(&wlStats);
+
+    ASSERT_EQ(wlStats.size(), kCapacity);
+    for (const auto& info : wlStats) {
+        ASSERT_FALSE(info.isActive);
+    }
+}
+
 }  // namespace android
 
 int main(int argc, char** argv) {
@@ -19,14 +19,16 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
-#include <android-base/stringprintf.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 
+#include <algorithm>
+#include <charconv>
 #include <iomanip>
+#include <string_view>
 
 using android::base::ParseInt;
 using android::base::ReadFdToString;
-using android::base::Readlink;
-using android::base::StringPrintf;
 
 namespace android {
 namespace system {
@@ -125,49 +127,125 @@ TimestampType getTimeNow() {
 }
 
 WakeLockEntryList::WakeLockEntryList(size_t capacity, unique_fd kernelWakelockStatsFd)
-    : mCapacity(capacity), mKernelWakelockStatsFd(std::move(kernelWakelockStatsFd)) {}
+    : mCapacity(capacity),
+      mKernelWakelockStatsFd(std::move(kernelWakelockStatsFd)),
+      mKernelWakelockStatsIsTable(false),
+      mKernelWakelockStatsDir(nullptr, &closedir),
+      mMaxOpenKernelWakelockStatFds(kMaxOpenKernelWakelockStatFds) {
+    // Leave at least half of the fds to the rest of the process.
+    struct rlimit rlim;
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur != RLIM_INFINITY) {
+        mMaxOpenKernelWakelockStatFds =
+            std::min<size_t>(mMaxOpenKernelWakelockStatFds, rlim.rlim_cur / 2);
+    }
+    struct stat st;
+    if (mKernelWakelockStatsFd >= 0 && fstat(mKernelWakelockStatsFd, &st) == 0) {
+        mKernelWakelockStatsIsTable = S_ISREG(st.st_mode);
+    }
+    if (mKernelWakelockStatsFd >= 0 && !mKernelWakelockStatsIsTable) {
+        std::lock_guard<std::mutex> lock(mKernelWakelockLock);
+        mKernelWakelockStatsDir.reset(fdopendir(dup(mKernelWakelockStatsFd.get())));
+    }
+}
+
+/**
+ * Returns the shard that owns the stats entry for (name, pid).
+ */
+WakeLockEntryList::Shard& WakeLockEntryList::getShard(const WakeLockName& name, int pid) {
+    return mShards[LockHash()(LockKey(name.id(), pid)) % kNumShards];
+}
 
 /**
- * Evicts LRU from back of list if stats is at capacity.
+ * Evicts LRU entries until stats are back within capacity. Must be called without holding any
+ * shard lock, after an insertion has been counted in mSize.
  */
 void WakeLockEntryList::evictIfFull() {
-    if (mStats.size() == mCapacity) {
-        auto evictIt = mStats.end();
-        std::advance(evictIt, -1);
-        auto evictKey = std::make_pair(evictIt->name, evictIt->pid);
-        mLookupTable.erase(evictKey);
-        mStats.erase(evictIt);
+    size_t size = mSize.load();
+    while (size > mCapacity) {
+        // Claim one eviction before performing it so that concurrent callers never evict more
+        // entries than needed to get back to capacity.
+        if (!mSize.compare_exchange_weak(size, size - 1)) {
+            continue;
+        }
+        evictOldest();
         LOG(ERROR) << "WakeLock Stats: Stats capacity met, consider adjusting capacity to "
                       "avoid stats eviction.";
+        size = mSize.load();
+    }
+}
+
+/**
+ * Removes the globally least recently used entry, i.e. the shard tail with the smallest stamp.
+ * Shard locks are only ever held one at a time, so a tail may change between finding it and
+ * locking its shard again; in that case the search is repeated.
+ */
+void WakeLockEntryList::evictOldest() {
+    while (true) {
+        Shard* victim = nullptr;
+        uint64_t oldestStamp = 0;
+        for (Shard& shard : mShards) {
+            std::lock_guard<ProfiledMutex> lock(shard.lock);
+            if (!shard.stats.empty() && (!victim || shard.stats.back().stamp < oldestStamp)) {
+                victim = &shard;
+                oldestStamp = shard.stats.back().stamp;
+            }
+        }
+        if (victim == nullptr) {
+            return;
+        }
+
+        std::lock_guard<ProfiledMutex> lock(victim->lock);
+        if (!victim->stats.empty() && victim->stats.back().stamp == oldestStamp) {
+            deleteEntry(*victim, std::prev(victim->stats.end()));
+            return;
+        }
     }
 }
 
 /**
  * Inserts entry as MRU.
  */
-void WakeLockEntryList::insertEntry(WakeLockInfo entry) {
-    auto key = std::make_pair(entry.name, entry.pid);
-    mStats.emplace_front(std::move(entry));
-    mLookupTable[key] = mStats.begin();
+void WakeLockEntryList::insertEntry(Shard& shard, const WakeLockName& name, WakeLockInfo entry) {
+    auto key = LockKey(name.id(), entry.pid);
+    shard.stats.push_front(
+        {name, std::move(entry), mNextStamp++, DurationHistogram(mHoldTimeHistogramPrecision)});
+    shard.lookupTable[key] = shard.stats.begin();
+}
+
+/**
+ * Marks an existing entry as MRU without reallocating it.
+ */
+void WakeLockEntryList::promoteEntry(Shard& shard, std::list<Entry>::iterator entry) {
+    entry->stamp = mNextStamp++;
+    shard.stats.splice(shard.stats.begin(), shard.stats, entry);
 }
 
 /**
  * Removes entry from the stats list.
  */
-void WakeLockEntryList::deleteEntry(std::list<WakeLockInfo>::iterator entry) {
-    auto key = std::make_pair(entry->name, entry->pid);
-    mLookupTable.erase(key);
-    mStats.erase(entry);
+void WakeLockEntryList::deleteEntry(Shard& shard, std::list<Entry>::iterator entry) {
+    shard.lookupTable.erase(LockKey(entry->name.id(), entry->info.pid));
+    shard.stats.erase(entry);
+    recordRemoval();
+}
+
+/**
+ * Advances mLastRemovalStamp to a new stamp. Removals may race, so the stamp is only ever raised.
+ */
+void WakeLockEntryList::recordRemoval() const {
+    uint64_t stamp = mNextStamp++;
+    uint64_t lastRemovalStamp = mLastRemovalStamp.load();
+    while (lastRemovalStamp < stamp &&
+           !mLastRemovalStamp.compare_exchange_weak(lastRemovalStamp, stamp)) {
+    }
 }
 
 /**
  * Creates and returns a native wakelock entry.
  */
-WakeLockInfo WakeLockEntryList::createNativeEntry(const std::string& name, int pid,
-                                                  TimestampType timeNow) const {
+WakeLockInfo WakeLockEntryList::createNativeEntry(int pid, TimestampType timeNow) const {
     WakeLockInfo info;
 
-    info.name = name;
     // It only makes sense to create a new entry on initial activation of the lock.
     info.activeCount = 1;
     info.lastChange = timeNow;
@@ -183,27 +261,15 @@ WakeLockInfo WakeLockEntryList::createNativeEntry(const std::string& name, int p
     info.expireCount = 0;
     info.preventSuspendTime = 0;
     info.wakeupCount = 0;
+    info.sampleAgeMillis = 0;
 
     return info;
 }
 
 /*
- * Checks whether a given directory entry is a stat file we're interested in.
+ * Returns a kernel wakelock entry with all stats zeroed.
  */
-static bool isStatFile(const struct dirent* de) {
-    const char* statName = de->d_name;
-    if (!strcmp(statName, ".") || !strcmp(statName, "..") || !strcmp(statName, "device") ||
-        !strcmp(statName, "power") || !strcmp(statName, "subsystem") ||
-        !strcmp(statName, "uevent")) {
-        return false;
-    }
-    return true;
-}
-
-/*
- * Creates and returns a kernel wakelock entry with data read from mKernelWakelockStatsFd
- */
-WakeLockInfo WakeLockEntryList::createKernelEntry(const std::string& kwlId) const {
+static WakeLockInfo createEmptyKernelEntry() {
     WakeLockInfo info;
 
     info.activeCount = 0;
@@ -220,81 +286,156 @@ WakeLockInfo WakeLockEntryList::createKernelEntry(const std::string& kwlId) cons
     info.expireCount = 0;
     info.preventSuspendTime = 0;
     info.wakeupCount = 0;
+    info.sampleAgeMillis = 0;
+
+    return info;
+}
 
+/*
+ * Stat files of a wakeup source and the WakeLockInfo fields they are read into.
+ */
+static constexpr std::array<std::pair<const char*, int64_t WakeLockInfo::*>, 9>
+    kKernelWakelockStats = {{
+        {"active_count", &WakeLockInfo::activeCount},
+        {"active_time_ms", &WakeLockInfo::activeTime},
+        {"event_count", &WakeLockInfo::eventCount},
+        {"expire_count", &WakeLockInfo::expireCount},
+        {"last_change_ms", &WakeLockInfo::lastChange},
+        {"max_time_ms", &WakeLockInfo::maxTime},
+        {"prevent_suspend_time_ms", &WakeLockInfo::preventSuspendTime},
+        {"total_time_ms", &WakeLockInfo::totalTime},
+        {"wakeup_count", &WakeLockInfo::wakeupCount},
+    }};
+
+static unique_fd openKernelWakelockDir(int kernelWakelockStatsFd, const std::string& kwlId) {
     unique_fd wakelockFd{TEMP_FAILURE_RETRY(
-        openat(mKernelWakelockStatsFd, kwlId.c_str(), O_DIRECTORY | O_CLOEXEC | O_RDONLY))};
+        openat(kernelWakelockStatsFd, kwlId.c_str(), O_DIRECTORY | O_CLOEXEC | O_RDONLY))};
     if (wakelockFd < 0) {
         char buf[PATH_MAX];
         ssize_t data_length =
-            readlinkat(mKernelWakelockStatsFd, kwlId.c_str(), buf, sizeof(buf) - 1);
+            readlinkat(kernelWakelockStatsFd, kwlId.c_str(), buf, sizeof(buf) - 1);
         if (data_length <= 0 || strncmp(kwlId.c_str(), buf, kwlId.length()) == 0) {
             buf[0] = '\0';
+        } else {
+            buf[data_length] = '\0';
         }
         PLOG(ERROR) << "Error opening kernel wakelock stats for: " << kwlId << " (" << buf << ")";
     }
+    return wakelockFd;
+}
 
-    std::unique_ptr<DIR, decltype(&closedir)> wakelockDp(fdopendir(dup(wakelockFd.get())),
-                                                         &closedir);
-    if (wakelockDp) {
-        struct dirent* de;
-        while ((de = readdir(wakelockDp.get()))) {
-            if (!isStatFile(de)) {
-                continue;
-            }
+/*
+ * Opens the directory of a wakeup source and reads its name. The name of a wakeup source never
+ * changes, so it is read once here.
+ */
+WakeLockEntryList::KernelWakelockSource WakeLockEntryList::openKernelWakelockSource(
+    const std::string& kwlId, ino_t ino) const {
+    static_assert(kKernelWakelockStats.size() == kNumKernelWakelockStats);
 
-            std::string statName(de->d_name);
-            unique_fd statFd{
-                TEMP_FAILURE_RETRY(openat(wakelockFd, statName.c_str(), O_CLOEXEC | O_RDONLY))};
-            if (statFd < 0) {
-                PLOG(ERROR) << "Error opening " << statName << " for " << kwlId;
-            }
+    KernelWakelockSource source;
+    source.ino = ino;
+    source.complete = true;
+    source.generation = 0;
 
-            std::string valStr;
-            if (!ReadFdToString(statFd.get(), &valStr)) {
-                PLOG(ERROR) << "Error reading " << statName << " for " << kwlId;
-                continue;
-            }
+    unique_fd wakelockFd = openKernelWakelockDir(mKernelWakelockStatsFd, kwlId);
+    if (wakelockFd < 0) {
+        source.complete = false;
+        return source;
+    }
 
-            // Trim newline
-            valStr.erase(std::remove(valStr.begin(), valStr.end(), '\n'), valStr.end());
+    unique_fd nameFd{TEMP_FAILURE_RETRY(openat(wakelockFd, "name", O_CLOEXEC | O_RDONLY))};
+    if (nameFd < 0 || !ReadFdToString(nameFd.get(), &source.name)) {
+        PLOG(ERROR) << "Error reading name for " << kwlId;
+        source.complete = false;
+    }
+    // Trim newline
+    source.name.erase(std::remove(source.name.begin(), source.name.end(), '\n'),
+                      source.name.end());
 
-            if (statName == "name") {
-                info.name = valStr;
-                continue;
-            }
+    openKernelWakelockStatsLocked(wakelockFd, kwlId, &source);
+    return source;
+}
 
-            int64_t statVal;
-            if (!ParseInt(valStr, &statVal)) {
-                std::string path;
-                if (Readlink(StringPrintf("/proc/self/fd/%d", statFd.get()), &path)) {
-                    LOG(ERROR) << "Unexpected format for wakelock stat value (" << valStr
-                               << ") from file: " << path;
-                } else {
-                    LOG(ERROR) << "Unexpected format for wakelock stat value (" << valStr << ")";
-                }
+/*
+ * Keeps the stat files of source open if they fit in the fd budget. A source whose stat files
+ * cannot all be opened keeps none of them and is read by opening them at query time.
+ */
+void WakeLockEntryList::openKernelWakelockStatsLocked(int dirFd, const std::string& kwlId,
+                                                      KernelWakelockSource* source) const {
+    if (!source->statFds.empty() ||
+        mNumOpenKernelWakelockStatFds + kNumKernelWakelockStats > mMaxOpenKernelWakelockStatFds) {
+        return;
+    }
+
+    std::vector<unique_fd> statFds;
+    statFds.reserve(kNumKernelWakelockStats);
+    for (const auto& [statName, statField] : kKernelWakelockStats) {
+        unique_fd statFd{TEMP_FAILURE_RETRY(openat(dirFd, statName, O_CLOEXEC | O_RDONLY))};
+        if (statFd < 0) {
+            PLOG(ERROR) << "Error opening " << statName << " for " << kwlId;
+            return;
+        }
+        statFds.push_back(std::move(statFd));
+    }
+    source->statFds = std::move(statFds);
+    mNumOpenKernelWakelockStatFds += kNumKernelWakelockStats;
+}
+
+/*
+ * Creates and returns a kernel wakelock entry with data read from the stat files of source. Each
+ * stat takes one pread() into a stack buffer if the stat files are kept open, else one openat()
+ * more. A source that is not kept open claims fds freed by sources that went away.
+ */
+WakeLockInfo WakeLockEntryList::createKernelEntryLocked(const std::string& kwlId,
+                                                        KernelWakelockSource* source) const {
+    WakeLockInfo info = createEmptyKernelEntry();
+    info.name = source->name;
+
+    unique_fd dirFd;
+    if (source->statFds.empty()) {
+        dirFd = openKernelWakelockDir(mKernelWakelockStatsFd, kwlId);
+        if (dirFd < 0) {
+            return info;
+        }
+        openKernelWakelockStatsLocked(dirFd, kwlId, source);
+    }
+
+    for (size_t i = 0; i < kKernelWakelockStats.size(); i++) {
+        const auto& [statName, statField] = kKernelWakelockStats[i];
+        unique_fd reopenedStatFd;
+        int statFd;
+        if (source->statFds.empty()) {
+            reopenedStatFd.reset(
+                TEMP_FAILURE_RETRY(openat(dirFd, statName, O_CLOEXEC | O_RDONLY)));
+            statFd = reopenedStatFd;
+            if (statFd < 0) {
+                PLOG(ERROR) << "Error opening " << statName << " for " << kwlId;
                 continue;
             }
+        } else {
+            statFd = source->statFds[i];
+        }
 
-            if (statName == "active_count") {
-                info.activeCount = statVal;
-            } else if (statName == "active_time_ms") {
-                info.activeTime = statVal;
-            } else if (statName == "event_count") {
-                info.eventCount = statVal;
-            } else if (statName == "expire_count") {
-                info.expireCount = statVal;
-            } else if (statName == "last_change_ms") {
-                info.lastChange = statVal;
-            } else if (statName == "max_time_ms") {
-                info.maxTime = statVal;
-            } else if (statName == "prevent_suspend_time_ms") {
-                info.preventSuspendTime = statVal;
-            } else if (statName == "total_time_ms") {
-                info.totalTime = statVal;
-            } else if (statName == "wakeup_count") {
-                info.wakeupCount = statVal;
-            }
+        // Stat values are single integers. sysfs regenerates the value on each read at offset 0.
+        char buf[32];
+        ssize_t len = TEMP_FAILURE_RETRY(pread(statFd, buf, sizeof(buf) - 1, 0));
+        if (len < 0) {
+            PLOG(ERROR) << "Error reading " << statName << " for " << kwlId;
+            continue;
+        }
+        // Trim newline
+        while (len > 0 && buf[len - 1] == '\n') {
+            len--;
+        }
+        buf[len] = '\0';
+
+        int64_t statVal;
+        if (!ParseInt(buf, &statVal)) {
+            LOG(ERROR) << "Unexpected format for wakelock stat value (" << buf
+                       << ") from file: " << kwlId << "/" << statName;
+            continue;
         }
+        info.*statField = statVal;
     }
 
     // Derived stats
@@ -303,106 +444,538 @@ WakeLockInfo WakeLockEntryList::createKernelEntry(const std::string& kwlId) cons
     return info;
 }
 
-void WakeLockEntryList::getKernelWakelockStats(std::vector<WakeLockInfo>* aidl_return) const {
-    std::unique_ptr<DIR, decltype(&closedir)> dp(fdopendir(dup(mKernelWakelockStatsFd.get())),
-                                                 &closedir);
-    if (dp) {
-        // rewinddir, else subsequent calls will not get any kernel wakelocks.
-        rewinddir(dp.get());
+void WakeLockEntryList::closeKernelWakelockSourceLocked(KernelWakelockSource* source) const {
+    if (!source->statFds.empty()) {
+        source->statFds.clear();
+        mNumOpenKernelWakelockStatFds -= kNumKernelWakelockStats;
+    }
+}
+
+void WakeLockEntryList::getKernelWakelockStatsLocked(std::vector<WakeLockInfo>* aidl_return) const {
+    if (mKernelWakelockStatsIsTable) {
+        getKernelWakelockStatsFromTableLocked(aidl_return);
+    } else {
+        getKernelWakelockStatsFromDirectoryLocked(aidl_return);
+    }
+}
+
+/*
+ * Lists the wakeup sources and reports the stats of each of them. Only sources that are new, were
+ * replaced (i.e. have a new inode), or could not be fully opened before are (re)opened; sources
+ * that disappeared are closed.
+ */
+void WakeLockEntryList::getKernelWakelockStatsFromDirectoryLocked(
+    std::vector<WakeLockInfo>* aidl_return) const {
+    if (!mKernelWakelockStatsDir) {
+        return;
+    }
+
+    uint64_t generation = ++mKernelWakelockGeneration;
+
+    // rewinddir, else subsequent calls will not get any kernel wakelocks.
+    rewinddir(mKernelWakelockStatsDir.get());
+
+    struct dirent* de;
+    while ((de = readdir(mKernelWakelockStatsDir.get()))) {
+        std::string kwlId(de->d_name);
+        if ((kwlId == ".") || (kwlId == "..")) {
+            continue;
+        }
+
+        auto it = mKernelWakelockSources.find(kwlId);
+        if (it == mKernelWakelockSources.end() || it->second.ino != de->d_ino ||
+            !it->second.complete) {
+            if (it != mKernelWakelockSources.end()) {
+                closeKernelWakelockSourceLocked(&it->second);
+            }
+            it = mKernelWakelockSources
+                     .insert_or_assign(kwlId, openKernelWakelockSource(kwlId, de->d_ino))
+                     .first;
+        }
+        it->second.generation = generation;
+        aidl_return->emplace_back(createKernelEntryLocked(kwlId, &it->second));
+    }
+
+    for (auto it = mKernelWakelockSources.begin(); it != mKernelWakelockSources.end();) {
+        if (it->second.generation != generation) {
+            closeKernelWakelockSourceLocked(&it->second);
+            it = mKernelWakelockSources.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/*
+ * Columns of the wakeup_sources table and the WakeLockInfo fields they are read into. Times are
+ * in milliseconds, active_since is only non zero while the wakeup source is active.
+ */
+static constexpr std::array<std::pair<std::string_view, int64_t WakeLockInfo::*>, 9>
+    kWakeupSourcesColumns = {{
+        {"active_count", &WakeLockInfo::activeCount},
+        {"event_count", &WakeLockInfo::eventCount},
+        {"wakeup_count", &WakeLockInfo::wakeupCount},
+        {"expire_count", &WakeLockInfo::expireCount},
+        {"active_since", &WakeLockInfo::activeTime},
+        {"total_time", &WakeLockInfo::totalTime},
+        {"max_time", &WakeLockInfo::maxTime},
+        {"last_change", &WakeLockInfo::lastChange},
+        {"prevent_suspend_time", &WakeLockInfo::preventSuspendTime},
+    }};
+
+/*
+ * Splits text at the first delimiter, returning the part before it and removing it and the
+ * delimiter from text.
+ */
+static std::string_view splitFirst(std::string_view* text, char delimiter) {
+    size_t end = text->find(delimiter);
+    std::string_view token = text->substr(0, end);
+    text->remove_prefix(end == std::string_view::npos ? text->size() : end + 1);
+    return token;
+}
+
+/*
+ * Removes and returns the next whitespace separated token of text.
+ */
+static std::string_view nextToken(std::string_view* text) {
+    size_t start = text->find_first_not_of(" \t");
+    if (start == std::string_view::npos) {
+        *text = {};
+        return {};
+    }
+    text->remove_prefix(start);
+    size_t end = text->find_first_of(" \t");
+    std::string_view token = text->substr(0, end);
+    text->remove_prefix(end == std::string_view::npos ? text->size() : end);
+    return token;
+}
+
+/*
+ * Reads the whole wakeup_sources table with a single pass of pread() into a buffer reused across
+ * queries, and tokenizes it in place. Columns are matched by the names in the header line so that
+ * columns added by newer kernels are skipped.
+ */
+void WakeLockEntryList::getKernelWakelockStatsFromTableLocked(
+    std::vector<WakeLockInfo>* aidl_return) const {
+    std::vector<char>& buf = mKernelWakeupSourcesBuffer;
+    size_t len = 0;
+    while (true) {
+        if (len == buf.size()) {
+            buf.resize(std::max<size_t>(4096, buf.size() * 2));
+        }
+        ssize_t n = TEMP_FAILURE_RETRY(
+            pread(mKernelWakelockStatsFd, buf.data() + len, buf.size() - len, len));
+        if (n < 0) {
+            PLOG(ERROR) << "Error reading kernel wakeup sources table";
+            return;
+        }
+        if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+    std::string_view table(buf.data(), len);
+
+    // Up to 16 columns are matched, the first column is always the name.
+    std::array<int64_t WakeLockInfo::*, 16> columnFields{};
+    size_t numColumns = 0;
+    std::string_view header = splitFirst(&table, '\n');
+    for (std::string_view column = nextToken(&header);
+         !column.empty() && numColumns < columnFields.size(); column = nextToken(&header)) {
+        for (const auto& [columnName, field] : kWakeupSourcesColumns) {
+            if (column == columnName) {
+                columnFields[numColumns] = field;
+            }
+        }
+        numColumns++;
+    }
+
+    while (!table.empty()) {
+        std::string_view line = splitFirst(&table, '\n');
+        // Names are padded with spaces and may contain spaces, values are separated by tabs.
+        std::string_view name = splitFirst(&line, '\t');
+        name = name.substr(0, name.find_last_not_of(' ') + 1);
+        if (name.empty()) {
+            continue;
+        }
 
-        struct dirent* de;
-        while ((de = readdir(dp.get()))) {
-            std::string kwlId(de->d_name);
-            if ((kwlId == ".") || (kwlId == "..")) {
+        WakeLockInfo info = createEmptyKernelEntry();
+        info.name = std::string(name);
+        for (size_t i = 1; i < numColumns; i++) {
+            std::string_view value = nextToken(&line);
+            if (value.empty()) {
+                break;
+            }
+            if (columnFields[i] == nullptr) {
                 continue;
             }
-            WakeLockInfo entry = createKernelEntry(kwlId);
-            aidl_return->emplace_back(std::move(entry));
+
+            int64_t statVal;
+            const char* end = value.data() + value.size();
+            auto [ptr, ec] = std::from_chars(value.data(), end, statVal);
+            if (ec != std::errc() || ptr != end) {
+                LOG(ERROR) << "Unexpected format for wakelock stat value (" << value
+                           << ") for: " << info.name;
+                continue;
+            }
+            info.*columnFields[i] = statVal;
         }
+
+        // Derived stats
+        info.isActive = info.activeTime > 0;
+
+        aidl_return->emplace_back(std::move(info));
+    }
+}
+
+void WakeLockEntryList::updateOnAcquire(const WakeLockName& name, int pid) {
+    TimestampType timeNow = getTimeNow();
+
+    Shard& shard = getShard(name, pid);
+    {
+        std::lock_guard<ProfiledMutex> lock(shard.lock);
+        updateOnAcquireLocked(shard, name, pid, timeNow);
     }
+    evictIfFull();
 }
 
-void WakeLockEntryList::updateOnAcquire(const std::string& name, int pid) {
+void WakeLockEntryList::updateOnAcquire(const std::vector<WakeLockName>& names, int pid) {
     TimestampType timeNow = getTimeNow();
 
-    std::lock_guard<std::mutex> lock(mStatsLock);
+    for (const auto& name : names) {
+        Shard& shard = getShard(name, pid);
+        std::lock_guard<ProfiledMutex> lock(shard.lock);
+        updateOnAcquireLocked(shard, name, pid, timeNow);
+    }
+    evictIfFull();
+}
 
-    auto key = std::make_pair(name, pid);
-    auto it = mLookupTable.find(key);
-    if (it == mLookupTable.end()) {
-        evictIfFull();
-        WakeLockInfo newEntry = createNativeEntry(name, pid, timeNow);
-        insertEntry(newEntry);
+void WakeLockEntryList::updateOnAcquireLocked(Shard& shard, const WakeLockName& name, int pid,
+                                              TimestampType timeNow) {
+    auto it = shard.lookupTable.find(LockKey(name.id(), pid));
+    if (it == shard.lookupTable.end()) {
+        insertEntry(shard, name, createNativeEntry(pid, timeNow));
+        mSize++;
     } else {
-        auto staleEntry = it->second;
-        WakeLockInfo updatedEntry = *staleEntry;
+        auto entry = it->second;
+        WakeLockInfo& info = entry->info;
 
         // Update entry
-        updatedEntry.isActive = true;
-        updatedEntry.activeTime = 0;
-        updatedEntry.activeCount++;
-        updatedEntry.lastChange = timeNow;
+        info.isActive = true;
+        info.activeTime = 0;
+        info.activeCount++;
+        info.lastChange = timeNow;
 
-        deleteEntry(staleEntry);
-        insertEntry(std::move(updatedEntry));
+        promoteEntry(shard, entry);
     }
 }
 
-void WakeLockEntryList::updateOnRelease(const std::string& name, int pid) {
+void WakeLockEntryList::updateOnRelease(const WakeLockName& name, int pid) {
     TimestampType timeNow = getTimeNow();
 
-    std::lock_guard<std::mutex> lock(mStatsLock);
+    Shard& shard = getShard(name, pid);
+    std::lock_guard<ProfiledMutex> lock(shard.lock);
+    updateOnReleaseLocked(shard, name, pid, timeNow);
+}
+
+void WakeLockEntryList::updateOnRelease(const std::vector<WakeLockName>& names, int pid) {
+    TimestampType timeNow = getTimeNow();
+
+    for (const auto& name : names) {
+        Shard& shard = getShard(name, pid);
+        std::lock_guard<ProfiledMutex> lock(shard.lock);
+        updateOnReleaseLocked(shard, name, pid, timeNow);
+    }
+}
 
-    auto key = std::make_pair(name, pid);
-    auto it = mLookupTable.find(key);
-    if (it == mLookupTable.end()) {
-        LOG(INFO) << "WakeLock Stats: A stats entry for, \"" << name
+void WakeLockEntryList::updateOnReleaseLocked(Shard& shard, const WakeLockName& name, int pid,
+                                              TimestampType timeNow) {
+    auto it = shard.lookupTable.find(LockKey(name.id(), pid));
+    if (it == shard.lookupTable.end()) {
+        LOG(INFO) << "WakeLock Stats: A stats entry for, \"" << name.str()
                   << "\" was not found. This is most likely due to it being evicted.";
     } else {
-        auto staleEntry = it->second;
-        WakeLockInfo updatedEntry = *staleEntry;
+        auto entry = it->second;
+        WakeLockInfo& info = entry->info;
 
         // Update entry
-        TimestampType timeDelta = timeNow - updatedEntry.lastChange;
-        updatedEntry.isActive = false;
-        updatedEntry.activeTime += timeDelta;
-        updatedEntry.maxTime = std::max(updatedEntry.maxTime, updatedEntry.activeTime);
-        updatedEntry.activeTime = 0;  // No longer active
-        updatedEntry.totalTime += timeDelta;
-        updatedEntry.lastChange = timeNow;
-
-        deleteEntry(staleEntry);
-        insertEntry(std::move(updatedEntry));
+        TimestampType timeDelta = timeNow - info.lastChange;
+        info.isActive = false;
+        info.activeTime += timeDelta;
+        info.maxTime = std::max(info.maxTime, info.activeTime);
+        entry->holdTimes.record(info.activeTime);
+        info.activeTime = 0;  // No longer active
+        info.totalTime += timeDelta;
+        info.lastChange = timeNow;
+
+        promoteEntry(shard, entry);
     }
 }
 /**
  * Updates the native wakelock stats based on the current time.
  */
 void WakeLockEntryList::updateNow() {
-    std::lock_guard<std::mutex> lock(mStatsLock);
-
     TimestampType timeNow = getTimeNow();
 
-    for (std::list<WakeLockInfo>::iterator it = mStats.begin(); it != mStats.end(); ++it) {
-        if (it->isActive) {
-            TimestampType timeDelta = timeNow - it->lastChange;
-            it->activeTime += timeDelta;
-            it->maxTime = std::max(it->maxTime, it->activeTime);
-            it->totalTime += timeDelta;
-            it->lastChange = timeNow;
+    for (Shard& shard : mShards) {
+        std::lock_guard<ProfiledMutex> lock(shard.lock);
+        for (Entry& entry : shard.stats) {
+            WakeLockInfo& info = entry.info;
+            if (info.isActive) {
+                TimestampType timeDelta = timeNow - info.lastChange;
+                info.activeTime += timeDelta;
+                info.maxTime = std::max(info.maxTime, info.activeTime);
+                info.totalTime += timeDelta;
+                info.lastChange = timeNow;
+            }
         }
     }
 }
 
-void WakeLockEntryList::getWakeLockStats(std::vector<WakeLockInfo>* aidl_return) const {
-    // Under no circumstances should the lock be held while getting kernel wakelock stats
-    {
-        std::lock_guard<std::mutex> lock(mStatsLock);
-        for (const WakeLockInfo& entry : mStats) {
-            aidl_return->emplace_back(entry);
+/*
+ * Compares the kernel wakelock stats of snapshot with those of the previous read, and records the
+ * stamp of the last change of each of them. Kernel wakelocks that disappeared are forgotten and
+ * recorded as a removal.
+ */
+void WakeLockEntryList::trackKernelWakelockChangesLocked(KernelWakelockSnapshot* snapshot) const {
+    uint64_t generation = ++mKernelWakelockChangesGeneration;
+
+    snapshot->changeStamps.reserve(snapshot->stats.size());
+    for (const WakeLockInfo& info : snapshot->stats) {
+        auto [it, inserted] = mKernelWakelockChanges.try_emplace(info.name);
+        KernelWakelockChange& change = it->second;
+        bool changed = inserted;
+        for (size_t i = 0; i < kKernelWakelockStats.size(); i++) {
+            int64_t statVal = info.*kKernelWakelockStats[i].second;
+            if (inserted || change.values[i] != statVal) {
+                change.values[i] = statVal;
+                changed = true;
+            }
+        }
+        if (changed) {
+            change.stamp = mNextStamp++;
         }
+        change.generation = generation;
+        snapshot->changeStamps.push_back(change.stamp);
     }
-    getKernelWakelockStats(aidl_return);
+
+    bool removed = false;
+    for (auto it = mKernelWakelockChanges.begin(); it != mKernelWakelockChanges.end();) {
+        if (it->second.generation != generation) {
+            it = mKernelWakelockChanges.erase(it);
+            removed = true;
+        } else {
+            ++it;
+        }
+    }
+    if (removed) {
+        recordRemoval();
+    }
+
+    snapshot->stamp = mNextStamp++;
+}
+
+std::shared_ptr<WakeLockEntryList::KernelWakelockSnapshot>
+WakeLockEntryList::readKernelWakelockSnapshotLocked() const {
+    auto snapshot = std::make_shared<KernelWakelockSnapshot>();
+    snapshot->sampleTime = getTimeNow();
+    getKernelWakelockStatsLocked(&snapshot->stats);
+    trackKernelWakelockChangesLocked(snapshot.get());
+    return snapshot;
+}
+
+/**
+ * Reads kernel wakelock stats and publishes them as the latest snapshot. The snapshot is published
+ * while mKernelWakelockLock is still held, so a concurrent refresh can never replace it with an
+ * older sample.
+ */
+std::shared_ptr<const WakeLockEntryList::KernelWakelockSnapshot>
+WakeLockEntryList::refreshKernelWakelockSnapshot() const {
+    std::lock_guard<std::mutex> lock(mKernelWakelockLock);
+    std::shared_ptr<const KernelWakelockSnapshot> snapshot = readKernelWakelockSnapshotLocked();
+    std::atomic_store(&mKernelWakelockSnapshot, snapshot);
+    return snapshot;
+}
+
+void WakeLockEntryList::startKernelWakelockSampler(std::chrono::milliseconds interval) {
+    if (mKernelWakelockSamplerEnabled) {
+        LOG(ERROR) << "Kernel wakelock sampler already started";
+        return;
+    }
+
+    // Publish a first snapshot before any query can observe the sampler as enabled.
+    refreshKernelWakelockSnapshot();
+    mKernelWakelockSamplerThread = std::thread(&WakeLockEntryList::kernelWakelockSamplerLoop, this,
+                                               interval);
+    mKernelWakelockSamplerEnabled = true;
+}
+
+void WakeLockEntryList::kernelWakelockSamplerLoop(std::chrono::milliseconds interval) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mKernelWakelockSamplerLock);
+            if (mKernelWakelockSamplerCondVar.wait_for(lock, interval, [this] {
+                    android::base::ScopedLockAssertion lock_assertion(mKernelWakelockSamplerLock);
+                    return mKernelWakelockSamplerStopped;
+                })) {
+                return;
+            }
+        }
+        refreshKernelWakelockSnapshot();
+    }
+}
+
+WakeLockEntryList::~WakeLockEntryList() {
+    if (mKernelWakelockSamplerThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mKernelWakelockSamplerLock);
+            mKernelWakelockSamplerStopped = true;
+        }
+        mKernelWakelockSamplerCondVar.notify_all();
+        mKernelWakelockSamplerThread.join();
+    }
+}
+
+/**
+ * Copies the native stats shard by shard, holding one shard lock at a time, and merges them in
+ * MRU order. Only entries changed since sinceStamp and active entries, whose times change without
+ * taking a new stamp, are copied. Entries inserted but not yet evicted by a concurrent writer are
+ * trimmed so that a snapshot never exceeds the capacity.
+ */
+void WakeLockEntryList::getNativeWakeLockStats(uint64_t sinceStamp,
+                                               std::vector<WakeLockInfo>* aidl_return) const {
+    // Copies of the entries without their hold time histograms.
+    struct NativeStat {
+        WakeLockName name;
+        WakeLockInfo info;
+        uint64_t stamp;
+    };
+    std::vector<NativeStat> nativeStats;
+    for (const Shard& shard : mShards) {
+        std::lock_guard<ProfiledMutex> lock(shard.lock);
+        // Entries are ordered by stamp, all changed entries are at the front of the list.
+        auto entry = shard.stats.begin();
+        for (; entry != shard.stats.end() && entry->stamp >= sinceStamp; ++entry) {
+            nativeStats.push_back({entry->name, entry->info, entry->stamp});
+        }
+        for (; entry != shard.stats.end(); ++entry) {
+            if (entry->info.isActive) {
+                nativeStats.push_back({entry->name, entry->info, entry->stamp});
+            }
+        }
+    }
+    std::sort(nativeStats.begin(), nativeStats.end(),
+              [](const NativeStat& a, const NativeStat& b) { return a.stamp > b.stamp; });
+    if (nativeStats.size() > mCapacity) {
+        nativeStats.erase(nativeStats.begin() + mCapacity, nativeStats.end());
+    }
+    for (NativeStat& stat : nativeStats) {
+        stat.info.name = stat.name.str();
+        aidl_return->emplace_back(std::move(stat.info));
+    }
+}
+
+void WakeLockEntryList::getNativeWakeLockStats(std::vector<WakeLockInfo>* aidl_return) const {
+    getNativeWakeLockStats(0, aidl_return);
+}
+
+void WakeLockEntryList::setHoldTimeHistogramSize(size_t bytesPerEntry) {
+    mHoldTimeHistogramPrecision = DurationHistogram::precisionForSize(bytesPerEntry);
+}
+
+void WakeLockEntryList::getHoldTimeStats(std::vector<WakeLockHoldTimeInfo>* aidl_return) const {
+    for (const Shard& shard : mShards) {
+        std::lock_guard<ProfiledMutex> lock(shard.lock);
+        for (const Entry& entry : shard.stats) {
+            const DurationHistogram& holdTimes = entry.holdTimes;
+            if (holdTimes.count() == 0) {
+                continue;
+            }
+            WakeLockHoldTimeInfo info;
+            info.name = entry.name.str();
+            info.pid = entry.info.pid;
+            info.count = holdTimes.count();
+            info.p50Millis = holdTimes.percentile(50);
+            info.p90Millis = holdTimes.percentile(90);
+            info.p99Millis = holdTimes.percentile(99);
+            info.maxMillis = holdTimes.max();
+            info.maxErrorPercent = 100 >> (holdTimes.precision() - 1);
+            aidl_return->push_back(std::move(info));
+        }
+    }
+}
+
+void WakeLockEntryList::getLockStats(std::vector<LockStats>* stats) const {
+    LockStats shardStats;
+    shardStats.name = mShards[0].lock.name();
+    for (const Shard& shard : mShards) {
+        shard.lock.addStats(&shardStats);
+    }
+    stats->push_back(std::move(shardStats));
+}
+
+/**
+ * Returns the kernel wakelock stats to report. Without the sampler they are read at query time,
+ * otherwise reading them only costs taking a reference to the latest snapshot.
+ */
+std::shared_ptr<const WakeLockEntryList::KernelWakelockSnapshot>
+WakeLockEntryList::getKernelWakelockSnapshot(bool forceRefresh) const {
+    if (!mKernelWakelockSamplerEnabled) {
+        std::lock_guard<std::mutex> lock(mKernelWakelockLock);
+        return readKernelWakelockSnapshotLocked();
+    }
+    return forceRefresh ? refreshKernelWakelockSnapshot()
+                        : std::atomic_load(&mKernelWakelockSnapshot);
+}
+
+void WakeLockEntryList::getKernelWakelockStats(const KernelWakelockSnapshot& snapshot,
+                                               uint64_t sinceStamp, bool forceRefresh,
+                                               std::vector<WakeLockInfo>* aidl_return) const {
+    TimestampType sampleAge = (!mKernelWakelockSamplerEnabled || forceRefresh)
+                                  ? 0
+                                  : getTimeNow() - snapshot.sampleTime;
+    for (size_t i = 0; i < snapshot.stats.size(); i++) {
+        if (snapshot.changeStamps[i] >= sinceStamp) {
+            aidl_return->emplace_back(snapshot.stats[i]).sampleAgeMillis = sampleAge;
+        }
+    }
+}
+
+void WakeLockEntryList::getWakeLockStats(std::vector<WakeLockInfo>* aidl_return,
+                                         bool forceRefresh) const {
+    // Under no circumstances should a lock be held while getting kernel wakelock stats
+    getNativeWakeLockStats(0, aidl_return);
+    getKernelWakelockStats(*getKernelWakelockSnapshot(forceRefresh), 0, forceRefresh, aidl_return);
+}
+
+/**
+ * Kernel stats read after the kernel wakelock snapshot take stamps larger than the snapshot stamp.
+ * A native stat changed after nextGeneration is read takes a stamp no smaller than it, since stamps
+ * are taken under the shard lock that is held while copying the shard. The returned generation is
+ * the smaller of both, so no change is missed by the next query. The kernel wakelock snapshot is
+ * taken first so that, unless it is an older sample, the returned generation is its own.
+ */
+void WakeLockEntryList::getWakeLockStatsDelta(int64_t generation,
+                                              WakeLockStatsDelta* aidl_return) const {
+    uint64_t sinceStamp = std::max<int64_t>(generation, 0);
+
+    std::shared_ptr<const KernelWakelockSnapshot> snapshot = getKernelWakelockSnapshot(false);
+    uint64_t nextGeneration = mNextStamp.load();
+    std::vector<WakeLockInfo> stats;
+    getNativeWakeLockStats(sinceStamp, &stats);
+
+    // Only checked after copying the stats, so that any removal they reflect is seen here.
+    bool isFullUpdate = sinceStamp == 0 || mLastRemovalStamp.load() >= sinceStamp;
+    if (isFullUpdate && sinceStamp != 0) {
+        sinceStamp = 0;
+        stats.clear();
+        getNativeWakeLockStats(sinceStamp, &stats);
+    }
+    getKernelWakelockStats(*snapshot, sinceStamp, false, &stats);
+
+    aidl_return->generation = std::min(nextGeneration, snapshot->stamp + 1);
+    aidl_return->isFullUpdate = isFullUpdate;
+    aidl_return->stats = std::move(stats);
 }
 
 }  // namespace V1_0
@@ -18,16 +18,31 @@
 #define ANDROID_SYSTEM_SUSPEND_WAKE_LOCK_ENTRY_LIST_H
 
 #include <android-base/unique_fd.h>
+#include <android/system/suspend/internal/WakeLockHoldTimeInfo.h>
 #include <android/system/suspend/internal/WakeLockInfo.h>
+#include <android/system/suspend/internal/WakeLockStatsDelta.h>
+#include <dirent.h>
 #include <utils/Mutex.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "DurationHistogram.h"
+#include "ProfiledMutex.h"
+#include "WakeLockName.h"
+
+using ::android::system::suspend::internal::WakeLockHoldTimeInfo;
 using ::android::system::suspend::internal::WakeLockInfo;
+using ::android::system::suspend::internal::WakeLockStatsDelta;
 
 namespace android {
 namespace system {
@@ -43,41 +58,196 @@ using TimestampType = int64_t;
  */
 class WakeLockEntryList {
    public:
+    // kernelWakelockStatsFd is either the /sys/class/wakeup directory, with one directory per
+    // wakeup source, or a file holding the consolidated wakeup_sources table.
     WakeLockEntryList(size_t capacity, unique_fd kernelWakelockStatsFd);
-    void updateOnAcquire(const std::string& name, int pid);
-    void updateOnRelease(const std::string& name, int pid);
+    ~WakeLockEntryList();
+    // Starts a thread sampling kernel wakelock stats every interval. Afterwards, getWakeLockStats()
+    // reports the latest sample instead of reading the kernel stats at query time.
+    void startKernelWakelockSampler(std::chrono::milliseconds interval);
+    // Records the hold durations of native wake locks in histograms of at most bytesPerEntry
+    // each, 0 to not record them. Only applies to stats entries created afterwards.
+    void setHoldTimeHistogramSize(size_t bytesPerEntry);
+    void updateOnAcquire(const WakeLockName& name, int pid);
+    void updateOnRelease(const WakeLockName& name, int pid);
+    // Batched variants sample the current time only once.
+    void updateOnAcquire(const std::vector<WakeLockName>& names, int pid);
+    void updateOnRelease(const std::vector<WakeLockName>& names, int pid);
     // updateNow() should be called before getWakeLockStats() to ensure stats are
     // updated wrt the current time.
     void updateNow();
-    void getWakeLockStats(std::vector<WakeLockInfo>* aidl_return) const;
+    // If forceRefresh is true, kernel wakelock stats are read at query time even if the sampler is
+    // running, and the sample is replaced with the result.
+    void getWakeLockStats(std::vector<WakeLockInfo>* aidl_return, bool forceRefresh = false) const;
+    // Returns the stats changed since the query that returned generation, or all stats if
+    // generation is 0 or stats were removed since then.
+    void getWakeLockStatsDelta(int64_t generation, WakeLockStatsDelta* aidl_return) const;
+    // Returns the native wake lock stats only.
+    void getNativeWakeLockStats(std::vector<WakeLockInfo>* aidl_return) const;
+    // Returns the hold time percentiles of the native wake locks released at least once since
+    // their hold durations are recorded.
+    void getHoldTimeStats(std::vector<WakeLockHoldTimeInfo>* aidl_return) const;
+    // Appends the contention stats of the shard locks, merged into one entry.
+    void getLockStats(std::vector<LockStats>* stats) const;
     friend std::ostream& operator<<(std::ostream& out, const WakeLockEntryList& list);
 
    private:
-    void evictIfFull() REQUIRES(mStatsLock);
-    void insertEntry(WakeLockInfo entry) REQUIRES(mStatsLock);
-    void deleteEntry(std::list<WakeLockInfo>::iterator entry) REQUIRES(mStatsLock);
-    WakeLockInfo createNativeEntry(const std::string& name, int pid, TimestampType timeNow) const;
-    WakeLockInfo createKernelEntry(const std::string& name) const;
-    void getKernelWakelockStats(std::vector<WakeLockInfo>* aidl_return) const;
-
-    // Hash for WakeLockEntry key (pair<std::string, int>)
+    // WakeLockEntry key, the interned name id and pid.
+    using LockKey = std::pair<WakeLockNameId, int>;
+
+    // Hash for WakeLockEntry key (pair<WakeLockNameId, int>)
     struct LockHash {
-        std::size_t operator()(const std::pair<std::string, int>& key) const {
-            return std::hash<std::string>()(key.first) ^ std::hash<int>()(key.second);
+        std::size_t operator()(const LockKey& key) const {
+            return std::hash<WakeLockNameId>()(key.first) ^ std::hash<int>()(key.second);
         }
     };
 
+    struct Entry {
+        // Keeps the name interned for as long as the entry exists. info.name is left empty and
+        // only filled in when stats are reported.
+        WakeLockName name;
+        WakeLockInfo info;
+        // Global recency stamp, a larger stamp is more recently used. Every change to the entry
+        // other than the time updates of an active entry takes a new stamp.
+        uint64_t stamp;
+        // Durations of the completed holds of the wake lock.
+        DurationHistogram holdTimes;
+    };
+
+    // Native stats are split across shards by hash of (name, pid) so that updates to
+    // unrelated wake locks do not contend on a single lock. Each shard keeps its own
+    // LRU list, ordered by stamp, with the LRU stat at the back of the list. Updates to an
+    // existing stat are done in place and the node is spliced to the front.
+    struct Shard {
+        mutable ProfiledMutex lock{"WakeLockEntryList::Shard::lock"};
+        std::list<Entry> stats GUARDED_BY(lock);
+        std::unordered_map<LockKey, std::list<Entry>::iterator, LockHash> lookupTable
+            GUARDED_BY(lock);
+    };
+
+    static constexpr size_t kNumShards = 16;
+
+    Shard& getShard(const WakeLockName& name, int pid);
+    void updateOnAcquireLocked(Shard& shard, const WakeLockName& name, int pid,
+                               TimestampType timeNow) REQUIRES(shard.lock);
+    void updateOnReleaseLocked(Shard& shard, const WakeLockName& name, int pid,
+                               TimestampType timeNow) REQUIRES(shard.lock);
+    void evictIfFull();
+    void evictOldest();
+    void insertEntry(Shard& shard, const WakeLockName& name, WakeLockInfo entry)
+        REQUIRES(shard.lock);
+    void promoteEntry(Shard& shard, std::list<Entry>::iterator entry) REQUIRES(shard.lock);
+    void deleteEntry(Shard& shard, std::list<Entry>::iterator entry) REQUIRES(shard.lock);
+    void recordRemoval() const;
+    WakeLockInfo createNativeEntry(int pid, TimestampType timeNow) const;
+    void getNativeWakeLockStats(uint64_t sinceStamp, std::vector<WakeLockInfo>* aidl_return) const;
+
+    // Number of per wakeup source stat files read for each kernel wakelock, excluding its name.
+    static constexpr size_t kNumKernelWakelockStats = 9;
+
+    // Number of stat fds kept open between queries, also limited to half of RLIMIT_NOFILE. The
+    // stat files of up to 455 wakeup sources stay open, the others are reopened on every query.
+    static constexpr size_t kMaxOpenKernelWakelockStatFds = 4096;
+
+    // A wakeup source directory in mKernelWakelockStatsFd, with its name read once. Its stat files
+    // are kept open and read with pread() while the fd budget allows it.
+    struct KernelWakelockSource {
+        ino_t ino;
+        std::string name;
+        // Indexed like kKernelWakelockStats, empty if the stat files are not kept open.
+        std::vector<unique_fd> statFds;
+        // False if the directory or the name could not be read, in which case opening the source
+        // is retried on the next query.
+        bool complete;
+        uint64_t generation;
+    };
+
+    KernelWakelockSource openKernelWakelockSource(const std::string& kwlId, ino_t ino) const
+        REQUIRES(mKernelWakelockLock);
+    void openKernelWakelockStatsLocked(int dirFd, const std::string& kwlId,
+                                       KernelWakelockSource* source) const
+        REQUIRES(mKernelWakelockLock);
+    void closeKernelWakelockSourceLocked(KernelWakelockSource* source) const
+        REQUIRES(mKernelWakelockLock);
+    WakeLockInfo createKernelEntryLocked(const std::string& kwlId,
+                                         KernelWakelockSource* source) const
+        REQUIRES(mKernelWakelockLock);
+    // Kernel wakelock stats, either read at query time or published by the sampler. Snapshots are
+    // immutable once published, the published pointer is only accessed through std::atomic_load()
+    // and std::atomic_store().
+    struct KernelWakelockSnapshot {
+        std::vector<WakeLockInfo> stats;
+        // Stamp of the last change of each of stats.
+        std::vector<uint64_t> changeStamps;
+        // Taken after all changeStamps, changes read by later snapshots get larger stamps.
+        uint64_t stamp;
+        TimestampType sampleTime;
+    };
+
+    // Last values of a kernel wakelock, to detect which kernel wakelocks changed between reads.
+    struct KernelWakelockChange {
+        std::array<int64_t, kNumKernelWakelockStats> values;
+        uint64_t stamp;
+        uint64_t generation;
+    };
+
+    std::shared_ptr<KernelWakelockSnapshot> readKernelWakelockSnapshotLocked() const
+        REQUIRES(mKernelWakelockLock);
+    std::shared_ptr<const KernelWakelockSnapshot> refreshKernelWakelockSnapshot() const;
+    std::shared_ptr<const KernelWakelockSnapshot> getKernelWakelockSnapshot(
+        bool forceRefresh) const;
+    void getKernelWakelockStats(const KernelWakelockSnapshot& snapshot, uint64_t sinceStamp,
+                                bool forceRefresh, std::vector<WakeLockInfo>* aidl_return) const;
+    void kernelWakelockSamplerLoop(std::chrono::milliseconds interval);
+    void trackKernelWakelockChangesLocked(KernelWakelockSnapshot* snapshot) const
+        REQUIRES(mKernelWakelockLock);
+    void getKernelWakelockStatsLocked(std::vector<WakeLockInfo>* aidl_return) const
+        REQUIRES(mKernelWakelockLock);
+    void getKernelWakelockStatsFromDirectoryLocked(std::vector<WakeLockInfo>* aidl_return) const
+        REQUIRES(mKernelWakelockLock);
+    void getKernelWakelockStatsFromTableLocked(std::vector<WakeLockInfo>* aidl_return) const
+        REQUIRES(mKernelWakelockLock);
+
     size_t mCapacity;
     unique_fd mKernelWakelockStatsFd;
+    // True if mKernelWakelockStatsFd is a wakeup_sources table rather than a directory.
+    bool mKernelWakelockStatsIsTable;
+
+    // Wakeup sources are re-listed on every query, but only new or replaced sources are opened.
+    mutable std::mutex mKernelWakelockLock;
+    std::unique_ptr<DIR, decltype(&closedir)> mKernelWakelockStatsDir GUARDED_BY(
+        mKernelWakelockLock);
+    mutable std::unordered_map<std::string, KernelWakelockSource> mKernelWakelockSources
+        GUARDED_BY(mKernelWakelockLock);
+    mutable uint64_t mKernelWakelockGeneration GUARDED_BY(mKernelWakelockLock) = 0;
+    // Number of KernelWakelockSource::statFds open, within mMaxOpenKernelWakelockStatFds.
+    mutable size_t mNumOpenKernelWakelockStatFds GUARDED_BY(mKernelWakelockLock) = 0;
+    size_t mMaxOpenKernelWakelockStatFds;
+    // Reused across queries to read the whole wakeup_sources table.
+    mutable std::vector<char> mKernelWakeupSourcesBuffer GUARDED_BY(mKernelWakelockLock);
+    // Keyed by kernel wakelock name.
+    mutable std::unordered_map<std::string, KernelWakelockChange> mKernelWakelockChanges
+        GUARDED_BY(mKernelWakelockLock);
+    mutable uint64_t mKernelWakelockChangesGeneration GUARDED_BY(mKernelWakelockLock) = 0;
 
-    mutable std::mutex mStatsLock;
+    std::atomic<bool> mKernelWakelockSamplerEnabled{false};
+    mutable std::shared_ptr<const KernelWakelockSnapshot> mKernelWakelockSnapshot;
+    std::thread mKernelWakelockSamplerThread;
+    std::mutex mKernelWakelockSamplerLock;
+    std::condition_variable mKernelWakelockSamplerCondVar;
+    bool mKernelWakelockSamplerStopped GUARDED_BY(mKernelWakelockSamplerLock) = false;
 
-    // std::list and std::unordered map are used to support both inserting a stat
-    // and eviction of the LRU stat in O(1) time. The LRU stat is maintained at
-    // the back of the list.
-    std::list<WakeLockInfo> mStats GUARDED_BY(mStatsLock);
-    std::unordered_map<std::pair<std::string, int>, std::list<WakeLockInfo>::iterator, LockHash>
-        mLookupTable GUARDED_BY(mStatsLock);
+    std::array<Shard, kNumShards> mShards;
+    // Precision of the hold time histograms of new entries, 0 if they are disabled.
+    std::atomic<uint8_t> mHoldTimeHistogramPrecision{0};
+    // Number of native stats entries across all shards, excluding entries that are already
+    // claimed for eviction.
+    std::atomic<size_t> mSize{0};
+    // Also stamps kernel wakelock changes, so that a single generation covers both.
+    mutable std::atomic<uint64_t> mNextStamp{1};
+    // Stamp of the last removal of a native or kernel wakelock stat. Deltas since an older
+    // generation can not express the removal and are sent as full updates instead.
+    mutable std::atomic<uint64_t> mLastRemovalStamp{0};
 };
 
 }  // namespace V1_0
@@ -0,0 +1,241 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "WakeLockEntryList.h"
+
+using android::base::unique_fd;
+using android::base::WriteStringToFile;
+using android::system::suspend::V1_0::WakeLockEntryList;
+using android::system::suspend::V1_0::WakeLockName;
+
+// Counts heap allocations made by the calling thread, so that benchmarks can report how many
+// allocations a stats update performs, and the heap bytes in use by the process.
+static thread_local size_t sAllocations = 0;
+static std::atomic<size_t> sLiveBytes = 0;
+
+void* operator new(size_t size) {
+    sAllocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    sLiveBytes += malloc_usable_size(p);
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr) {
+        sLiveBytes -= malloc_usable_size(p);
+    }
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+static constexpr size_t kCapacity = 64;
+
+// Acquires and releases a wake lock that already has a stats entry, i.e. the steady state of a
+// client that repeatedly takes the same wake lock. Expected to report zero allocations.
+static void BM_updateKnownWakeLock(benchmark::State& state) {
+    static WakeLockEntryList* entryList = nullptr;
+    if (state.thread_index() == 0) {
+        entryList = new WakeLockEntryList(kCapacity, unique_fd());
+    }
+    const WakeLockName name("BenchmarkWakeLock" + std::to_string(state.thread_index()));
+    const int pid = state.thread_index();
+
+    size_t allocations = 0;
+    for (auto _ : state) {
+        // The first update inserts the stats entry, which is expected to allocate.
+        entryList->updateOnAcquire(name, pid);
+        size_t start = sAllocations;
+        entryList->updateOnRelease(name, pid);
+        entryList->updateOnAcquire(name, pid);
+        entryList->updateOnRelease(name, pid);
+        allocations += sAllocations - start;
+    }
+    state.counters["allocs_per_iter"] = static_cast<double>(allocations) / state.iterations();
+
+    if (state.thread_index() == 0) {
+        delete entryList;
+        entryList = nullptr;
+    }
+}
+BENCHMARK(BM_updateKnownWakeLock)->ThreadRange(1, 8);
+
+// Acquires range(0) distinct wake locks in a full stats table, so that every acquire evicts the
+// LRU entry.
+static void BM_updateEvictingWakeLock(benchmark::State& state) {
+    WakeLockEntryList entryList(kCapacity, unique_fd());
+    std::vector<WakeLockName> names;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        names.emplace_back("BenchmarkWakeLock" + std::to_string(i));
+    }
+
+    for (auto _ : state) {
+        for (const auto& name : names) {
+            entryList.updateOnAcquire(name, 0);
+            entryList.updateOnRelease(name, 0);
+        }
+    }
+}
+BENCHMARK(BM_updateEvictingWakeLock)->Arg(kCapacity * 2);
+
+// Acquires and releases range(0) distinct wake locks the way a binder call does, starting from the
+// name received as a string. Also reports the heap bytes retained by the stats of those wake locks
+// while each of them is held by one client.
+static void BM_acquireDistinctWakeLocks(benchmark::State& state) {
+    std::vector<std::string> names;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        names.push_back("com.example.app/BenchmarkWakeLock" + std::to_string(i));
+    }
+
+    size_t liveBytesBefore = sLiveBytes;
+    {
+        WakeLockEntryList entryList(names.size(), unique_fd());
+        std::vector<WakeLockName> held;
+        for (const auto& name : names) {
+            held.emplace_back(name);
+            entryList.updateOnAcquire(held.back(), 0);
+        }
+        state.counters["retained_bytes"] = sLiveBytes - liveBytesBefore;
+    }
+
+    WakeLockEntryList entryList(names.size(), unique_fd());
+    for (auto _ : state) {
+        for (const auto& name : names) {
+            WakeLockName wlName(name);
+            entryList.updateOnAcquire(wlName, 0);
+            entryList.updateOnRelease(wlName, 0);
+        }
+    }
+}
+BENCHMARK(BM_acquireDistinctWakeLocks)->Arg(1000);
+
+// Queries stats of range(0) kernel wakeup sources laid out like /sys/class/wakeup.
+static void BM_getKernelWakelockStats(benchmark::State& state) {
+    static const char* const kStatNames[] = {
+        "active_count",
+        "active_time_ms",
+        "event_count",
+        "expire_count",
+        "last_change_ms",
+        "max_time_ms",
+        "prevent_suspend_time_ms",
+        "total_time_ms",
+        "wakeup_count",
+    };
+
+    TemporaryDir kernelWakelockStatsDir;
+    std::vector<std::string> paths;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        std::string dir = std::string(kernelWakelockStatsDir.path) + "/wakeup" + std::to_string(i);
+        mkdir(dir.c_str(), S_IRWXU);
+        paths.push_back(dir);
+        WriteStringToFile("BenchmarkKernelWakeLock" + std::to_string(i) + "\n", dir + "/name");
+        for (const char* statName : kStatNames) {
+            WriteStringToFile("42\n", dir + "/" + statName);
+            paths.push_back(dir + "/" + statName);
+        }
+        paths.push_back(dir + "/name");
+    }
+
+    WakeLockEntryList entryList(
+        0, unique_fd(open(kernelWakelockStatsDir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY)));
+    for (auto _ : state) {
+        std::vector<WakeLockInfo> wlStats;
+        entryList.getWakeLockStats(&wlStats);
+    }
+
+    // TemporaryDir only removes empty directories.
+    for (auto it = paths.rbegin(); it != paths.rend(); ++it) {
+        remove(it->c_str());
+    }
+}
+BENCHMARK(BM_getKernelWakelockStats)->Arg(100);
+
+// Queries stats of range(0) kernel wakeup sources from a consolidated wakeup_sources table.
+static void BM_getKernelWakelockStatsFromTable(benchmark::State& state) {
+    TemporaryFile table;
+    std::string content =
+        "name\t\tactive_count\tevent_count\twakeup_count\texpire_count\tactive_since\t"
+        "total_time\tmax_time\tlast_change\tprevent_suspend_time\n";
+    for (int64_t i = 0; i < state.range(0); i++) {
+        content += "BenchmarkKernelWakeLock" + std::to_string(i) +
+                   "\t42\t42\t42\t42\t42\t42\t42\t42\t42\n";
+    }
+    WriteStringToFile(content, table.path);
+
+    WakeLockEntryList entryList(0, unique_fd(open(table.path, O_CLOEXEC | O_RDONLY)));
+    for (auto _ : state) {
+        std::vector<WakeLockInfo> wlStats;
+        entryList.getWakeLockStats(&wlStats);
+    }
+}
+BENCHMARK(BM_getKernelWakelockStatsFromTable)->Arg(100);
+
+// Polls the stats of a full native stats table while a few wake locks are used between polls,
+// either with full queries or, if range(0) is 1, with delta queries. Reports the number of stats
+// returned per query.
+static void BM_pollWakeLockStats(benchmark::State& state) {
+    static constexpr size_t kNumWakeLocks = 1000;
+    static constexpr size_t kNumUsedWakeLocks = 10;
+    const bool delta = state.range(0) == 1;
+
+    WakeLockEntryList entryList(kNumWakeLocks, unique_fd());
+    std::vector<WakeLockName> names;
+    for (size_t i = 0; i < kNumWakeLocks; i++) {
+        names.emplace_back("BenchmarkWakeLock" + std::to_string(i));
+        entryList.updateOnAcquire(names.back(), 0);
+        entryList.updateOnRelease(names.back(), 0);
+    }
+
+    WakeLockStatsDelta statsDelta;
+    entryList.getWakeLockStatsDelta(0, &statsDelta);
+    size_t numStats = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < kNumUsedWakeLocks; i++) {
+            entryList.updateOnAcquire(names[i], 0);
+            entryList.updateOnRelease(names[i], 0);
+        }
+        if (delta) {
+            entryList.getWakeLockStatsDelta(statsDelta.generation, &statsDelta);
+            numStats += statsDelta.stats.size();
+        } else {
+            std::vector<WakeLockInfo> wlStats;
+            entryList.getWakeLockStats(&wlStats);
+            numStats += wlStats.size();
+        }
+    }
+    state.counters["stats_per_query"] = static_cast<double>(numStats) / state.iterations();
+}
+BENCHMARK(BM_pollWakeLockStats)->ArgName("delta")->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WakeLockName.h"
+
+#include <tuple>
+#include <utility>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+WakeLockNameTable& WakeLockNameTable::getInstance() {
+    // Intentionally leaked, handles may outlive static destruction.
+    static WakeLockNameTable* table = new WakeLockNameTable();
+    return *table;
+}
+
+size_t WakeLockNameTable::size() const {
+    size_t size = 0;
+    for (const Shard& shard : mShards) {
+        std::lock_guard<std::mutex> lock(shard.lock);
+        size += shard.nodes.size();
+    }
+    return size;
+}
+
+/**
+ * Returns the node for name with one reference taken on behalf of the caller, creating it if the
+ * name is not interned yet.
+ */
+WakeLockNameTable::Node* WakeLockNameTable::intern(std::string_view name) {
+    size_t shardIndex = std::hash<std::string_view>()(name) % kNumShards;
+    Shard& shard = mShards[shardIndex];
+
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto it = shard.nodes.find(name);
+    if (it != shard.nodes.end()) {
+        it->second.refs++;
+        return &it->second;
+    }
+
+    WakeLockNameId index;
+    if (shard.freeIds.empty()) {
+        index = shard.nextIndex++;
+    } else {
+        index = shard.freeIds.back();
+        shard.freeIds.pop_back();
+    }
+
+    // Insert with a key viewing the caller's name, then rekey the map node to view its own copy
+    // of the name. Map nodes never move, so the returned pointer stays valid until erased.
+    it = shard.nodes.emplace(std::piecewise_construct, std::forward_as_tuple(name),
+                             std::forward_as_tuple())
+             .first;
+    auto nodeHandle = shard.nodes.extract(it);
+    Node& node = nodeHandle.mapped();
+    node.name = std::string(name);
+    node.id = (index << kNumShardBits) | shardIndex;
+    node.refs = 1;
+    node.watchers = 0;
+    node.patternMatchCache = 0;
+    nodeHandle.key() = node.name;
+    return &shard.nodes.insert(std::move(nodeHandle)).position->second;
+}
+
+/**
+ * Drops one reference to node, removing it from the table once the last reference is gone.
+ * Dropping a reference that is not the last one does not take a lock.
+ */
+void WakeLockNameTable::release(Node* node) {
+    uint32_t refs = node->refs.load();
+    while (refs > 1) {
+        if (node->refs.compare_exchange_weak(refs, refs - 1)) {
+            return;
+        }
+    }
+
+    // References are only added from zero by intern(), which holds the shard lock, so the count
+    // seen under the lock is final once it drops to zero.
+    Shard& shard = mShards[node->id & (kNumShards - 1)];
+    std::lock_guard<std::mutex> lock(shard.lock);
+    if (--node->refs == 0) {
+        shard.freeIds.push_back(node->id >> kNumShardBits);
+        shard.nodes.erase(shard.nodes.find(node->name));
+    }
+}
+
+WakeLockName::WakeLockName(std::string_view name)
+    : mNode(WakeLockNameTable::getInstance().intern(name)) {}
+
+WakeLockName::WakeLockName(const WakeLockName& other) : mNode(other.mNode) {
+    if (mNode) {
+        mNode->refs++;
+    }
+}
+
+WakeLockName::WakeLockName(WakeLockName&& other) noexcept : mNode(other.mNode) {
+    other.mNode = nullptr;
+}
+
+WakeLockName& WakeLockName::operator=(WakeLockName other) noexcept {
+    std::swap(mNode, other.mNode);
+    return *this;
+}
+
+WakeLockName::~WakeLockName() {
+    if (mNode) {
+        WakeLockNameTable::getInstance().release(mNode);
+    }
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
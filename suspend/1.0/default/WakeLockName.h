@@ -0,0 +1,124 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_WAKE_LOCK_NAME_H
+#define ANDROID_SYSTEM_SUSPEND_WAKE_LOCK_NAME_H
+
+#include <android-base/thread_annotations.h>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using WakeLockNameId = uint32_t;
+
+class WakeLockName;
+
+/*
+ * Process-wide table of interned wake lock names. Each distinct name is stored once and assigned
+ * a compact id for as long as a WakeLockName handle refers to it; ids of names that are no longer
+ * referenced are reused.
+ * This class is thread safe.
+ */
+class WakeLockNameTable {
+   public:
+    static WakeLockNameTable& getInstance();
+
+    // Returns the number of distinct names currently interned.
+    size_t size() const;
+
+   private:
+    friend class WakeLockName;
+
+    struct Node {
+        std::string name;
+        WakeLockNameId id;
+        std::atomic<uint32_t> refs;
+        std::atomic<uint32_t> watchers;
+        std::atomic<uint64_t> patternMatchCache;
+    };
+
+    // Names are split across shards by hash, the low bits of an id identify its shard.
+    static constexpr size_t kNumShardBits = 4;
+    static constexpr size_t kNumShards = 1 << kNumShardBits;
+
+    struct Shard {
+        mutable std::mutex lock;
+        // Keys view the name owned by the mapped node.
+        std::unordered_map<std::string_view, Node> nodes GUARDED_BY(lock);
+        std::vector<WakeLockNameId> freeIds GUARDED_BY(lock);
+        WakeLockNameId nextIndex GUARDED_BY(lock) = 0;
+    };
+
+    WakeLockNameTable() = default;
+
+    Node* intern(std::string_view name);
+    void release(Node* node);
+
+    std::array<Shard, kNumShards> mShards;
+};
+
+/*
+ * Reference counted handle to an interned wake lock name. Handles to the same name share a single
+ * copy of the string and compare and hash by id. Copying a handle never takes a lock.
+ */
+class WakeLockName {
+   public:
+    explicit WakeLockName(std::string_view name);
+    WakeLockName(const WakeLockName& other);
+    WakeLockName(WakeLockName&& other) noexcept;
+    WakeLockName& operator=(WakeLockName other) noexcept;
+    ~WakeLockName();
+
+    WakeLockNameId id() const { return mNode->id; }
+    const std::string& str() const { return mNode->name; }
+
+    // Watchers are interested in every acquisition and release of the name. Checking for them
+    // never takes a lock, so that names nobody watches cost nothing to skip.
+    void addWatcher() const { mNode->watchers++; }
+    void removeWatcher() const { mNode->watchers--; }
+    bool hasWatchers() const { return mNode->watchers.load(std::memory_order_relaxed) > 0; }
+    // Cached result of matching the name against wake lock name patterns, shared by all handles
+    // to the name. Its meaning is up to the owner of the patterns, see SuspendControlService.
+    uint64_t getPatternMatchCache() const {
+        return mNode->patternMatchCache.load(std::memory_order_relaxed);
+    }
+    void setPatternMatchCache(uint64_t cache) const {
+        mNode->patternMatchCache.store(cache, std::memory_order_relaxed);
+    }
+
+    bool operator==(const WakeLockName& other) const { return mNode == other.mNode; }
+    bool operator!=(const WakeLockName& other) const { return mNode != other.mNode; }
+
+   private:
+    WakeLockNameTable::Node* mNode;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_WAKE_LOCK_NAME_H
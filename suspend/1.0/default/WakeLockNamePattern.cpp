@@ -0,0 +1,83 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WakeLockNamePattern.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/**
+ * Returns true if segment matches name at pos, which must leave room for the whole segment.
+ */
+static bool matchesAt(std::string_view name, size_t pos, const std::string& segment) {
+    for (size_t i = 0; i < segment.size(); i++) {
+        if (segment[i] != '?' && segment[i] != name[pos + i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WakeLockNamePattern::isPattern(std::string_view name) {
+    return name.find_first_of("*?") != std::string_view::npos;
+}
+
+WakeLockNamePattern::WakeLockNamePattern(std::string_view pattern) : mPattern(pattern) {
+    size_t start = 0;
+    while (true) {
+        size_t end = pattern.find('*', start);
+        mSegments.emplace_back(pattern.substr(start, end - start));
+        if (end == std::string_view::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+bool WakeLockNamePattern::matches(std::string_view name) const {
+    const std::string& first = mSegments.front();
+    if (mSegments.size() == 1) {
+        return name.size() == first.size() && matchesAt(name, 0, first);
+    }
+
+    const std::string& last = mSegments.back();
+    if (name.size() < first.size() + last.size() || !matchesAt(name, 0, first) ||
+        !matchesAt(name, name.size() - last.size(), last)) {
+        return false;
+    }
+
+    // Match each segment in between as early as possible, leaving the most room for the next ones.
+    size_t pos = first.size();
+    size_t end = name.size() - last.size();
+    for (size_t i = 1; i + 1 < mSegments.size(); i++) {
+        const std::string& segment = mSegments[i];
+        while (pos + segment.size() <= end && !matchesAt(name, pos, segment)) {
+            pos++;
+        }
+        if (pos + segment.size() > end) {
+            return false;
+        }
+        pos += segment.size();
+    }
+    return true;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
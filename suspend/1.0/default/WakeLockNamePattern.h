@@ -0,0 +1,56 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_WAKE_LOCK_NAME_PATTERN_H
+#define ANDROID_SYSTEM_SUSPEND_WAKE_LOCK_NAME_PATTERN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * Glob pattern over wake lock names, where '*' matches any sequence of characters and '?' any
+ * single character. The pattern is compiled into the segments between its '*', which are matched
+ * left to right without backtracking.
+ */
+class WakeLockNamePattern {
+   public:
+    // Returns true if name holds wildcards, i.e. must be matched as a pattern.
+    static bool isPattern(std::string_view name);
+
+    explicit WakeLockNamePattern(std::string_view pattern);
+
+    bool matches(std::string_view name) const;
+    const std::string& str() const { return mPattern; }
+
+   private:
+    std::string mPattern;
+    // Parts of the pattern between '*'. The first one matches the start of a name and the last one
+    // its end, there is a single one if the pattern has no '*'.
+    std::vector<std::string> mSegments;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_WAKE_LOCK_NAME_PATTERN_H
@@ -19,6 +19,8 @@
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 
+#include <algorithm>
+
 namespace android {
 namespace system {
 namespace suspend {
@@ -29,37 +31,44 @@ WakeupList::WakeupList(size_t capacity) : mCapacity(capacity) {}
 void WakeupList::getWakeupStats(std::vector<WakeupInfo>* wakeups) const {
     std::scoped_lock lock(mLock);
 
-    for (const WakeupInfo& w : mWakeups) {
+    for (const auto& [w, hash] : mWakeups) {
         wakeups->push_back(w);
     }
 }
 
 void WakeupList::update(const std::vector<std::string>& wakeupReasons) {
-    if (wakeupReasons.empty()) {
+    WakeupReasons reasons;
+    reasons.parse(::android::base::Join(wakeupReasons, "\n"));
+    update(reasons);
+}
+
+void WakeupList::update(const WakeupReasons& wakeupReasons) {
+    if (wakeupReasons.get().empty()) {
         LOG(ERROR) << "WakeupList: empty wakeup reasons";
         return;
     }
-    std::string key = ::android::base::Join(wakeupReasons, ";");
+    uint64_t hash = wakeupReasons.hash();
 
     std::scoped_lock lock(mLock);
 
-    auto it = mLookupTable.find(key);
-    if (it == mLookupTable.end()) {
+    auto [begin, end] = mLookupTable.equal_range(hash);
+    auto it = std::find_if(begin, end, [&](const auto& entry) {
+        return wakeupReasons.equalsJoined(entry.second->first.name);
+    });
+    if (it == end) {
         // Create a new entry
         WakeupInfo w;
-        w.name = key;
+        w.name = wakeupReasons.join();
         w.count = 1;
 
-        insert(std::move(w));
+        insert(std::move(w), hash);
         evict();
     } else {
-        // Entry found. Increment the count
-        auto staleEntry = it->second;
-        WakeupInfo updatedEntry = *staleEntry;
-        updatedEntry.count++;
-
-        erase(staleEntry);
-        insert(std::move(updatedEntry));
+        // Entry found. Increment the count and move it to the front, this keeps the iterator in
+        // the lookup table valid.
+        auto entry = it->second;
+        entry->first.count++;
+        mWakeups.splice(mWakeups.begin(), mWakeups, entry);
     }
 }
 
@@ -71,13 +80,19 @@ void WakeupList::evict() {
     }
 }
 
-void WakeupList::insert(WakeupInfo entry) {
-    mWakeups.push_front(entry);
-    mLookupTable.insert_or_assign(entry.name, mWakeups.begin());
+void WakeupList::insert(WakeupInfo entry, uint64_t hash) {
+    mWakeups.emplace_front(std::move(entry), hash);
+    mLookupTable.emplace(hash, mWakeups.begin());
 }
 
-void WakeupList::erase(std::list<WakeupInfo>::iterator entry) {
-    mLookupTable.erase(entry->name);
+void WakeupList::erase(std::list<std::pair<WakeupInfo, uint64_t>>::iterator entry) {
+    auto [begin, end] = mLookupTable.equal_range(entry->second);
+    for (auto it = begin; it != end; ++it) {
+        if (it->second == entry) {
+            mLookupTable.erase(it);
+            break;
+        }
+    }
     mWakeups.erase(entry);
 }
 
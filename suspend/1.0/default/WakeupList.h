@@ -20,7 +20,11 @@
 #include <utils/Mutex.h>
 
 #include <list>
+#include <string>
 #include <unordered_map>
+#include <vector>
+
+#include "WakeupReasons.h"
 
 using ::android::system::suspend::internal::WakeupInfo;
 
@@ -38,16 +42,21 @@ class WakeupList {
     WakeupList(size_t capacity);
     void getWakeupStats(std::vector<WakeupInfo>* wakeups) const;
     void update(const std::vector<std::string>& wakeupReasons);
+    // Only allocates if the reasons are not in the list yet.
+    void update(const WakeupReasons& wakeupReasons);
 
    private:
     void evict() REQUIRES(mLock);
-    void insert(WakeupInfo entry) REQUIRES(mLock);
-    void erase(std::list<WakeupInfo>::iterator entry) REQUIRES(mLock);
+    void insert(WakeupInfo entry, uint64_t hash) REQUIRES(mLock);
+    void erase(std::list<std::pair<WakeupInfo, uint64_t>>::iterator entry) REQUIRES(mLock);
 
     size_t mCapacity;
     mutable std::mutex mLock;
-    std::list<WakeupInfo> mWakeups GUARDED_BY(mLock);
-    std::unordered_map<std::string, std::list<WakeupInfo>::iterator> mLookupTable GUARDED_BY(mLock);
+    // Entries with their WakeupReasons::hash(), most recently updated first.
+    std::list<std::pair<WakeupInfo, uint64_t>> mWakeups GUARDED_BY(mLock);
+    // Keyed by hash, the names of entries are compared on lookup to tell collisions apart.
+    std::unordered_multimap<uint64_t, std::list<std::pair<WakeupInfo, uint64_t>>::iterator>
+        mLookupTable GUARDED_BY(mLock);
 };
 
 }  // namespace V1_0
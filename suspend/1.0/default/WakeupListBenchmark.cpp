@@ -0,0 +1,105 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "WakeupList.h"
+#include "WakeupReasons.h"
+
+using android::base::unique_fd;
+using android::base::WriteStringToFile;
+using android::system::suspend::V1_0::WakeupList;
+using android::system::suspend::V1_0::WakeupReasons;
+
+// Counts heap allocations made by the calling thread, so that benchmarks can report how many
+// allocations the resume path performs.
+static thread_local size_t sAllocations = 0;
+
+void* operator new(size_t size) {
+    sAllocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static constexpr size_t kCapacity = 32;
+
+// Reads range(0) wakeup reason lines from a file laid out like
+// /sys/kernel/wakeup_reasons/last_resume_reason and records them in the wakeup stats, i.e. what
+// the autosuspend thread does on every resume. The reasons are already known after the first
+// iteration, so this is expected to report zero allocations.
+static void BM_readAndRecordWakeupReasons(benchmark::State& state) {
+    TemporaryFile file;
+    std::string content;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        content += std::to_string(100 + i) + " :android,benchmark-wakeup-reason-" +
+                   std::to_string(i) + "\n";
+    }
+    WriteStringToFile(content, file.path);
+    unique_fd fd(open(file.path, O_CLOEXEC | O_RDONLY));
+
+    WakeupList wakeupList(kCapacity);
+    WakeupReasons wakeupReasons;
+    wakeupReasons.read(fd);
+    wakeupList.update(wakeupReasons);
+
+    size_t allocations = 0;
+    for (auto _ : state) {
+        size_t start = sAllocations;
+        wakeupReasons.read(fd);
+        wakeupList.update(wakeupReasons);
+        allocations += sAllocations - start;
+    }
+    state.counters["allocs_per_iter"] = static_cast<double>(allocations) / state.iterations();
+}
+BENCHMARK(BM_readAndRecordWakeupReasons)->Arg(1)->Arg(4);
+
+// Records wakeups that alternate between range(0) distinct reasons, all of which fit in the
+// wakeup stats.
+static void BM_recordAlternatingWakeupReasons(benchmark::State& state) {
+    std::vector<WakeupReasons> reasons(state.range(0));
+    for (size_t i = 0; i < reasons.size(); i++) {
+        reasons[i].parse(std::to_string(100 + i) + " :android,benchmark-wakeup-reason-" +
+                         std::to_string(i) + "\nAbort: benchmark abort reason\n");
+    }
+
+    WakeupList wakeupList(kCapacity);
+    for (auto _ : state) {
+        for (const auto& r : reasons) {
+            wakeupList.update(r);
+        }
+    }
+}
+BENCHMARK(BM_recordAlternatingWakeupReasons)->Arg(kCapacity);
+
+BENCHMARK_MAIN();
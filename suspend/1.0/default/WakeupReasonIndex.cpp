@@ -0,0 +1,172 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WakeupReasonIndex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <functional>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+static constexpr std::string_view kAbortPrefix = "Abort:";
+
+static std::string_view trimLeft(std::string_view s) {
+    while (!s.empty() && isspace(static_cast<unsigned char>(s.front()))) {
+        s.remove_prefix(1);
+    }
+    return s;
+}
+
+static size_t hashComponent(int32_t type, int32_t irq, std::string_view name) {
+    size_t hash = std::hash<std::string_view>{}(name);
+    hash = hash * 31 + static_cast<size_t>(type);
+    hash = hash * 31 + static_cast<size_t>(irq);
+    return hash;
+}
+
+WakeupReasonIndex::WakeupReasonIndex(size_t capacity) : mCapacity(capacity) {}
+
+/**
+ * Kernel wakeup reason lines are "<irq> <name>" for each IRQ that woke up the system, or
+ * "Abort: <reason>" when suspend was aborted. Anything else is kept as is.
+ */
+void WakeupReasonIndex::parseComponent(std::string_view line, int32_t* type, int32_t* irq,
+                                       std::string_view* name) {
+    if (line.substr(0, kAbortPrefix.size()) == kAbortPrefix) {
+        *type = WakeupComponentInfo::TYPE_ABORT;
+        *irq = -1;
+        *name = trimLeft(line.substr(kAbortPrefix.size()));
+        return;
+    }
+
+    int32_t number = -1;
+    auto [p, ec] = std::from_chars(line.data(), line.data() + line.size(), number);
+    size_t numberLength = p - line.data();
+    if (ec == std::errc() && number >= 0 && numberLength < line.size() &&
+        isspace(static_cast<unsigned char>(line[numberLength]))) {
+        *type = WakeupComponentInfo::TYPE_IRQ;
+        *irq = number;
+        *name = trimLeft(line.substr(numberLength));
+        return;
+    }
+
+    *type = WakeupComponentInfo::TYPE_OTHER;
+    *irq = -1;
+    *name = line;
+}
+
+void WakeupReasonIndex::update(const WakeupReasons& wakeupReasons,
+                               std::chrono::milliseconds suspendTime, int64_t nowMillis) {
+    const auto& reasons = wakeupReasons.get();
+    bool chained = reasons.size() > 1;
+
+    std::scoped_lock lock(mLock);
+
+    for (std::string_view reason : reasons) {
+        int32_t type, irq;
+        std::string_view name;
+        parseComponent(reason, &type, &irq, &name);
+        size_t hash = hashComponent(type, irq, name);
+
+        auto [begin, end] = mLookupTable.equal_range(hash);
+        auto it = std::find_if(begin, end, [&](const auto& entry) {
+            const WakeupComponentInfo& info = mEntries[entry.second].info;
+            return info.type == type && info.irq == irq && info.name == name;
+        });
+
+        size_t index;
+        if (it != end) {
+            index = it->second;
+        } else {
+            if (mCapacity == 0) {
+                return;
+            }
+            if (mEntries.size() >= mCapacity) {
+                evict();
+            }
+            index = mEntries.size();
+            Entry& entry = mEntries.emplace_back();
+            entry.hash = hash;
+            entry.info.type = type;
+            entry.info.irq = irq;
+            entry.info.name = name;
+            mLookupTable.emplace(hash, index);
+        }
+
+        WakeupComponentInfo& info = mEntries[index].info;
+        info.count++;
+        if (chained) {
+            info.chainedCount++;
+        }
+        info.lastSeenMillis = nowMillis;
+        info.lastSuspendTimeMillis = suspendTime.count();
+        info.totalSuspendTimeMillis += suspendTime.count();
+    }
+}
+
+/**
+ * Removes the component that was seen least recently. The last entry of the table is moved in its
+ * place to keep the table compact.
+ */
+void WakeupReasonIndex::evict() {
+    auto victim =
+        std::min_element(mEntries.begin(), mEntries.end(), [](const auto& a, const auto& b) {
+            return a.info.lastSeenMillis < b.info.lastSeenMillis;
+        });
+    size_t index = victim - mEntries.begin();
+    size_t last = mEntries.size() - 1;
+
+    eraseFromLookupTable(mEntries[index].hash, index);
+    if (index != last) {
+        eraseFromLookupTable(mEntries[last].hash, last);
+        mEntries[index] = std::move(mEntries[last]);
+        mLookupTable.emplace(mEntries[index].hash, index);
+    }
+    mEntries.pop_back();
+}
+
+void WakeupReasonIndex::eraseFromLookupTable(size_t hash, size_t index) {
+    auto [begin, end] = mLookupTable.equal_range(hash);
+    for (auto it = begin; it != end; ++it) {
+        if (it->second == index) {
+            mLookupTable.erase(it);
+            return;
+        }
+    }
+}
+
+void WakeupReasonIndex::getComponentStats(std::vector<WakeupComponentInfo>* components) const {
+    size_t start = components->size();
+    {
+        std::scoped_lock lock(mLock);
+        for (const auto& entry : mEntries) {
+            components->push_back(entry.info);
+        }
+    }
+    std::sort(components->begin() + start, components->end(), [](const auto& a, const auto& b) {
+        return a.count > b.count || (a.count == b.count && a.lastSeenMillis > b.lastSeenMillis);
+    });
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_WAKEUP_REASON_INDEX_H
+#define ANDROID_SYSTEM_SUSPEND_WAKEUP_REASON_INDEX_H
+
+#include <android-base/thread_annotations.h>
+#include <android/system/suspend/internal/WakeupComponentInfo.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "WakeupReasons.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using ::android::system::suspend::internal::WakeupComponentInfo;
+
+/*
+ * Stats of the components of the wakeup reasons, i.e. of the IRQs, abort reasons and other reason
+ * lines, as opposed to WakeupList which counts the wakeup reasons of a resume as a whole.
+ * When the index is full, the component that was seen least recently is evicted.
+ * This class is thread safe.
+ */
+class WakeupReasonIndex {
+   public:
+    explicit WakeupReasonIndex(size_t capacity);
+
+    // Records the wakeup reasons of a resume at nowMillis (monotonic time), after a suspend that
+    // lasted suspendTime.
+    void update(const WakeupReasons& wakeupReasons, std::chrono::milliseconds suspendTime,
+                int64_t nowMillis);
+    // Returns the component stats, the most frequent first.
+    void getComponentStats(std::vector<WakeupComponentInfo>* components) const;
+
+    // Splits a wakeup reason line into its type, IRQ number and name, see WakeupComponentInfo.
+    static void parseComponent(std::string_view line, int32_t* type, int32_t* irq,
+                               std::string_view* name);
+
+   private:
+    struct Entry {
+        size_t hash;
+        WakeupComponentInfo info;
+    };
+
+    void evict() REQUIRES(mLock);
+    void eraseFromLookupTable(size_t hash, size_t index) REQUIRES(mLock);
+
+    size_t mCapacity;
+    mutable std::mutex mLock;
+    // Compact table of the components, in no particular order.
+    std::vector<Entry> mEntries GUARDED_BY(mLock);
+    // Index of the entries by hash, the components are compared on lookup to tell collisions apart.
+    std::unordered_multimap<size_t, size_t> mLookupTable GUARDED_BY(mLock);
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_WAKEUP_REASON_INDEX_H
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WakeupReasons.h"
+
+#include <unistd.h>
+
+#include <cctype>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// The reasons of a resume usually fit in a single page.
+static constexpr size_t kInitialBufferSize = 4096;
+static constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+static constexpr uint64_t kFnvPrime = 0x100000001b3ULL;
+
+static uint64_t hashAppend(uint64_t hash, std::string_view s) {
+    for (char c : s) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * kFnvPrime;
+    }
+    return hash;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && isspace(static_cast<unsigned char>(s.front()))) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && isspace(static_cast<unsigned char>(s.back()))) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+/**
+ * Reads with pread() into the reused buffer, doubling it only if the reasons do not fit. sysfs
+ * files must be read up to EOF, a single read may return less than the whole content.
+ */
+bool WakeupReasons::read(int fd) {
+    if (mBuffer.size() < kInitialBufferSize) {
+        mBuffer.resize(kInitialBufferSize);
+    }
+
+    size_t length = 0;
+    while (true) {
+        if (length == mBuffer.size()) {
+            mBuffer.resize(mBuffer.size() * 2);
+        }
+        ssize_t n =
+            TEMP_FAILURE_RETRY(pread(fd, &mBuffer[length], mBuffer.size() - length, length));
+        if (n < 0) {
+            mReasons.clear();
+            mHash = kFnvOffsetBasis;
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        length += n;
+    }
+
+    parseBuffer(length);
+    return true;
+}
+
+void WakeupReasons::parse(std::string_view content) {
+    if (mBuffer.size() < content.size()) {
+        mBuffer.resize(content.size());
+    }
+    content.copy(&mBuffer[0], content.size());
+    parseBuffer(content.size());
+}
+
+void WakeupReasons::parseBuffer(size_t length) {
+    mReasons.clear();
+    mHash = kFnvOffsetBasis;
+
+    std::string_view content(mBuffer.data(), length);
+    while (!content.empty()) {
+        size_t end = content.find('\n');
+        std::string_view line = trim(content.substr(0, end));
+        content.remove_prefix(end == std::string_view::npos ? content.size() : end + 1);
+
+        // Only include non-empty reason lines
+        if (line.empty()) {
+            continue;
+        }
+        if (!mReasons.empty()) {
+            mHash = hashAppend(mHash, ";");
+        }
+        mHash = hashAppend(mHash, line);
+        mReasons.push_back(line);
+    }
+}
+
+std::string WakeupReasons::join() const {
+    std::string joined;
+    for (const auto& reason : mReasons) {
+        if (!joined.empty()) {
+            joined += ';';
+        }
+        joined += reason;
+    }
+    return joined;
+}
+
+bool WakeupReasons::equalsJoined(std::string_view joined) const {
+    for (size_t i = 0; i < mReasons.size(); i++) {
+        if (i > 0) {
+            if (joined.empty() || joined.front() != ';') {
+                return false;
+            }
+            joined.remove_prefix(1);
+        }
+        if (joined.substr(0, mReasons[i].size()) != mReasons[i]) {
+            return false;
+        }
+        joined.remove_prefix(mReasons[i].size());
+    }
+    return joined.empty();
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
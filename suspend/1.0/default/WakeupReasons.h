@@ -0,0 +1,67 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_SUSPEND_WAKEUP_REASONS_H
+#define ANDROID_SYSTEM_SUSPEND_WAKEUP_REASONS_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * Wakeup reasons of the last resume, i.e. the non-empty lines of
+ * /sys/kernel/wakeup_reasons/last_resume_reason with surrounding whitespace trimmed.
+ * The buffers are reused across reads, so that reading the reasons of a resume does not allocate
+ * once they have grown to fit the longest reasons seen.
+ * This class is not thread safe.
+ */
+class WakeupReasons {
+   public:
+    // Reads the wakeup reasons from the start of fd. Returns false if fd could not be read, in
+    // which case there are no reasons.
+    bool read(int fd);
+    // Takes the wakeup reasons from content.
+    void parse(std::string_view content);
+
+    // Valid until the next read() or parse().
+    const std::vector<std::string_view>& get() const { return mReasons; }
+    // Hash of the reasons joined with ';', the key of the reasons in WakeupList.
+    uint64_t hash() const { return mHash; }
+    // Returns the reasons joined with ';'.
+    std::string join() const;
+    // Returns true if the reasons joined with ';' are equal to joined.
+    bool equalsJoined(std::string_view joined) const;
+
+   private:
+    void parseBuffer(size_t length);
+
+    std::string mBuffer;
+    std::vector<std::string_view> mReasons;
+    uint64_t mHash = 0;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
+
+#endif  // ANDROID_SYSTEM_SUSPEND_WAKEUP_REASONS_H
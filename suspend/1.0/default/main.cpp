@@ -26,11 +26,16 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/system_properties.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <thread>
+
 #include <SuspendProperties.sysprop.h>
 
+#include "ProfiledMutex.h"
+#include "SuspendBackoffPolicy.h"
 #include "SuspendControlService.h"
 #include "SystemSuspend.h"
 #include "SystemSuspendAidl.h"
@@ -40,21 +45,28 @@ using aidl::android::system::suspend::SystemSuspendAidl;
 using android::sp;
 using android::status_t;
 using android::String16;
+using android::base::Result;
 using android::base::Socketpair;
 using android::base::unique_fd;
 using android::hardware::configureRpcThreadpool;
 using android::hardware::joinRpcThreadpool;
 using android::system::suspend::V1_0::ISystemSuspend;
+using android::system::suspend::V1_0::ProfiledMutex;
 using android::system::suspend::V1_0::SleepTimeConfig;
+using android::system::suspend::V1_0::SuspendBackoffPolicy;
+using android::system::suspend::V1_0::SuspendBackoffPolicyType;
+using android::system::suspend::V1_0::SuspendCallbackConfig;
 using android::system::suspend::V1_0::SuspendControlService;
 using android::system::suspend::V1_0::SuspendControlServiceInternal;
 using android::system::suspend::V1_0::SystemSuspend;
 using android::system::suspend::V1_0::SystemSuspendHidl;
+using android::system::suspend::V1_0::validateSleepTimeConfig;
 using namespace std::chrono_literals;
 using namespace ::android::sysprop;
 
 static constexpr size_t kStatsCapacity = 1000;
 static constexpr char kSysClassWakeup[] = "/sys/class/wakeup";
+static constexpr char kSysKernelDebugWakeupSources[] = "/sys/kernel/debug/wakeup_sources";
 static constexpr char kSysPowerSuspendStats[] = "/sys/power/suspend_stats";
 static constexpr char kSysPowerWakeupCount[] = "/sys/power/wakeup_count";
 static constexpr char kSysPowerState[] = "/sys/power/state";
@@ -69,6 +81,80 @@ static constexpr uint32_t kDefaultBackoffThresholdCount = 1;
 static constexpr uint32_t kDefaultShortSuspendThresholdMillis = 50;
 static constexpr bool kDefaultFailedSuspendBackoffEnabled = true;
 static constexpr bool kDefaultShortSuspendBackoffEnabled = true;
+static constexpr bool kDefaultEventDrivenAutosuspendEnabled = false;
+static constexpr bool kDefaultWakeupSourcesTableEnabled = false;
+static constexpr uint32_t kDefaultKernelWakelockSampleIntervalMillis = 0;
+static constexpr uint32_t kDefaultWakeupCallbackQueueSize = 16;
+static constexpr uint32_t kDefaultWakeupCallbackDeadlineMillis = 1000;
+static constexpr bool kDefaultWakeupCallbackCoalescingEnabled = false;
+// Percentiles within 25% of the hold durations.
+static constexpr uint32_t kDefaultWakeLockHoldTimeHistogramBytes = 512;
+static constexpr bool kDefaultLockProfilingEnabled = false;
+static constexpr SuspendBackoffPolicyType kDefaultBackoffPolicy =
+    SuspendBackoffPolicyType::EXPONENTIAL;
+static constexpr bool kDefaultSleepTimeConfigWatcherEnabled = false;
+static constexpr SleepTimeConfig kDefaultSleepTimeConfig = {
+    .baseSleepTime = std::chrono::milliseconds(kDefaultBaseSleepTimeMillis),
+    .maxSleepTime = std::chrono::milliseconds(kDefaultMaxSleepTimeMillis),
+    .sleepTimeScaleFactor = kDefaultSleepTimeScaleFactor,
+    .backoffThreshold = kDefaultBackoffThresholdCount,
+    .shortSuspendThreshold = std::chrono::milliseconds(kDefaultShortSuspendThresholdMillis),
+    .failedSuspendBackoffEnabled = kDefaultFailedSuspendBackoffEnabled,
+    .shortSuspendBackoffEnabled = kDefaultShortSuspendBackoffEnabled,
+    .eventDrivenAutosuspendEnabled = kDefaultEventDrivenAutosuspendEnabled,
+    .backoffPolicy = kDefaultBackoffPolicy,
+};
+
+static SleepTimeConfig readSleepTimeConfig() {
+    SuspendBackoffPolicyType backoffPolicy = kDefaultBackoffPolicy;
+    std::optional<std::string> backoffPolicyName = SuspendProperties::backoff_policy();
+    if (backoffPolicyName.has_value() &&
+        !SuspendBackoffPolicy::parseType(*backoffPolicyName, &backoffPolicy)) {
+        LOG(WARNING) << "SystemSuspend: Unknown backoff policy " << *backoffPolicyName;
+    }
+
+    return {
+        .baseSleepTime = std::chrono::milliseconds(
+            SuspendProperties::base_sleep_time_millis().value_or(kDefaultBaseSleepTimeMillis)),
+        .maxSleepTime = std::chrono::milliseconds(
+            SuspendProperties::max_sleep_time_millis().value_or(kDefaultMaxSleepTimeMillis)),
+        .sleepTimeScaleFactor =
+            SuspendProperties::sleep_time_scale_factor().value_or(kDefaultSleepTimeScaleFactor),
+        .backoffThreshold =
+            SuspendProperties::backoff_threshold_count().value_or(kDefaultBackoffThresholdCount),
+        .shortSuspendThreshold =
+            std::chrono::milliseconds(SuspendProperties::short_suspend_threshold_millis().value_or(
+                kDefaultShortSuspendThresholdMillis)),
+        .failedSuspendBackoffEnabled = SuspendProperties::failed_suspend_backoff_enabled().value_or(
+            kDefaultFailedSuspendBackoffEnabled),
+        .shortSuspendBackoffEnabled = SuspendProperties::short_suspend_backoff_enabled().value_or(
+            kDefaultShortSuspendBackoffEnabled),
+        .eventDrivenAutosuspendEnabled =
+            SuspendProperties::event_driven_autosuspend_enabled().value_or(
+                kDefaultEventDrivenAutosuspendEnabled),
+        .backoffPolicy = backoffPolicy,
+    };
+}
+
+// Applies the sleep time config read from SuspendProperties whenever it changes. Invalid configs
+// are logged and ignored.
+static void watchSleepTimeConfig(sp<SystemSuspend> suspend, SleepTimeConfig config) {
+    uint32_t serial = 0;
+    // Wakes up on any property change, the config is only re-applied when one of its properties
+    // changed.
+    while (__system_property_wait(nullptr, serial, &serial, nullptr)) {
+        SleepTimeConfig newConfig = readSleepTimeConfig();
+        if (newConfig == config) {
+            continue;
+        }
+        config = newConfig;
+        Result<int64_t> generation = suspend->setSleepTimeConfig(config);
+        if (!generation.ok()) {
+            LOG(ERROR) << "SystemSuspend: Ignoring sleep time config: "
+                       << generation.error().message();
+        }
+    }
+}
 
 int main() {
     unique_fd wakeupCountFd{TEMP_FAILURE_RETRY(open(kSysPowerWakeupCount, O_CLOEXEC | O_RDWR))};
@@ -79,10 +165,24 @@ int main() {
     if (stateFd < 0) {
         PLOG(ERROR) << "error opening " << kSysPowerState;
     }
-    unique_fd kernelWakelockStatsFd{
-        TEMP_FAILURE_RETRY(open(kSysClassWakeup, O_DIRECTORY | O_CLOEXEC | O_RDONLY))};
+    // Kernel wakelock stats are read from the consolidated wakeup_sources table if enabled and
+    // available, otherwise from one directory per wakeup source under /sys/class/wakeup.
+    unique_fd kernelWakelockStatsFd;
+    if (SuspendProperties::wakeup_sources_table_enabled().value_or(
+            kDefaultWakeupSourcesTableEnabled)) {
+        kernelWakelockStatsFd.reset(
+            TEMP_FAILURE_RETRY(open(kSysKernelDebugWakeupSources, O_CLOEXEC | O_RDONLY)));
+        if (kernelWakelockStatsFd < 0) {
+            PLOG(WARNING) << "SystemSuspend: Error opening " << kSysKernelDebugWakeupSources
+                          << ", falling back to " << kSysClassWakeup;
+        }
+    }
     if (kernelWakelockStatsFd < 0) {
-        PLOG(ERROR) << "SystemSuspend: Error opening " << kSysClassWakeup;
+        kernelWakelockStatsFd.reset(
+            TEMP_FAILURE_RETRY(open(kSysClassWakeup, O_DIRECTORY | O_CLOEXEC | O_RDONLY)));
+        if (kernelWakelockStatsFd < 0) {
+            PLOG(ERROR) << "SystemSuspend: Error opening " << kSysClassWakeup;
+        }
     }
     unique_fd suspendStatsFd{
         TEMP_FAILURE_RETRY(open(kSysPowerSuspendStats, O_DIRECTORY | O_CLOEXEC | O_RDONLY))};
@@ -109,27 +209,29 @@ int main() {
         Socketpair(SOCK_STREAM, &wakeupCountFd, &stateFd);
     }
 
-    SleepTimeConfig sleepTimeConfig = {
-        .baseSleepTime = std::chrono::milliseconds(
-            SuspendProperties::base_sleep_time_millis().value_or(kDefaultBaseSleepTimeMillis)),
-        .maxSleepTime = std::chrono::milliseconds(
-            SuspendProperties::max_sleep_time_millis().value_or(kDefaultMaxSleepTimeMillis)),
-        .sleepTimeScaleFactor =
-            SuspendProperties::sleep_time_scale_factor().value_or(kDefaultSleepTimeScaleFactor),
-        .backoffThreshold =
-            SuspendProperties::backoff_threshold_count().value_or(kDefaultBackoffThresholdCount),
-        .shortSuspendThreshold =
-            std::chrono::milliseconds(SuspendProperties::short_suspend_threshold_millis().value_or(
-                kDefaultShortSuspendThresholdMillis)),
-        .failedSuspendBackoffEnabled = SuspendProperties::failed_suspend_backoff_enabled().value_or(
-            kDefaultFailedSuspendBackoffEnabled),
-        .shortSuspendBackoffEnabled = SuspendProperties::short_suspend_backoff_enabled().value_or(
-            kDefaultShortSuspendBackoffEnabled),
+    SleepTimeConfig sleepTimeConfig = readSleepTimeConfig();
+    if (Result<void> valid = validateSleepTimeConfig(sleepTimeConfig); !valid.ok()) {
+        LOG(ERROR) << "SystemSuspend: Using the default sleep time config, "
+                   << valid.error().message();
+        sleepTimeConfig = kDefaultSleepTimeConfig;
+    }
+
+    SuspendCallbackConfig suspendCallbackConfig = {
+        .queueCapacity = SuspendProperties::wakeup_callback_queue_size().value_or(
+            kDefaultWakeupCallbackQueueSize),
+        .deliveryDeadline =
+            std::chrono::milliseconds(SuspendProperties::wakeup_callback_deadline_millis().value_or(
+                kDefaultWakeupCallbackDeadlineMillis)),
+        .coalesceWakeups = SuspendProperties::wakeup_callback_coalescing_enabled().value_or(
+            kDefaultWakeupCallbackCoalescingEnabled),
     };
 
+    ProfiledMutex::setProfilingEnabled(
+        SuspendProperties::lock_profiling_enabled().value_or(kDefaultLockProfilingEnabled));
+
     configureRpcThreadpool(1, true /* callerWillJoin */);
 
-    sp<SuspendControlService> suspendControl = new SuspendControlService();
+    sp<SuspendControlService> suspendControl = new SuspendControlService(suspendCallbackConfig);
     auto controlStatus =
         android::defaultServiceManager()->addService(String16("suspend_control"), suspendControl);
     if (controlStatus != android::OK) {
@@ -151,6 +253,22 @@ int main() {
         std::move(wakeupCountFd), std::move(stateFd), std::move(suspendStatsFd), kStatsCapacity,
         std::move(kernelWakelockStatsFd), std::move(wakeupReasonsFd), std::move(suspendTimeFd),
         sleepTimeConfig, suspendControl, suspendControlInternal, true /* mUseSuspendCounter*/);
+    if (SuspendProperties::sleep_time_config_watcher_enabled().value_or(
+            kDefaultSleepTimeConfigWatcherEnabled)) {
+        std::thread(watchSleepTimeConfig, suspend, sleepTimeConfig).detach();
+    }
+    suspend->setWakeLockHoldTimeHistogramSize(
+        SuspendProperties::wakelock_hold_time_histogram_bytes().value_or(
+            kDefaultWakeLockHoldTimeHistogramBytes));
+
+    // Kernel wakelock stats are read at query time unless a sample interval is configured.
+    uint32_t kernelWakelockSampleIntervalMillis =
+        SuspendProperties::kernel_wakelock_sample_interval_millis().value_or(
+            kDefaultKernelWakelockSampleIntervalMillis);
+    if (kernelWakelockSampleIntervalMillis > 0) {
+        suspend->startKernelWakelockSampler(
+            std::chrono::milliseconds(kernelWakelockSampleIntervalMillis));
+    }
 
     std::shared_ptr<SystemSuspendAidl> suspendAidl =
         ndk::SharedRefBase::make<SystemSuspendAidl>(suspend.get());